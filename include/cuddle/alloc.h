@@ -0,0 +1,23 @@
+#ifndef KDL_ALLOC_H
+#define KDL_ALLOC_H
+
+#include <stddef.h>
+
+/*
+ * an allocator that documents can grow through instead of fixed buffers.
+ * realloc and free are passed the size the memory was last allocated with,
+ * for allocators that don't keep track themselves. returning NULL from alloc
+ * or realloc is a fatal error.
+ */
+typedef struct kdl_allocator {
+    void *(*alloc)(size_t size, void *ctx);
+    void *(*realloc)(void *ptr, size_t old_size, size_t new_size, void *ctx);
+    void (*free)(void *ptr, size_t size, void *ctx);
+
+    void *ctx;
+} kdl_allocator_t;
+
+// malloc, realloc and free
+extern const kdl_allocator_t KDL_DEFAULT_ALLOCATOR;
+
+#endif
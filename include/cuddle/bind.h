@@ -0,0 +1,123 @@
+#ifndef KDL_BIND_H
+#define KDL_BIND_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <cuddle/tokenize.h>
+
+/*
+ * binds a kdl document straight into c structs as it's tokenized, without
+ * building a kdl_document_t. structs are described by kdl_bind_struct_t tables,
+ * which are meant to be generated from a schema by tools/cuddlegen.
+ *
+ * a struct's fields are matched against the names of child nodes (whose
+ * arguments are the values) and against the properties of the struct's own
+ * node. the top level of a document binds to the root struct. fields that
+ * don't appear keep whatever the caller initialized them to, and unknown
+ * nodes are skipped along with their children.
+ */
+
+#ifndef KDL_BIND_MAX_DEPTH
+#define KDL_BIND_MAX_DEPTH 64
+#endif
+
+typedef enum kdl_bind_kind {
+    KDL_BIND_INT, // long
+    KDL_BIND_DOUBLE,
+    KDL_BIND_BOOL,
+    KDL_BIND_STRING, // fixed size char array
+    KDL_BIND_STRUCT
+} kdl_bind_kind_e;
+
+typedef struct kdl_bind_field {
+    const char *name;
+    size_t name_len;
+    kdl_bind_kind_e kind;
+
+    // size is of a single element, which for strings is the array capacity
+    size_t offset, size;
+
+    // arrays store their length in a size_t at count_offset. 0 for scalars
+    size_t max_count, count_offset;
+
+    const struct kdl_bind_struct *type; // for KDL_BIND_STRUCT
+} kdl_bind_field_t;
+
+typedef struct kdl_bind_struct {
+    const char *name;
+    const kdl_bind_field_t *fields;
+    size_t num_fields;
+
+    /*
+     * perfect hash of field names. slots has mask + 1 entries holding a field
+     * index or -1, and kdl_bind_hash(name, seed) & mask picks the slot.
+     */
+    const short *slots;
+    unsigned seed, mask;
+} kdl_bind_struct_t;
+
+// the state of one struct being filled in
+typedef struct kdl_bind_frame {
+    const kdl_bind_struct_t *type;
+    char *obj;
+} kdl_bind_frame_t;
+
+typedef struct kdl_binder {
+    kdl_tokenizer_t tzr;
+    kdl_token_t token;
+
+    kdl_bind_frame_t frames[KDL_BIND_MAX_DEPTH];
+    size_t depth;
+
+    // the node currently being bound, node_field is NULL for unknown nodes
+    const kdl_bind_field_t *node_field, *prop_field;
+    char *node_obj;
+    bool node_assigned, await_prop;
+} kdl_binder_t;
+
+/*
+ * seeded fnv-1a with a murmur3 finalizer, so that the low bits used for slots
+ * depend on every bit of the seed. the generator and binder must agree on this
+ * exactly.
+ */
+static inline unsigned kdl_bind_hash(
+    const char *name, size_t len, unsigned seed
+) {
+    unsigned hash = 2166136261u ^ seed;
+
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+// returns a field of type, or NULL if there isn't one with this name
+const kdl_bind_field_t *kdl_bind_lookup(
+    const kdl_bind_struct_t *, const char *name, size_t len
+);
+
+// buffers are the same as for kdl_tokenizer_make() and kdl_token_make()
+void kdl_binder_make(
+    kdl_binder_t *, const kdl_bind_struct_t *root, void *out,
+    char *tzr_buf, size_t tzr_buf_size, char *tok_buf
+);
+
+// these return false if the data isn't utf-8, see tzr.utf8.error
+bool kdl_binder_feed(kdl_binder_t *, char *data, size_t length);
+bool kdl_binder_finish(kdl_binder_t *);
+
+// binds a whole document in memory, false if it isn't utf-8
+bool kdl_bind_parse(
+    const kdl_bind_struct_t *root, void *out, char *data, size_t length
+);
+
+#endif
@@ -1,8 +1,17 @@
 #ifndef KDL_CUDDLE_H
 #define KDL_CUDDLE_H
 
+#include "alloc.h"
+#include "input.h"
 #include "tokenize.h"
+#include "span.h"
 #include "serialize.h"
 #include "dom.h"
+#include "profile.h"
+#include "bind.h"
+#include "diff.h"
+#include "cursor.h"
+#include "jik.h"
+#include "extract.h"
 
 #endif
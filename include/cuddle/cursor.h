@@ -0,0 +1,63 @@
+#ifndef KDL_CURSOR_H
+#define KDL_CURSOR_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <cuddle/dom.h>
+
+/*
+ * a cursor walks a document or a subtree of one without recursion. nodes know
+ * their parent and their index among their siblings, so the cursor is all the
+ * state a walk needs and any depth works without allocating.
+ *
+ * kdl_cursor_next() visits every node twice, once entering it before its
+ * children (pre-order) and once leaving it after them (post-order):
+ *
+ * while (kdl_cursor_next(&cursor)) { [ check cursor.event and cursor.node ] }
+ *
+ * the tree shouldn't be changed during a walk. the one exception is that a node
+ * the cursor has left and moved past may be freed, which is how a subtree can
+ * be torn down bottom up.
+ */
+
+typedef enum kdl_cursor_event {
+    KDL_CURSOR_ENTER,
+    KDL_CURSOR_LEAVE
+} kdl_cursor_event_e;
+
+typedef struct kdl_cursor {
+    kdl_document_t *doc;
+    kdl_node_t *root; // NULL walks the whole document
+
+    kdl_node_t *node; // NULL before the first and after the last event
+    kdl_cursor_event_e event;
+    size_t depth; // relative to where the walk started
+
+    bool started;
+} kdl_cursor_t;
+
+/*
+ * root is the subtree to walk, or NULL for the whole document. walking a
+ * subtree never looks at the top level, so doc may be NULL then, unless it's an
+ * on-demand document. those have children blocks loaded as they're entered.
+ */
+void kdl_cursor_make(kdl_cursor_t *, kdl_document_t *, kdl_node_t *root);
+
+// moves to the next event and returns true, or returns false once done
+bool kdl_cursor_next(kdl_cursor_t *);
+
+// after entering a node, makes the next event leaving it without its children
+static inline void kdl_cursor_skip(kdl_cursor_t *cursor) {
+    cursor->event = KDL_CURSOR_LEAVE;
+}
+
+/*
+ * manual movement, these return false without moving if there isn't anywhere
+ * to go. they leave the cursor entering whichever node it lands on.
+ */
+bool kdl_cursor_first_child(kdl_cursor_t *);
+bool kdl_cursor_next_sibling(kdl_cursor_t *);
+bool kdl_cursor_parent(kdl_cursor_t *);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef KDL_DIFF_H
+#define KDL_DIFF_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cuddle/dom.h>
+
+/*
+ * structural hashing and diffing of documents.
+ *
+ * a node's hash covers its name, args, props and children. values are hashed
+ * decoded, so raw lazy values hash the same as eager ones, and props are
+ * hashed without regard to their order. hashes are cached on nodes, so after
+ * the first call only edited subtrees are rehashed.
+ *
+ * equal hashes are taken to mean equal subtrees, which is wrong with odds
+ * around 2^-64 per comparison.
+ */
+
+uint64_t kdl_node_hash(kdl_document_t *, kdl_node_t *);
+uint64_t kdl_document_hash(kdl_document_t *);
+
+static inline bool kdl_document_equal(kdl_document_t *a, kdl_document_t *b) {
+    return kdl_document_hash(a) == kdl_document_hash(b);
+}
+
+typedef enum kdl_diff_op {
+    // index is where the node is among the children of its parent
+    KDL_DIFF_NODE_ADDED, // new_node
+    KDL_DIFF_NODE_REMOVED, // old_node
+    KDL_DIFF_NODE_MOVED, // both, index is in new_node's siblings
+    // both, followed by the edits made within them. there may be none when
+    // only the node's annotation changed
+    KDL_DIFF_NODE_CHANGED,
+
+    // index is of the arg
+    KDL_DIFF_ARG_ADDED, // new_value
+    KDL_DIFF_ARG_REMOVED, // old_value
+    KDL_DIFF_ARG_CHANGED, // both values
+
+    KDL_DIFF_PROP_ADDED, // new_prop
+    KDL_DIFF_PROP_REMOVED, // old_prop
+    KDL_DIFF_PROP_CHANGED // both props
+} kdl_diff_op_e;
+
+/*
+ * one step of an edit script from an old document to a new one. old_node and
+ * new_node are the matched pair the edit happens in, one of which is NULL for
+ * added and removed nodes. anything not listed for an op is NULL.
+ */
+typedef struct kdl_diff_edit {
+    kdl_diff_op_e op;
+    kdl_node_t *old_node, *new_node;
+    size_t index;
+
+    kdl_value_t *old_value, *new_value;
+    kdl_prop_t *old_prop, *new_prop;
+} kdl_diff_edit_t;
+
+typedef void (*kdl_diff_fn)(const kdl_diff_edit_t *, void *ctx);
+
+/*
+ * calls emit for each edit from old_doc to new_doc, in document order. sibling
+ * nodes are matched up with the same nth-node-with-this-name rule merging uses.
+ * subtrees with equal hashes are skipped without being walked, so once both
+ * documents are hashed only changed subtrees and their siblings are visited.
+ */
+void kdl_document_diff(
+    kdl_document_t *old_doc, kdl_document_t *new_doc, kdl_diff_fn emit,
+    void *ctx
+);
+
+#endif
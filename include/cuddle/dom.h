@@ -3,25 +3,59 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <cuddle/htable.h>
+#include <cuddle/input.h>
+#include <cuddle/span.h>
 
-// a tagged union for arguments and property values
+// strings up to this long are kept in the value itself
+#define KDL_SMALL_STR_LEN 15
+
+// where the text of a string or raw value is, see kdl_value_text()
+typedef enum kdl_str_storage {
+    KDL_STR_POINTER, // data.string, for values from outside a document
+    KDL_STR_SMALL, // data.small
+    KDL_STR_TABLE // data.str_ref, in the document's data table
+} kdl_str_storage_e;
+
+/*
+ * a tagged union for arguments and property values, packed into 32 bytes.
+ * values in a document never hold pointers, so read strings and annotations
+ * through kdl_value_text() and kdl_value_annotation().
+ */
 typedef struct kdl_value {
     enum kdl_value_type {
         KDL_STRING,
         KDL_NUMBER,
         KDL_BOOL,
-        KDL_NULL
+        KDL_NULL,
+        // native types, only produced by annotation decoders
+        KDL_INT,
+        KDL_UINT,
+        KDL_UUID,
+        KDL_TIMESTAMP
     } type;
 
+    // loaded lazily and not decoded yet, see kdl_value_decode()
+    bool raw;
+
+    unsigned char storage; // kdl_str_storage_e
+
+    // the type annotation without parens, a count of 0 if there isn't one
+    kdl_href_t annotation_ref;
+
     union kdl_value_data {
         char *string;
+        kdl_href_t str_ref;
+        char small[KDL_SMALL_STR_LEN + 1];
         double number;
         bool boolean;
+        int64_t integer;
+        uint64_t uinteger;
+        unsigned char uuid[16];
+        int64_t timestamp; // microseconds since the unix epoch, utc
     } data;
-
-    kdl_href_t str_ref;
 } kdl_value_t;
 
 // a key/value pair for properties
@@ -38,33 +72,371 @@ typedef struct kdl_node {
     kdl_href_t id_ref, self_ref;
     bool id_is_identifier;
 
-    // these arrays are alloc'd in a kdl_document data_table
+    char *annotation; // or NULL
+    kdl_href_t annotation_ref;
+
+    struct kdl_node *parent; // NULL for top level nodes
+    size_t index; // among its siblings
+
+    /*
+     * subtree hash cache, see kdl_node_hash(). the mutation api invalidates a
+     * node and its ancestors, so edit nodes through it to keep this correct.
+     */
+    uint64_t hash;
+    bool hash_valid;
+
+    /*
+     * these arrays are alloc'd in a kdl_document data_table on first use. with
+     * fixed buffers they grow in place up to the data block size, and with an
+     * allocator they grow without a limit but may move.
+     */
     kdl_value_t *args;
     kdl_prop_t *props;
     struct kdl_node **children;
     kdl_href_t args_ref, props_ref, children_ref;
     size_t num_args, num_props, num_children;
+    size_t cap_args, cap_props, cap_children;
+
+    /*
+     * in an on-demand document, a children block that hasn't been loaded yet.
+     * it's the source text between the braces, see kdl_node_expand().
+     */
+    bool children_deferred;
+    size_t children_start, children_end;
 } kdl_node_t;
 
+#define KDL_LIMITS_X\
+    X(KDL_LIMIT_NONE),\
+    X(KDL_LIMIT_INPUT_BYTES),\
+    X(KDL_LIMIT_DEPTH),\
+    X(KDL_LIMIT_NODES),\
+    X(KDL_LIMIT_ARGS),\
+    X(KDL_LIMIT_PROPS),\
+    X(KDL_LIMIT_STRING_LEN),\
+    X(KDL_LIMIT_ARENA_BYTES)
+
+#define X(name) name
+typedef enum kdl_limit {
+    KDL_LIMITS_X
+} kdl_limit_e;
+#undef X
+
+extern const char KDL_LIMITS[][32];
+
+/*
+ * bounds for loading untrusted input, where 0 means no bound. a load stops at
+ * the first token that would go over one, see kdl_document_t.limits.
+ */
+typedef struct kdl_limits {
+    size_t max_input_bytes; // per load
+    size_t max_depth; // how deep children blocks nest
+    size_t max_nodes; // in the document
+    size_t max_args, max_props; // per node
+    size_t max_string_len; // names, annotations and strings, in bytes
+    size_t max_arena_bytes; // requested by both tables, see kdl_htable_stats_t
+} kdl_limits_t;
+
+// which limit stopped a load, and about where in the input
+typedef struct kdl_limit_error {
+    kdl_limit_e limit;
+    size_t max, offset;
+} kdl_limit_error_t;
+
+// a value which an annotation decoder rejected, see kdl_annotation_fn
+typedef struct kdl_decode_error {
+    bool rejected;
+    // the value's annotation, which lives in the document until it's reset
+    const char *annotation;
+    size_t offset; // of the value
+} kdl_decode_error_t;
+
 typedef struct kdl_document {
     kdl_htable_t node_table, data_table;
 
     // allocated in data_table
     kdl_node_t **nodes;
     kdl_href_t nodes_ref;
-    size_t num_nodes;
+    size_t num_nodes, cap_nodes;
+
+    /*
+     * set before loading to keep escaped strings and numbers as raw text until
+     * they're accessed through kdl_value_decode() or the kdl_value_* getters.
+     * for sparse reads this skips most of the decoding work.
+     */
+    bool lazy_values;
+
+    /*
+     * set before loading to convert annotated values as they're loaded, see
+     * kdl_annotation_decoder_t. values with a decoder are never left raw.
+     */
+    const struct kdl_annotation_decoder *decoders;
+    size_t num_decoders;
+
+    /*
+     * set before loading from a file or memory to only load the top level. a
+     * children block is skipped over and loaded the first time it's needed,
+     * which for big documents that are mostly left alone saves most of the
+     * work. the source has to stay alive, memory passed to
+     * kdl_document_load_memory() is used in place and files are mapped.
+     */
+    bool on_demand;
+    const char *source;
+    size_t source_len;
+    bool source_mapped;
+
+    /*
+     * set before loading to record where every node and value is in the
+     * source, see kdl_node_span(). spans are byte offsets into what was
+     * loaded, and come from the allocator, or malloc with fixed buffers.
+     */
+    bool record_spans;
+    kdl_span_table_t spans;
+
+    /*
+     * set before loading to bound what input can make the document do. a load
+     * that hits a limit returns false with limit_error saying which, and leaves
+     * what it loaded so far for kdl_document_reset() to clear. tokens too long
+     * for the tokenizer hit KDL_LIMIT_STRING_LEN instead of being an error.
+     * with fixed buffers, pick limits that fit in them.
+     */
+    const kdl_limits_t *limits;
+    kdl_limit_error_t limit_error;
+
+    // a load that found input which isn't utf-8 returns false with this set
+    kdl_utf8_error_t utf8_error;
+    // and one with a value that a decoder rejected with this
+    kdl_decode_error_t decode_error;
 } kdl_document_t;
 
-// fill this in and pass to make. you are responsible for freeing the memory.
+/*
+ * annotation decoders convert values annotated with their type to a native
+ * representation. text is the value as it was written for numbers, decoded for
+ * strings, and NULL otherwise. val starts out as it would be loaded, and a
+ * decoder changes it in place; if val is left a string it's copied into the
+ * document afterwards. returning false rejects the value, which is left null
+ * and stops the load with decode_error set.
+ */
+typedef bool (*kdl_annotation_fn)(const char *text, kdl_value_t *val);
+
+typedef struct kdl_annotation_decoder {
+    const char *type;
+    kdl_annotation_fn decode;
+} kdl_annotation_decoder_t;
+
+/*
+ * decoders for the types the kdl spec reserves:
+ * - i8 i16 i32 i64 isize: integer numbers to KDL_INT, range checked
+ * - u8 u16 u32 u64 usize: integer numbers to KDL_UINT, range checked
+ * - uuid: strings in 8-4-4-4-12 hex form to KDL_UUID
+ * - date-time: rfc 3339 strings to KDL_TIMESTAMP
+ * - date: YYYY-MM-DD strings to KDL_TIMESTAMP at midnight
+ */
+extern const kdl_annotation_decoder_t KDL_STD_DECODERS[];
+extern const size_t KDL_NUM_STD_DECODERS;
+
+/*
+ * fixed-buffer mode, for when a document shouldn't touch the heap. fill this in
+ * and pass to make. you are responsible for freeing the memory. each table also
+ * needs KDL_HTABLE_META_LEN() of its block count in bookkeeping.
+ */
 typedef struct kdl_document_buffers {
     size_t num_node_blocks; // node block size should be sizeof(kdl_node_t)
     size_t num_data_blocks, data_block_size;
 
     void *node_blocks, *data_blocks;
+    unsigned *node_meta, *data_meta;
 } kdl_document_buffers_t;
 
+// memory usage of a document's buffers, for sizing kdl_document_buffers_t
+typedef struct kdl_document_stats {
+    kdl_htable_stats_t nodes, data;
+} kdl_document_stats_t;
+
 void kdl_document_make(kdl_document_t *, kdl_document_buffers_t *);
-void kdl_document_load_file(kdl_document_t *, const char *filename);
+// a document which grows through an allocator, see kdl_document_free()
+void kdl_document_make_alloc(kdl_document_t *, const kdl_allocator_t *);
+/*
+ * empties a document to be loaded again. it keeps its memory, and settings
+ * like lazy_values and decoders, so loading something about the same size
+ * again doesn't allocate. hrefs into the document go stale.
+ */
+void kdl_document_reset(kdl_document_t *);
+// gives back a document's memory, which is a no-op for fixed buffers
+void kdl_document_free(kdl_document_t *);
+/*
+ * loads return false when they stop at one of the document's limits, at input
+ * which isn't utf-8 or at a value a decoder rejects, and are otherwise always
+ * true.
+ */
+// loads everything an input has to give, see cuddle/input.h
+bool kdl_document_load(kdl_document_t *, kdl_input_t *);
+// reads through io_uring where it's available, or maps the file for on_demand
+bool kdl_document_load_file(kdl_document_t *, const char *filename);
+bool kdl_document_load_memory(
+    kdl_document_t *, const char *data, size_t length
+);
+/*
+ * loads the same as kdl_document_load(), but reads and tokenizes on a second
+ * thread while this one builds the tree, which pays off for big inputs with a
+ * core to spare. the input is only read from the second thread. buffers come
+ * from the document's allocator, or malloc with fixed buffers. falls back to
+ * loading on one thread if a thread can't be started, or if the document
+ * records spans or has limits.
+ */
+bool kdl_document_load_pipelined(kdl_document_t *, kdl_input_t *);
+bool kdl_document_load_file_pipelined(kdl_document_t *, const char *filename);
+
+void kdl_document_stats(kdl_document_t *, kdl_document_stats_t *);
+
+/*
+ * loads a deferred children block, see kdl_document_t.on_demand. a block that
+ * hits a limit is left partly loaded, with limit_error set. utf8_error and
+ * decode_error work the same way.
+ */
+void kdl_node_load_children(kdl_document_t *, kdl_node_t *);
+
+// call before using a node's children fields in an on-demand document
+static inline void kdl_node_expand(kdl_document_t *doc, kdl_node_t *node) {
+    if (node->children_deferred)
+        kdl_node_load_children(doc, node);
+}
+
+// loads every children block an on-demand document has left
+void kdl_document_expand(kdl_document_t *);
+
+/*
+ * where a node or value was in the source, returning false if it has none.
+ * a node's span runs from its annotation or name to the end of its last value
+ * or its '}', an arg's from its annotation and a prop's from its name. nodes
+ * made through the mutation api or clones don't have spans, and changing a
+ * node's values drops the spans of its values.
+ */
+bool kdl_node_span(kdl_document_t *, kdl_node_t *, kdl_span_t *);
+bool kdl_arg_span(kdl_document_t *, kdl_node_t *, size_t index, kdl_span_t *);
+bool kdl_prop_span(
+    kdl_document_t *, kdl_node_t *, size_t index, kdl_span_t *
+);
+/*
+ * the line and column of an offset into the source of the last load. lines
+ * are indexed on first use when the document holds its source, otherwise
+ * while loading.
+ */
+kdl_location_t kdl_document_locate(kdl_document_t *, size_t offset);
+
+/*
+ * decodes a raw value in place (a no-op for values that aren't raw) and
+ * returns it. the result is remembered, so only the first access pays.
+ */
+kdl_value_t *kdl_value_decode(kdl_document_t *, kdl_value_t *);
+
+/*
+ * the text of a string or raw value as it's stored, without decoding it. small
+ * strings are inside the value, so the pointer only lasts until the array the
+ * value is in changes.
+ */
+static inline char *kdl_value_text(kdl_document_t *doc, kdl_value_t *val) {
+    switch (val->storage) {
+    case KDL_STR_SMALL:
+        return val->data.small;
+    case KDL_STR_TABLE:
+        return kdl_htable_get(&doc->data_table, &val->data.str_ref);
+    default:
+        return val->data.string;
+    }
+}
+
+static inline char *kdl_value_string(kdl_document_t *doc, kdl_value_t *val) {
+    return kdl_value_text(doc, kdl_value_decode(doc, val));
+}
+
+static inline double kdl_value_number(kdl_document_t *doc, kdl_value_t *val) {
+    return kdl_value_decode(doc, val)->data.number;
+}
+
+// the type annotation without parens, or NULL
+static inline char *kdl_value_annotation(
+    kdl_document_t *doc, kdl_value_t *val
+) {
+    return kdl_htable_get(&doc->data_table, &val->annotation_ref);
+}
+
+/*
+ * mutation. nodes are referred to by their self_ref, which goes stale once the
+ * node is removed; passing a stale handle to any of these is an error, and
+ * kdl_node_get() returns NULL for one. a NULL parent means the top level.
+ *
+ * ids and string values are copied into the document, and everything a node
+ * owns is freed back to its tables when it's removed. values passed in are
+ * either from this document or built with a plain data.string, which can't
+ * carry an annotation.
+ */
+kdl_node_t *kdl_node_get(kdl_document_t *, kdl_href_t *node);
+
+kdl_href_t kdl_node_append(
+    kdl_document_t *, kdl_href_t *parent, const char *id
+);
+kdl_href_t kdl_node_insert(
+    kdl_document_t *, kdl_href_t *parent, size_t index, const char *id
+);
+// removes a node along with its children
+void kdl_node_remove(kdl_document_t *, kdl_href_t *node);
+// moves a node to index among its siblings
+void kdl_node_move(kdl_document_t *, kdl_href_t *node, size_t index);
+
+void kdl_node_push_arg(kdl_document_t *, kdl_href_t *node, kdl_value_t *);
+void kdl_node_erase_arg(kdl_document_t *, kdl_href_t *node, size_t index);
+
+// replaces the value of a prop with this id, or adds one
+void kdl_node_set_prop(
+    kdl_document_t *, kdl_href_t *node, const char *id, kdl_value_t *
+);
+// returns whether there was a prop with this id
+bool kdl_node_remove_prop(kdl_document_t *, kdl_href_t *node, const char *id);
+
+/*
+ * clones src into a new document made from bufs, or with src's allocator when
+ * bufs is NULL (KDL_DEFAULT_ALLOCATOR if src has fixed buffers). when bufs has
+ * the same block sizes as src and enough blocks, or dst has an allocator, both
+ * tables are copied in bulk and their pointers relocated, otherwise nodes are
+ * copied one at a time.
+ */
+void kdl_document_clone(
+    kdl_document_t *dst, kdl_document_buffers_t *bufs, kdl_document_t *src
+);
+
+/*
+ * merging layers an overlay document onto a base. at each level, the nth
+ * overlay node with some id is matched with the nth base node with that id,
+ * and what happens next depends on the mode for that id.
+ */
+typedef enum kdl_merge_mode {
+    // args and the annotation are replaced if the overlay has any, props are
+    // overridden one by one, and children are merged recursively
+    KDL_MERGE_OVERRIDE,
+    // the overlay node replaces the base node in the same position
+    KDL_MERGE_REPLACE,
+    // the overlay node is added after the base nodes without matching
+    KDL_MERGE_APPEND
+} kdl_merge_mode_e;
+
+typedef struct kdl_merge_rule {
+    const char *id;
+    kdl_merge_mode_e mode;
+} kdl_merge_rule_t;
+
+typedef struct kdl_merge_rules {
+    kdl_merge_mode_e default_mode; // for ids without a rule
+    const kdl_merge_rule_t *rules;
+    size_t num_rules;
+} kdl_merge_rules_t;
+
+/*
+ * merges overlay into doc. clone the base first to merge into a new document,
+ * layers can then be merged one after another.
+ */
+void kdl_document_merge(
+    kdl_document_t *doc, kdl_document_t *overlay, const kdl_merge_rules_t *
+);
 
 void kdl_document_debug(kdl_document_t *);
 
@@ -0,0 +1,139 @@
+#ifndef KDL_EXTRACT_H
+#define KDL_EXTRACT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cuddle/tokenize.h>
+#include <cuddle/input.h>
+
+/*
+ * pulls selected nodes out of a document in one streaming pass, without
+ * building a kdl_document_t. nodes are selected by rules, which are paths or
+ * predicates, and matching nodes and their values are passed to a callback.
+ *
+ * a path is node names separated by '>', starting from the top level, like
+ * "server > port". '*' stands for any one node, and '**' for any number of
+ * levels, so "** > package" is every package node however deep it is.
+ *
+ * a block of children that no rule can match anything in is skipped by brace
+ * matching, without its strings or numbers being decoded, and values are only
+ * decoded for matching nodes. work is mostly proportional to what's selected.
+ */
+
+#ifndef KDL_EXTRACT_MAX_DEPTH
+#define KDL_EXTRACT_MAX_DEPTH 64
+#endif
+
+// rules are bits in a uint64_t, and so are the segments of all paths
+#define KDL_EXTRACT_MAX_RULES 64
+#define KDL_EXTRACT_MAX_SEGMENTS 64
+
+// what a predicate wants done with a node, as flags
+#define KDL_EXTRACT_MATCH 1 // pass the node and its values to the callback
+#define KDL_EXTRACT_DESCEND 2 // keep asking about its children
+
+/*
+ * predicates are asked about nodes by name and depth (0 at the top level).
+ * they're asked about the top level, and then about the children of every node
+ * they return KDL_EXTRACT_DESCEND for.
+ */
+typedef unsigned (*kdl_extract_pred_fn)(
+    const char *name, size_t depth, void *ctx
+);
+
+typedef enum kdl_extract_event_type {
+    KDL_EXTRACT_NODE, // a matching node
+    KDL_EXTRACT_ARG, // an argument of the last matching node
+    KDL_EXTRACT_PROP // a property of the last matching node
+} kdl_extract_event_e;
+
+typedef struct kdl_extract_event {
+    kdl_extract_event_e type;
+
+    // bit i is set for rule i, for every rule matching the node
+    uint64_t rules;
+    size_t depth;
+
+    // the node's name, or the property's
+    const char *name;
+    // the node's or value's annotation, or NULL
+    const char *annotation;
+    // a decoded value for args and props, which is never raw
+    const kdl_token_t *value;
+} kdl_extract_event_t;
+
+typedef void (*kdl_extract_fn)(const kdl_extract_event_t *, void *ctx);
+
+typedef struct kdl_extract_segment {
+    const char *name;
+    size_t name_len, rule;
+
+    bool any_name, any_depth, last;
+} kdl_extract_segment_t;
+
+typedef struct kdl_extract_pred {
+    kdl_extract_pred_fn fn;
+    void *ctx;
+    size_t rule;
+} kdl_extract_pred_t;
+
+// which segments and predicates apply to the nodes at a depth
+typedef struct kdl_extract_frame {
+    uint64_t segments, preds;
+} kdl_extract_frame_t;
+
+typedef struct kdl_extractor {
+    kdl_tokenizer_t tzr;
+    kdl_token_t token;
+
+    kdl_extract_fn callback;
+    void *ctx;
+
+    // rules
+    kdl_extract_segment_t segments[KDL_EXTRACT_MAX_SEGMENTS];
+    kdl_extract_pred_t preds[KDL_EXTRACT_MAX_RULES];
+    size_t num_segments, num_preds, num_rules;
+
+    // matching state
+    kdl_extract_frame_t frames[KDL_EXTRACT_MAX_DEPTH + 1];
+    size_t depth;
+
+    // the last node, and what applies to its children
+    kdl_extract_frame_t node_children;
+    uint64_t node_rules;
+
+    // text held on to while the next token is read
+    char *prop_name, *annotation;
+    bool await_prop, has_annotation;
+} kdl_extractor_t;
+
+/*
+ * tok_buf needs 3 * tzr_buf_size bytes, to hold a property name and an
+ * annotation alongside the current token.
+ */
+void kdl_extractor_make(
+    kdl_extractor_t *, kdl_extract_fn callback, void *ctx,
+    char *tzr_buf, size_t tzr_buf_size, char *tok_buf
+);
+
+/*
+ * rules return their index, and have to be added before feeding. paths aren't
+ * copied, so they need to outlive the extractor.
+ */
+size_t kdl_extractor_add_path(kdl_extractor_t *, const char *path);
+size_t kdl_extractor_add_pred(
+    kdl_extractor_t *, kdl_extract_pred_fn fn, void *ctx
+);
+
+/*
+ * feeding and finishing return false if the data isn't utf-8, and the stream
+ * is done with then, see tzr.utf8.error
+ */
+bool kdl_extractor_feed(kdl_extractor_t *, const char *data, size_t length);
+bool kdl_extractor_finish(kdl_extractor_t *);
+// feeds everything an input has to give and finishes
+bool kdl_extractor_read(kdl_extractor_t *, kdl_input_t *);
+
+#endif
@@ -1,54 +1,125 @@
 #ifndef KDL_HTABLE_H
 #define KDL_HTABLE_H
 
+#include <stddef.h>
 #include <stdbool.h>
 
-#ifndef KDL_HTABLE_SIZE
-#define KDL_HTABLE_SIZE ((unsigned short)4096)
-#endif
+#include <cuddle/alloc.h>
+
+// how many unsigneds of bookkeeping a table of fixed blocks needs
+#define KDL_HTABLE_META_LEN(num_blocks) (3 * (size_t)(num_blocks))
 
 /*
  * a "memory resource" which manages blocks of memory using a handle table and
- * weak references
+ * weak references.
+ *
+ * without an allocator, blocks are equally sized and come from one buffer the
+ * caller supplies. with one, every block is its own allocation of the size it
+ * was asked for, and the table grows as needed.
  */
 typedef struct kdl_htable {
-    // memory is separated into equally sized blocks
-    char *blocks;
-    size_t block_size, num_blocks;
+    const kdl_allocator_t *allocator; // NULL for fixed blocks
+
+    char *blocks; // fixed blocks
+    char **ptrs; // allocated blocks, NULL once freed
+    unsigned *caps; // bytes behind each of ptrs, which reset() holds on to
+    size_t block_size; // 0 with an allocator
+    size_t num_blocks; // how many blocks there's bookkeeping for
 
     // counts represents the generation of each block if it is allocated
-    unsigned short counts[KDL_HTABLE_SIZE];
+    unsigned *counts;
 
     // reusable is a stack of freed blocks that can be reused
     // if num_reusable is 0, just allocate max_used (the next block up)
-    unsigned short reusable[KDL_HTABLE_SIZE];
+    unsigned *reusable;
     size_t num_reusable, max_used;
+
+    // accounting, sizes holds the bytes requested for each allocated block
+    unsigned *sizes;
+    size_t bytes_requested, num_allocs;
 } kdl_htable_t;
 
+/*
+ * a generation checked handle to a block. counts are bumped on both alloc and
+ * free, so a live block always has an odd count and a count of 0 never refers
+ * to anything.
+ */
 typedef struct kdl_href {
-    unsigned short index, count;
+    unsigned index, count;
 } kdl_href_t;
 
+// a snapshot of how a table is being used, see kdl_htable_stats()
+typedef struct kdl_htable_stats {
+    size_t num_blocks, block_size;
+    size_t blocks_in_use;
+    size_t max_used; // high-water mark in blocks
+    size_t num_reusable; // depth of the reusable stack
+    size_t num_allocs; // lifetime calls to alloc()
+
+    size_t bytes_requested; // sum of sizes passed to alloc() for live blocks
+    size_t bytes_reserved; // blocks_in_use * block_size, or requested
+    size_t bytes_wasted; // internal fragmentation, reserved - requested
+} kdl_htable_stats_t;
+
+/*
+ * a table of fixed blocks keeps its bookkeeping in meta, which is
+ * KDL_HTABLE_META_LEN(num_blocks) long and, like blocks, the caller's to free
+ */
 void kdl_htable_make(
-    kdl_htable_t *, void *blocks, size_t block_size, size_t num_blocks
+    kdl_htable_t *, void *blocks, size_t block_size, size_t num_blocks,
+    unsigned *meta
 );
+void kdl_htable_make_alloc(kdl_htable_t *, const kdl_allocator_t *);
+
+// gives back everything an allocator table holds, a no-op for fixed blocks
+void kdl_htable_release(kdl_htable_t *);
 
 void *kdl_htable_alloc(kdl_htable_t *, kdl_href_t *, size_t size);
 
+/*
+ * changes the size of an allocation. fixed blocks never move since every block
+ * is the same size, so this only updates accounting and checks bounds. blocks
+ * from an allocator may move.
+ */
+void *kdl_htable_realloc(kdl_htable_t *, kdl_href_t *, size_t size);
+
+// errors on a stale reference rather than freeing a block twice
+void kdl_htable_free(kdl_htable_t *, kdl_href_t *);
+
 // there is no reason you can't reuse a handle table, just clear() it
-static inline void kdl_htable_clear(kdl_htable_t *table) {
-    kdl_htable_make(table, table->blocks, table->block_size, table->num_blocks);
-}
+void kdl_htable_clear(kdl_htable_t *);
+
+/*
+ * frees every block like clear(), but keeps the memory behind them for the
+ * blocks allocated next, so refilling a table to about where it was doesn't
+ * call the allocator at all. counts carry on, so earlier hrefs go stale instead
+ * of coming back to life.
+ */
+void kdl_htable_reset(kdl_htable_t *);
+
+/*
+ * copies src's blocks and bookkeeping into a freshly made dst so that every
+ * href carries over. fixed blocks in dst need to be the same size as src's
+ * fixed blocks, and there need to be enough of them, otherwise this returns
+ * false and leaves dst alone. pointers into the blocks are the caller's to
+ * relocate.
+ */
+bool kdl_htable_copy(kdl_htable_t *dst, kdl_htable_t *src);
+
+void kdl_htable_stats(kdl_htable_t *, kdl_htable_stats_t *);
 
-static inline void kdl_htable_free(kdl_htable_t *table, kdl_href_t *ref) {
-    ++table->counts[ref->index];
-    table->reusable[table->num_reusable++] = ref->index;
+// the block at an index, whether or not it's allocated
+static inline void *kdl_htable_block(kdl_htable_t *table, size_t index) {
+    return table->allocator
+        ? table->ptrs[index]
+        : table->blocks + index * table->block_size;
 }
 
-// gets the actual pointer to a block of data given a reference
+// gets the actual pointer to a block of data given a reference, or NULL if the
+// block has been freed since
 static inline void *kdl_htable_get(kdl_htable_t *table, kdl_href_t *ref) {
-    return (table->counts[ref->index] == ref->count)
-        ? table->blocks + ref->index * table->block_size
+    return ref->count && table->counts[ref->index] == ref->count
+        ? kdl_htable_block(table, ref->index)
         : NULL;
 }
 
@@ -0,0 +1,89 @@
+#ifndef KDL_INPUT_H
+#define KDL_INPUT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * sources of bytes for documents to load from. read hands out the next chunk
+ * of input and returns its length, or 0 once the input is over. a chunk only
+ * has to stay valid until the next call to read.
+ */
+typedef size_t (*kdl_read_fn)(const char **data, void *ctx);
+
+// how many reads an io_uring input keeps in flight, its buffer is split evenly
+#define KDL_URING_DEPTH 4
+
+// io_uring state, this is only used on linux
+typedef struct kdl_uring {
+    int ring_fd;
+
+    // shared with the kernel
+    void *sq_ptr, *cq_ptr, *sqes;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+
+    // pieces of the buffer, queued in file order while their reads are out
+    size_t piece_size;
+    long long offsets[KDL_URING_DEPTH];
+    int results[KDL_URING_DEPTH];
+    bool in_flight[KDL_URING_DEPTH], done[KDL_URING_DEPTH];
+
+    unsigned queue[KDL_URING_DEPTH];
+    unsigned queue_start, queue_len;
+    int handed_out; // the piece the last chunk came from, or -1
+
+    long long next_offset;
+    bool eof;
+} kdl_uring_t;
+
+typedef struct kdl_input {
+    kdl_read_fn read;
+    void *ctx;
+
+    // state for the built in sources
+    const char *data;
+    size_t length;
+
+    FILE *fp;
+    int fd;
+    char *buf;
+    size_t buf_size;
+
+    bool uring_active;
+    kdl_uring_t uring;
+} kdl_input_t;
+
+// a custom source
+void kdl_input_make(kdl_input_t *, kdl_read_fn read, void *ctx);
+// hands out the whole of data at once, without copying
+void kdl_input_memory(kdl_input_t *, const char *data, size_t length);
+// reads a file descriptor into buf, with read-ahead where the os allows it
+void kdl_input_fd(kdl_input_t *, int fd, char *buf, size_t buf_size);
+void kdl_input_file(kdl_input_t *, FILE *fp, char *buf, size_t buf_size);
+/*
+ * reads a file through io_uring, keeping KDL_URING_DEPTH reads into pieces of
+ * buf in flight so the next chunk is read while the last one is tokenized.
+ * needs linux 5.6, and falls back to kdl_input_fd() when io_uring isn't there
+ * or fd isn't seekable, like a pipe.
+ */
+void kdl_input_uring(kdl_input_t *, int fd, char *buf, size_t buf_size);
+// waits out reads still in flight, doesn't close the fd or FILE
+void kdl_input_close(kdl_input_t *);
+
+/*
+ * maps a whole file to read it in place, returning NULL for an empty file. the
+ * mapping lasts until kdl_unmap_file().
+ */
+const char *kdl_map_file(const char *filename, size_t *length);
+void kdl_unmap_file(const char *data, size_t length);
+
+// returns the next chunk of input, see kdl_read_fn
+static inline size_t kdl_input_read(kdl_input_t *input, const char **data) {
+    return input->read(data, input->ctx);
+}
+
+#endif
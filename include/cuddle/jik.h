@@ -0,0 +1,142 @@
+#ifndef KDL_JIK_H
+#define KDL_JIK_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <cuddle/tokenize.h>
+#include <cuddle/serialize.h>
+
+/*
+ * streaming transcoding between json and json-in-kdl (jik). neither direction
+ * builds a document, tokens are written out as they're read, so memory use
+ * only depends on the longest token and how deeply things nest.
+ *
+ * in jik every node is a json value. nodes are named by their key in objects
+ * and '-' everywhere else:
+ *
+ *     - 1                      // 1
+ *     - 1 2 3                  // [1, 2, 3]
+ *     - a=1 b=2                // {"a": 1, "b": 2}
+ *     - 1 { - 2; - { x 3; }; } // [1, 2, {"x": 3}]
+ *     (array)-                 // []
+ *     (object)- { - 1; }       // {"-": 1}
+ *
+ * args and children make arrays, and props and children make objects. a node
+ * with only children is an array if its first child is named '-' and an object
+ * otherwise, which (array) and (object) annotations override. a node with
+ * nothing in it needs one of them.
+ */
+
+#ifndef KDL_JIK_MAX_DEPTH
+#define KDL_JIK_MAX_DEPTH 1024
+#endif
+
+typedef enum kdl_jik_container {
+    KDL_JIK_UNDECIDED, // children block waiting on its first child's name
+    KDL_JIK_ARRAY,
+    KDL_JIK_OBJECT
+} kdl_jik_container_e;
+
+/*
+ * jik to json
+ */
+
+typedef enum kdl_jik_node {
+    KDL_JIK_NODE_NONE,
+    KDL_JIK_NODE_EMPTY,
+    KDL_JIK_NODE_LITERAL, // one arg, which is in pending
+    KDL_JIK_NODE_ARRAY,
+    KDL_JIK_NODE_OBJECT
+} kdl_jik_node_e;
+
+typedef struct kdl_jik_decoder {
+    kdl_tokenizer_t tzr;
+    kdl_token_t token;
+    kdl_output_t *out;
+
+    // a node's first arg, held until it's clear whether it's alone
+    kdl_token_t pending;
+
+    kdl_jik_container_e containers[KDL_JIK_MAX_DEPTH];
+    size_t depth;
+
+    // the node currently being read and its annotation
+    kdl_jik_node_e node;
+    kdl_jik_container_e annotation, next_annotation;
+
+    // whether nothing has been written to the innermost json container yet
+    bool first;
+    bool await_prop;
+    bool has_root;
+} kdl_jik_decoder_t;
+
+/*
+ * buffers are the same as for kdl_tokenizer_make() and kdl_token_make(), and
+ * pending_buf needs to be the same size as tok_buf.
+ */
+void kdl_jik_decoder_make(
+    kdl_jik_decoder_t *, kdl_output_t *out, char *tzr_buf, size_t tzr_buf_size,
+    char *tok_buf, char *pending_buf
+);
+// these return false if the data isn't utf-8, see tzr.utf8.error
+bool kdl_jik_decoder_feed(kdl_jik_decoder_t *, char *data, size_t length);
+// also flushes out
+bool kdl_jik_decoder_finish(kdl_jik_decoder_t *);
+
+/*
+ * json to jik
+ */
+
+typedef enum kdl_jik_lex {
+    KDL_JIK_LEX_NONE,
+    KDL_JIK_LEX_STRING,
+    KDL_JIK_LEX_ESCAPE,
+    KDL_JIK_LEX_UNICODE,
+    KDL_JIK_LEX_NUMBER,
+    KDL_JIK_LEX_WORD
+} kdl_jik_lex_e;
+
+typedef enum kdl_jik_expect {
+    KDL_JIK_EXPECT_VALUE,
+    KDL_JIK_EXPECT_VALUE_OR_END,
+    KDL_JIK_EXPECT_KEY,
+    KDL_JIK_EXPECT_KEY_OR_END,
+    KDL_JIK_EXPECT_COLON,
+    KDL_JIK_EXPECT_COMMA_OR_END,
+    KDL_JIK_EXPECT_NOTHING
+} kdl_jik_expect_e;
+
+typedef struct kdl_jik_encoder {
+    kdl_output_t *out;
+
+    // json token being lexed, strings are decoded as they go
+    kdl_jik_lex_e lex;
+    char *buf;
+    size_t buf_size, buf_len;
+    unsigned escape_digits, code_unit, high_surrogate;
+
+    /*
+     * the name of the next node, which is held along with the kind of a
+     * container that was just opened until the next token shows whether the
+     * container is empty
+     */
+    char *name;
+    size_t name_len;
+    kdl_jik_container_e opening;
+
+    kdl_jik_container_e containers[KDL_JIK_MAX_DEPTH];
+    size_t depth;
+    kdl_jik_expect_e expect;
+} kdl_jik_encoder_t;
+
+// buf holds the longest json string or number, and name_buf is the same size
+void kdl_jik_encoder_make(
+    kdl_jik_encoder_t *, kdl_output_t *out, char *buf, size_t buf_size,
+    char *name_buf
+);
+void kdl_jik_encoder_feed(kdl_jik_encoder_t *, const char *data, size_t length);
+// also flushes out
+void kdl_jik_encoder_finish(kdl_jik_encoder_t *);
+
+#endif
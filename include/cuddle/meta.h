@@ -14,6 +14,26 @@
 #define KDL_DEBUG(...)
 #endif
 
+/*
+ * wrap a pipeline stage in KDL_PROFILE_BEGIN/END to count its calls and cycles.
+ * stages are listed in profile.h.
+ */
+#ifdef KDL_PROFILE
+#include <cuddle/profile.h>
+
+#define KDL_PROFILE_BEGIN(stage)\
+    unsigned long long kdl_prof_start_##stage = kdl_profile_clock()
+#define KDL_PROFILE_END(stage)\
+    do {\
+        kdl_profile_counters.cycles[stage] +=\
+            kdl_profile_clock() - kdl_prof_start_##stage;\
+        ++kdl_profile_counters.events[stage];\
+    } while (0)
+#else
+#define KDL_PROFILE_BEGIN(stage)
+#define KDL_PROFILE_END(stage)
+#endif
+
 #ifndef NDEBUG
 #define KDL_ASSERT(cond, ...) if (!(cond)) KDL_ERROR(__VA_ARGS__)
 #else
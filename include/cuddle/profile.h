@@ -0,0 +1,64 @@
+#ifndef KDL_PROFILE_H
+#define KDL_PROFILE_H
+
+/*
+ * per-stage profiling counters. these are only recorded when cuddle is built
+ * with KDL_PROFILE defined, otherwise the hooks compile to nothing and stats
+ * always read as zero.
+ *
+ * counters are global and not synchronized, so profile one parse at a time.
+ */
+
+#define KDL_PROFILE_STAGES_X\
+    X(KDL_PROF_UTF8_VALIDATE),\
+    X(KDL_PROF_UTF8_DECODE),\
+    X(KDL_PROF_CONSUME_CHAR),\
+    X(KDL_PROF_GENERATE_TOKEN),\
+    X(KDL_PROF_EXTRACT_VALUE),\
+    X(KDL_PROF_NEW_NODE)
+
+#define X(name) name
+typedef enum kdl_profile_stage {
+    KDL_PROFILE_STAGES_X,
+    KDL_PROF_NUM_STAGES
+} kdl_profile_stage_e;
+#undef X
+
+extern const char KDL_PROFILE_STAGES[][32];
+
+typedef struct kdl_profile {
+    // cycles are tsc ticks where available, otherwise clock() ticks
+    unsigned long long cycles[KDL_PROF_NUM_STAGES];
+    unsigned long long events[KDL_PROF_NUM_STAGES];
+} kdl_profile_t;
+
+// copies out the current counters
+void kdl_profile_read(kdl_profile_t *);
+void kdl_profile_reset(void);
+
+// used by the KDL_PROFILE_* hooks in meta.h
+extern kdl_profile_t kdl_profile_counters;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline unsigned long long kdl_profile_clock(void) {
+    return __rdtsc();
+}
+#elif defined(__aarch64__)
+static inline unsigned long long kdl_profile_clock(void) {
+    unsigned long long ticks;
+
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+
+    return ticks;
+}
+#else
+#include <time.h>
+
+static inline unsigned long long kdl_profile_clock(void) {
+    return clock();
+}
+#endif
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef KDL_SERIALIZE_H
 #define KDL_SERIALIZE_H
 
+#include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /*
  * serialization functions take in a value and output
@@ -15,4 +17,41 @@ void kdl_serialize_bool(char *buf, size_t buf_size, bool boolean);
 // just writes 'null' to buf, here for symmetry lol
 void kdl_serialize_null(char *buf, size_t buf_size);
 
+// native values from annotation decoders, uuids and timestamps as strings
+void kdl_serialize_int(char *buf, size_t buf_size, int64_t integer);
+void kdl_serialize_uint(char *buf, size_t buf_size, uint64_t uinteger);
+void kdl_serialize_uuid(char *buf, size_t buf_size, const unsigned char *uuid);
+// rfc 3339 in utc, with microseconds only when there are any
+void kdl_serialize_timestamp(char *buf, size_t buf_size, int64_t timestamp);
+
+// whether a name can be written without quotes
+bool kdl_is_identifier(const char *id);
+
+/*
+ * buffered output for streaming serializers. bytes collect in buf and are
+ * passed to write whenever it fills up, and by kdl_output_flush().
+ */
+typedef void (*kdl_write_fn)(const char *data, size_t length, void *ctx);
+
+typedef struct kdl_output {
+    char *buf;
+    size_t buf_size, buf_len;
+
+    kdl_write_fn write;
+    void *ctx;
+} kdl_output_t;
+
+void kdl_output_make(
+    kdl_output_t *, char *buf, size_t buf_size, kdl_write_fn write, void *ctx
+);
+void kdl_output_write(kdl_output_t *, const char *data, size_t length);
+void kdl_output_flush(kdl_output_t *);
+
+static inline void kdl_output_char(kdl_output_t *out, char ch) {
+    if (out->buf_len == out->buf_size)
+        kdl_output_flush(out);
+
+    out->buf[out->buf_len++] = ch;
+}
+
 #endif
@@ -0,0 +1,75 @@
+#ifndef KDL_SPAN_H
+#define KDL_SPAN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <cuddle/alloc.h>
+#include <cuddle/tokenize.h>
+
+/*
+ * where a document's nodes and values were in the source, for tools that point
+ * back into it. spans are kept to the side in flat arrays instead of in nodes
+ * and values, so documents that don't record them don't pay for them.
+ */
+
+// a node's span, and where the spans of its values start
+typedef struct kdl_node_spans {
+    kdl_span_t span;
+
+    // the node's self_ref.count, a block reused by another node won't match
+    unsigned count;
+
+    unsigned num_args, num_props;
+    size_t args, props;
+} kdl_node_spans_t;
+
+// lines and columns count from 1, and columns are in bytes
+typedef struct kdl_location {
+    size_t line, column;
+} kdl_location_t;
+
+typedef struct kdl_span_table {
+    const kdl_allocator_t *allocator;
+
+    // indexed by the index of a node's block in the node table
+    kdl_node_spans_t *nodes;
+    size_t cap_nodes;
+
+    // a node's arg spans and prop spans are in one run each
+    kdl_span_t *args, *props;
+    size_t num_args, num_props, cap_args, cap_props;
+
+    // the offset of every '\n' in the first text_len bytes of the source
+    size_t *newlines;
+    size_t num_newlines, cap_newlines, text_len;
+    bool indexed;
+} kdl_span_table_t;
+
+// nothing is allocated until spans are recorded
+void kdl_span_table_make(kdl_span_table_t *, const kdl_allocator_t *);
+// forgets every span, keeping the memory
+void kdl_span_table_clear(kdl_span_table_t *);
+void kdl_span_table_release(kdl_span_table_t *);
+
+// the entry for a node's block, which is zeroed until it's first used
+kdl_node_spans_t *kdl_span_table_node(kdl_span_table_t *, unsigned index);
+void kdl_span_table_push_arg(
+    kdl_span_table_t *, kdl_node_spans_t *, kdl_span_t
+);
+void kdl_span_table_push_prop(
+    kdl_span_table_t *, kdl_node_spans_t *, kdl_span_t
+);
+
+/*
+ * the newline index is built from the source one piece at a time, in order,
+ * and marked done with indexed. finding a location is a binary search.
+ */
+void kdl_span_table_index(
+    kdl_span_table_t *, const char *text, size_t length
+);
+// forgets the newline index, for a new source
+void kdl_span_table_unindex(kdl_span_table_t *);
+kdl_location_t kdl_span_table_locate(kdl_span_table_t *, size_t offset);
+
+#endif
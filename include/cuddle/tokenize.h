@@ -15,7 +15,9 @@
     X(KDL_TOK_NULL),\
     /* symbols */\
     X(KDL_TOK_CHILD_BEGIN),\
-    X(KDL_TOK_CHILD_END)
+    X(KDL_TOK_CHILD_END),\
+    /* type annotation, comes right before the node or value it annotates */\
+    X(KDL_TOK_ANNOTATION)
 
 // table of (name, tentative type)
 #define KDL_TOKENIZER_STATES_X\
@@ -49,12 +51,17 @@ typedef enum kdl_tokenizer_state {
 extern const char KDL_TOKEN_TYPES[][32];
 extern const char KDL_TOKENIZER_STATES[][32];
 
+// a range of bytes in a stream, end is exclusive
+typedef struct kdl_span {
+    size_t start, end;
+} kdl_span_t;
+
 typedef struct kdl_tokenizer {
     // current data
     kdl_utf8_t utf8;
 
-    // token buffer
-    kdl_u8ch_t *buf;
+    // token buffer, holds utf-8
+    char *buf;
     size_t buf_size, buf_len; // buf_len is size of current token
 
     // parsing state
@@ -67,6 +74,7 @@ typedef struct kdl_tokenizer {
     unsigned force_detect: 1;
     unsigned reset_buf: 1;
     unsigned token_break: 1;
+    unsigned str_escape: 1;
 
     // token typing state
     unsigned break_escape: 1;
@@ -75,6 +83,35 @@ typedef struct kdl_tokenizer {
     unsigned sd_value: 1;
 
     int sd_node_level;
+
+    // braces left to close in a block being skipped, see kdl_tok_skip_children
+    int skip_depth;
+
+    /*
+     * byte offsets into the stream of the '{' of the last KDL_TOK_CHILD_BEGIN,
+     * and of the '}' which ended the last skipped block. offset is how much was
+     * fed before the current data.
+     */
+    size_t offset, brace_offset, skip_end;
+
+    // when set, span is kept up to date with the bytes of the last token
+    unsigned spans: 1;
+    kdl_span_t span;
+
+    /*
+     * when set, a token too long for the buffer stops the tokenizer and sets
+     * overflowed instead of being an error. the rest of the data fed is
+     * dropped, so it needs a reset before it's used again.
+     */
+    unsigned soft_overflow: 1;
+    unsigned overflowed: 1;
+
+    /*
+     * when set, string values with escapes and number values are left as raw
+     * text and marked with token.raw, so that they can be decoded on demand.
+     * node and property names are always decoded.
+     */
+    unsigned lazy_values: 1;
 } kdl_tokenizer_t;
 
 typedef struct kdl_token {
@@ -86,24 +123,76 @@ typedef struct kdl_token {
     double number;
     unsigned boolean: 1;
 
+    // string or number that hasn't been decoded, see lazy_values
+    unsigned raw: 1;
+
     // set to true for identifiers/strings marking a node or prop
     unsigned node: 1;
     unsigned property: 1;
 } kdl_token_t;
 
+/*
+ * a batch of tokens for kdl_tok_next_batch(). the text of every token is packed
+ * into bytes one after another, null terminated, and token.string points into
+ * it. bytes needs to be at least as big as the tokenizer buffer, and the more
+ * room it has over that the more tokens fit in a batch.
+ */
+typedef struct kdl_token_batch {
+    kdl_token_t *tokens;
+    size_t max_tokens, num_tokens;
+
+    char *bytes;
+    size_t bytes_size, bytes_len;
+
+    // filled in with the span of every token if it isn't NULL, see spans
+    kdl_span_t *spans;
+} kdl_token_batch_t;
+
 /*
  * buffers are just raw memory. the tokenizer buffer needs to be able to hold
- * the longest raw token component, and the token buffer needs to be able to
- * hold the longest processed string.
+ * the longest raw token component in bytes, and the token buffer needs to be
+ * able to hold the longest processed string. comments aren't buffered.
  *
  * only the tokenizer checks to ensure no overwriting, but if you allocate the
  * token buffer to be the same size no memory errors will happen.
  */
-void kdl_tokenizer_make(kdl_tokenizer_t *, kdl_u8ch_t *buffer, size_t buf_size);
+void kdl_tokenizer_make(kdl_tokenizer_t *, char *buffer, size_t buf_size);
 void kdl_token_make(kdl_token_t *, char *buffer);
+void kdl_token_batch_make(
+    kdl_token_batch_t *, kdl_token_t *tokens, size_t max_tokens, char *bytes,
+    size_t bytes_size
+);
+/*
+ * starts over on a new stream, keeping the buffer and the lazy_values, spans
+ * and soft_overflow settings
+ */
+void kdl_tokenizer_reset(kdl_tokenizer_t *);
 
-// feed tokenizer a raw multibyte string and it will parse the utf-8
-void kdl_tok_feed(kdl_tokenizer_t *, char *data, size_t length);
+/*
+ * feed tokenizer a raw multibyte string and it will parse the utf-8. returns
+ * false if it isn't utf-8, see kdl_utf8_feed() and utf8.error.
+ */
+bool kdl_tok_feed(kdl_tokenizer_t *, const char *data, size_t length);
+/*
+ * call once all data has been fed, so that the trailing token can be returned.
+ * returns false if the data ended partway through a utf-8 char.
+ */
+bool kdl_tok_finish(kdl_tokenizer_t *);
 bool kdl_tok_next(kdl_tokenizer_t *, kdl_token_t *);
 
+/*
+ * replaces the tokens in a batch with as many of the next tokens as fit and
+ * returns how many there are, which is 0 once more data is needed:
+ *
+ * while (kdl_tok_next_batch()) { [ do something with batch.tokens... ] }
+ */
+size_t kdl_tok_next_batch(kdl_tokenizer_t *, kdl_token_batch_t *);
+
+/*
+ * call right after getting a KDL_TOK_CHILD_BEGIN to skip the rest of its block.
+ * everything up to and including the matching KDL_TOK_CHILD_END is tokenized
+ * only as far as finding braces, so nothing in it is copied or decoded.
+ */
+void kdl_tok_skip_children(kdl_tokenizer_t *);
+
 #endif
@@ -10,9 +10,28 @@ typedef int kdl_u8ch_t;
 #define WEOF ((kdl_u8ch_t)-1)
 #endif
 
+// strict validation state, carried between fed chunks
+typedef struct kdl_utf8_validator {
+    size_t offset; // bytes validated before the current chunk
+
+    // continuation bytes still owed by a char split between chunks, and the
+    // range the next one has to fall in
+    unsigned char needed, lo, hi;
+    unsigned char width; // of the last char started, to find its lead byte
+} kdl_utf8_validator_t;
+
+// where a stream stopped being utf-8
+typedef struct kdl_utf8_error {
+    bool invalid;
+    size_t offset; // from the start of the stream
+} kdl_utf8_error_t;
+
 // utf8 parsing state
 typedef struct kdl_utf8 {
-    unsigned char *data;
+    kdl_utf8_validator_t validator;
+    kdl_utf8_error_t error;
+
+    const unsigned char *data;
     size_t data_len, data_idx;
 
     // when fails to finish a char, it's left here
@@ -24,14 +43,33 @@ typedef struct kdl_utf8 {
  * utf8 character parser
  */
 void kdl_utf8_make(kdl_utf8_t *); // just zero-inits
-void kdl_utf8_feed(kdl_utf8_t *, char *data, size_t length);
 
 /*
- * returns false if failed to finish char, outputs WEOF at end of file and
- * L'\0' at end of string.
+ * fed data is validated before it is decoded. invalid utf-8 returns false and
+ * sets error, and none of the data is decoded. the stream is done with then,
+ * and refuses anything fed after. feeding nothing ends the stream, which is
+ * invalid if a char was left unfinished, with the offset of its lead byte.
+ */
+bool kdl_utf8_feed(kdl_utf8_t *, const char *data, size_t length);
+
+/*
+ * returns false if failed to finish char or the fed data is exhausted, outputs
+ * WEOF at end of file and L'\0' at end of string.
  */
 bool kdl_utf8_next(kdl_utf8_t *, kdl_u8ch_t *out_ch);
 
+/*
+ * validates the next chunk of a utf-8 stream. overlong encodings, surrogates,
+ * stray or missing continuation bytes and codepoints past U+10FFFF are all
+ * rejected. returns false and outputs the byte offset from the start of the
+ * stream on failure. a char split between chunks is finished by the next call,
+ * so a stream which ends mid-char is left with needed set, see kdl_utf8_feed().
+ */
+bool kdl_utf8_validate(
+    kdl_utf8_validator_t *, const char *data, size_t length,
+    size_t *out_offset
+);
+
 /*
  * utf8 string utilities
  */
@@ -0,0 +1,31 @@
+#include <stdlib.h>
+
+#include <cuddle/alloc.h>
+
+static void *default_alloc(size_t size, void *ctx) {
+    (void)ctx;
+
+    return malloc(size);
+}
+
+static void *default_realloc(
+    void *ptr, size_t old_size, size_t new_size, void *ctx
+) {
+    (void)old_size;
+    (void)ctx;
+
+    return realloc(ptr, new_size);
+}
+
+static void default_free(void *ptr, size_t size, void *ctx) {
+    (void)size;
+    (void)ctx;
+
+    free(ptr);
+}
+
+const kdl_allocator_t KDL_DEFAULT_ALLOCATOR = {
+    .alloc = default_alloc,
+    .realloc = default_realloc,
+    .free = default_free
+};
@@ -0,0 +1,307 @@
+#include <string.h>
+
+#include <cuddle/dom.h>
+#include "token_parse.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
+
+/*
+ * integers are parsed from their text rather than the parsed double, which
+ * can't hold every 64 bit value
+ */
+
+// returns false for anything that isn't an integer that fits in 64 bits
+static bool parse_integer(
+    const char *text, bool *out_negative, uint64_t *out_magnitude
+) {
+    const char *trav = text;
+    uint64_t magnitude = 0;
+    unsigned base = 10;
+    bool digits = false;
+
+    *out_negative = *trav == '-';
+    trav += *trav == '-' || *trav == '+';
+
+    if (trav[0] == '0') {
+        switch (trav[1]) {
+        case 'x': base = 16; trav += 2; break;
+        case 'o': base = 8; trav += 2; break;
+        case 'b': base = 2; trav += 2; break;
+        default: break;
+        }
+    }
+
+    for (; *trav; ++trav) {
+        unsigned digit;
+
+        if (*trav == '_')
+            continue;
+        else if (*trav >= '0' && *trav <= '9')
+            digit = *trav - '0';
+        else if (*trav >= 'a' && *trav <= 'f')
+            digit = *trav - 'a' + 10;
+        else if (*trav >= 'A' && *trav <= 'F')
+            digit = *trav - 'A' + 10;
+        else
+            return false;
+
+        if (digit >= base || magnitude > (UINT64_MAX - digit) / base)
+            return false;
+
+        magnitude = magnitude * base + digit;
+        digits = true;
+    }
+
+    *out_magnitude = magnitude;
+
+    return digits;
+}
+
+static bool decode_signed(const char *text, kdl_value_t *val, unsigned bits) {
+    uint64_t max = ((uint64_t)1 << (bits - 1)) - 1, magnitude;
+    bool negative;
+
+    if (val->type != KDL_NUMBER || !parse_integer(text, &negative, &magnitude))
+        return false;
+
+    // the negative range goes one further
+    if (magnitude > max + negative)
+        return false;
+
+    val->type = KDL_INT;
+    val->data.integer = negative
+        ? magnitude ? -(int64_t)(magnitude - 1) - 1 : 0
+        : (int64_t)magnitude;
+
+    return true;
+}
+
+static bool decode_unsigned(
+    const char *text, kdl_value_t *val, unsigned bits
+) {
+    uint64_t max = bits == 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1;
+    uint64_t magnitude;
+    bool negative;
+
+    if (val->type != KDL_NUMBER || !parse_integer(text, &negative, &magnitude))
+        return false;
+
+    if ((negative && magnitude) || magnitude > max)
+        return false;
+
+    val->type = KDL_UINT;
+    val->data.uinteger = magnitude;
+
+    return true;
+}
+
+#define INT_DECODERS(name, bits)\
+    static bool decode_i##name(const char *text, kdl_value_t *val) {\
+        return decode_signed(text, val, bits);\
+    }\
+    static bool decode_u##name(const char *text, kdl_value_t *val) {\
+        return decode_unsigned(text, val, bits);\
+    }
+
+INT_DECODERS(8, 8)
+INT_DECODERS(16, 16)
+INT_DECODERS(32, 32)
+INT_DECODERS(64, 64)
+INT_DECODERS(size, sizeof(size_t) * 8)
+
+#undef INT_DECODERS
+
+static bool decode_uuid(const char *text, kdl_value_t *val) {
+    unsigned char uuid[16];
+    size_t byte = 0;
+
+    if (val->type != KDL_STRING || strlen(text) != 36)
+        return false;
+
+    for (size_t i = 0; i < 36; i += 2) {
+        // hyphens sit between the 8-4-4-4-12 groups
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (text[i] != '-')
+                return false;
+
+            ++i;
+        }
+
+        int hi = hex_digit(text[i]), lo = hex_digit(text[i + 1]);
+
+        if (hi < 0 || lo < 0)
+            return false;
+
+        uuid[byte++] = hi << 4 | lo;
+    }
+
+    val->type = KDL_UUID;
+    memcpy(val->data.uuid, uuid, sizeof(uuid));
+
+    return true;
+}
+
+/*
+ * dates and times
+ */
+
+// reads exactly count digits
+static bool parse_digits(const char **trav, int count, int *out) {
+    *out = 0;
+
+    for (int i = 0; i < count; ++i, ++*trav) {
+        if (**trav < '0' || **trav > '9')
+            return false;
+
+        *out = *out * 10 + (**trav - '0');
+    }
+
+    return true;
+}
+
+static bool expect_char(const char **trav, char ch) {
+    return **trav == ch && (++*trav, true);
+}
+
+// days since 1970-01-01 in the proleptic gregorian calendar
+static int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned year_of_era = (unsigned)(year - era * 400);
+    unsigned day_of_year =
+        (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned day_of_era = year_of_era * 365 + year_of_era / 4
+                        - year_of_era / 100 + day_of_year;
+
+    return era * 146097 + (int64_t)day_of_era - 719468;
+}
+
+static bool parse_date(const char **trav, int64_t *out_days) {
+    static const int DAYS_IN_MONTH[] = {
+        31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+    };
+
+    int year, month, day;
+
+    if (
+        !parse_digits(trav, 4, &year) || !expect_char(trav, '-')
+        || !parse_digits(trav, 2, &month) || !expect_char(trav, '-')
+        || !parse_digits(trav, 2, &day)
+        || month < 1 || month > 12 || day < 1 || day > DAYS_IN_MONTH[month - 1]
+    ) {
+        return false;
+    }
+
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+
+    if (month == 2 && day == 29 && !leap)
+        return false;
+
+    *out_days = days_from_civil(year, month, day);
+
+    return true;
+}
+
+// parses HH:MM:SS with an optional fraction, in microseconds
+static bool parse_time(const char **trav, int64_t *out_micros) {
+    int hour, minute, second, micros = 0;
+
+    if (
+        !parse_digits(trav, 2, &hour) || !expect_char(trav, ':')
+        || !parse_digits(trav, 2, &minute) || !expect_char(trav, ':')
+        || !parse_digits(trav, 2, &second)
+        || hour > 23 || minute > 59 || second > 60 // leap seconds
+    ) {
+        return false;
+    }
+
+    // digits past microseconds are dropped
+    if (expect_char(trav, '.')) {
+        int digits = 0;
+
+        for (; **trav >= '0' && **trav <= '9'; ++*trav, ++digits)
+            if (digits < 6)
+                micros = micros * 10 + (**trav - '0');
+
+        if (!digits)
+            return false;
+
+        for (; digits < 6; ++digits)
+            micros *= 10;
+    }
+
+    *out_micros = ((hour * 60 + minute) * 60 + second) * (int64_t)1000000
+                + micros;
+
+    return true;
+}
+
+static bool decode_date_time(const char *text, kdl_value_t *val) {
+    const char *trav = text;
+    int64_t days, micros;
+    int offset = 0; // in minutes
+
+    if (
+        val->type != KDL_STRING || !parse_date(&trav, &days)
+        || !(expect_char(&trav, 'T') || expect_char(&trav, 't'))
+        || !parse_time(&trav, &micros)
+    ) {
+        return false;
+    }
+
+    if (!expect_char(&trav, 'Z') && !expect_char(&trav, 'z')) {
+        int sign = *trav == '-' ? -1 : 1, hours, minutes;
+
+        if (
+            !(expect_char(&trav, '+') || expect_char(&trav, '-'))
+            || !parse_digits(&trav, 2, &hours) || !expect_char(&trav, ':')
+            || !parse_digits(&trav, 2, &minutes)
+            || hours > 23 || minutes > 59
+        ) {
+            return false;
+        }
+
+        offset = sign * (hours * 60 + minutes);
+    }
+
+    if (*trav)
+        return false;
+
+    val->type = KDL_TIMESTAMP;
+    val->data.timestamp = days * 86400 * (int64_t)1000000 + micros
+                        - offset * 60 * (int64_t)1000000;
+
+    return true;
+}
+
+static bool decode_date(const char *text, kdl_value_t *val) {
+    const char *trav = text;
+    int64_t days;
+
+    if (val->type != KDL_STRING || !parse_date(&trav, &days) || *trav)
+        return false;
+
+    val->type = KDL_TIMESTAMP;
+    val->data.timestamp = days * 86400 * (int64_t)1000000;
+
+    return true;
+}
+
+const kdl_annotation_decoder_t KDL_STD_DECODERS[] = {
+    { "i8", decode_i8 },
+    { "i16", decode_i16 },
+    { "i32", decode_i32 },
+    { "i64", decode_i64 },
+    { "isize", decode_isize },
+    { "u8", decode_u8 },
+    { "u16", decode_u16 },
+    { "u32", decode_u32 },
+    { "u64", decode_u64 },
+    { "usize", decode_usize },
+    { "uuid", decode_uuid },
+    { "date-time", decode_date_time },
+    { "date", decode_date },
+};
+
+const size_t KDL_NUM_STD_DECODERS = ARRAY_SIZE(KDL_STD_DECODERS);
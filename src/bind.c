@@ -0,0 +1,218 @@
+#include <string.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/bind.h>
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
+
+const kdl_bind_field_t *kdl_bind_lookup(
+    const kdl_bind_struct_t *type, const char *name, size_t len
+) {
+    short index = type->slots[kdl_bind_hash(name, len, type->seed) & type->mask];
+
+    if (index < 0)
+        return NULL;
+
+    // a perfect hash still needs one comparison to reject unknown names
+    const kdl_bind_field_t *field = &type->fields[index];
+
+    if (field->name_len != len || memcmp(field->name, name, len))
+        return NULL;
+
+    return field;
+}
+
+void kdl_binder_make(
+    kdl_binder_t *binder, const kdl_bind_struct_t *root, void *out,
+    char *tzr_buf, size_t tzr_buf_size, char *tok_buf
+) {
+    *binder = (kdl_binder_t){
+        .depth = 1
+    };
+
+    binder->frames[0] = (kdl_bind_frame_t){
+        .type = root,
+        .obj = out
+    };
+
+    kdl_tokenizer_make(&binder->tzr, tzr_buf, tzr_buf_size);
+    kdl_token_make(&binder->token, tok_buf);
+}
+
+// returns storage for the next element of a field in obj
+static char *field_slot(const kdl_bind_field_t *field, char *obj) {
+    if (!field->max_count)
+        return obj + field->offset;
+
+    size_t *count = (size_t *)(obj + field->count_offset);
+
+    if (*count == field->max_count) {
+        KDL_ERROR(
+            "field \"%s\" can't hold more than %zu values.\n",
+            field->name, field->max_count
+        );
+    }
+
+    return obj + field->offset + field->size * (*count)++;
+}
+
+static void assign_value(
+    const kdl_bind_field_t *field, char *slot, kdl_token_t *token
+) {
+    switch (field->kind) {
+    case KDL_BIND_INT:
+    case KDL_BIND_DOUBLE:
+        if (token->type != KDL_TOK_NUMBER)
+            KDL_ERROR("field \"%s\" expects a number.\n", field->name);
+
+        if (field->kind == KDL_BIND_INT)
+            *(long *)slot = (long)token->number;
+        else
+            *(double *)slot = token->number;
+
+        break;
+    case KDL_BIND_BOOL:
+        if (token->type != KDL_TOK_BOOL)
+            KDL_ERROR("field \"%s\" expects a bool.\n", field->name);
+
+        *(bool *)slot = token->boolean;
+
+        break;
+    case KDL_BIND_STRING:
+        if (token->type != KDL_TOK_STRING)
+            KDL_ERROR("field \"%s\" expects a string.\n", field->name);
+
+        if (token->str_len >= field->size) {
+            KDL_ERROR(
+                "field \"%s\" can't hold a string of %zu bytes.\n",
+                field->name, token->str_len
+            );
+        }
+
+        memcpy(slot, token->string, token->str_len + 1);
+
+        break;
+    case KDL_BIND_STRUCT:
+        KDL_ERROR("field \"%s\" expects children.\n", field->name);
+    }
+}
+
+static void bind_node(kdl_binder_t *binder, kdl_token_t *token) {
+    kdl_bind_frame_t *frame = &binder->frames[binder->depth - 1];
+    const kdl_bind_field_t *field = kdl_bind_lookup(
+        frame->type, token->string, token->str_len
+    );
+
+    binder->node_field = field;
+    binder->node_obj = NULL;
+    binder->node_assigned = false;
+    binder->await_prop = false;
+
+    // struct elements are claimed up front so that props can fill them in
+    if (field && field->kind == KDL_BIND_STRUCT)
+        binder->node_obj = field_slot(field, frame->obj);
+}
+
+static void bind_token(kdl_binder_t *binder, kdl_token_t *token) {
+    const kdl_bind_field_t *field = binder->node_field;
+
+    // fields already have types, so annotations don't change anything
+    if (token->type == KDL_TOK_ANNOTATION)
+        return;
+
+    if (token->node) {
+        bind_node(binder, token);
+    } else if (token->property) {
+        // props only bind to struct nodes
+        binder->await_prop = true;
+        binder->prop_field = field && field->kind == KDL_BIND_STRUCT
+            ? kdl_bind_lookup(field->type, token->string, token->str_len)
+            : NULL;
+    } else {
+        switch (token->type) {
+        case KDL_TOK_CHILD_BEGIN:
+            if (!field || field->kind != KDL_BIND_STRUCT) {
+                // unknown subtrees are skipped without being decoded
+                kdl_tok_skip_children(&binder->tzr);
+            } else if (binder->depth == ARRAY_SIZE(binder->frames)) {
+                KDL_ERROR("binding nested deeper than KDL_BIND_MAX_DEPTH.\n");
+            } else {
+                binder->frames[binder->depth++] = (kdl_bind_frame_t){
+                    .type = field->type,
+                    .obj = binder->node_obj
+                };
+            }
+
+            binder->node_field = NULL;
+
+            break;
+        case KDL_TOK_CHILD_END:
+            if (binder->depth == 1)
+                KDL_ERROR("unmatched '}' while binding.\n");
+
+            --binder->depth;
+            binder->node_field = NULL;
+
+            break;
+        default:
+            if (binder->await_prop) {
+                binder->await_prop = false;
+
+                if (binder->prop_field) {
+                    assign_value(
+                        binder->prop_field,
+                        field_slot(binder->prop_field, binder->node_obj),
+                        token
+                    );
+                }
+            } else if (field) {
+                // scalars take their first argument, arrays take all of them
+                if (field->max_count || !binder->node_assigned) {
+                    assign_value(
+                        field, field_slot(field, binder->frames[
+                            binder->depth - 1
+                        ].obj), token
+                    );
+                }
+
+                binder->node_assigned = true;
+            }
+
+            break;
+        }
+    }
+}
+
+bool kdl_binder_feed(kdl_binder_t *binder, char *data, size_t length) {
+    if (!kdl_tok_feed(&binder->tzr, data, length))
+        return false;
+
+    while (kdl_tok_next(&binder->tzr, &binder->token))
+        bind_token(binder, &binder->token);
+
+    return true;
+}
+
+bool kdl_binder_finish(kdl_binder_t *binder) {
+    if (!kdl_tok_finish(&binder->tzr))
+        return false;
+
+    while (kdl_tok_next(&binder->tzr, &binder->token))
+        bind_token(binder, &binder->token);
+
+    return true;
+}
+
+bool kdl_bind_parse(
+    const kdl_bind_struct_t *root, void *out, char *data, size_t length
+) {
+    char tzr_buf[4096], tok_buf[4096];
+    kdl_binder_t binder;
+
+    kdl_binder_make(
+        &binder, root, out, tzr_buf, ARRAY_SIZE(tzr_buf), tok_buf
+    );
+
+    return kdl_binder_feed(&binder, data, length)
+        && kdl_binder_finish(&binder);
+}
@@ -0,0 +1,114 @@
+#include <cuddle/cursor.h>
+
+void kdl_cursor_make(
+    kdl_cursor_t *cursor, kdl_document_t *doc, kdl_node_t *root
+) {
+    *cursor = (kdl_cursor_t){
+        .doc = doc,
+        .root = root
+    };
+}
+
+static kdl_node_t *next_sibling(kdl_document_t *doc, kdl_node_t *node) {
+    kdl_node_t **siblings = node->parent ? node->parent->children : doc->nodes;
+    size_t len = node->parent ? node->parent->num_children : doc->num_nodes;
+
+    return node->index + 1 < len ? siblings[node->index + 1] : NULL;
+}
+
+static void enter(kdl_cursor_t *cursor, kdl_node_t *node) {
+    cursor->node = node;
+    cursor->event = KDL_CURSOR_ENTER;
+    cursor->started = true;
+}
+
+bool kdl_cursor_next(kdl_cursor_t *cursor) {
+    kdl_node_t *node = cursor->node;
+
+    if (!cursor->started) {
+        cursor->started = true;
+
+        if (cursor->root)
+            enter(cursor, cursor->root);
+        else if (cursor->doc->num_nodes)
+            enter(cursor, cursor->doc->nodes[0]);
+
+        return cursor->node != NULL;
+    }
+
+    if (!node)
+        return false;
+
+    if (cursor->event == KDL_CURSOR_ENTER) {
+        kdl_node_expand(cursor->doc, node);
+
+        // go down, or leave a node without children straight away
+        if (node->num_children) {
+            enter(cursor, node->children[0]);
+            ++cursor->depth;
+        } else {
+            cursor->event = KDL_CURSOR_LEAVE;
+        }
+
+        return true;
+    }
+
+    // leaving, so go across or back up
+    kdl_node_t *sibling = node == cursor->root
+        ? NULL
+        : next_sibling(cursor->doc, node);
+
+    if (sibling) {
+        enter(cursor, sibling);
+    } else if (cursor->depth) {
+        cursor->node = node->parent;
+        --cursor->depth;
+    } else {
+        cursor->node = NULL;
+    }
+
+    return cursor->node != NULL;
+}
+
+bool kdl_cursor_first_child(kdl_cursor_t *cursor) {
+    kdl_node_t *node = cursor->node;
+
+    if (!node)
+        return false;
+
+    kdl_node_expand(cursor->doc, node);
+
+    if (!node->num_children)
+        return false;
+
+    enter(cursor, node->children[0]);
+    ++cursor->depth;
+
+    return true;
+}
+
+bool kdl_cursor_next_sibling(kdl_cursor_t *cursor) {
+    kdl_node_t *node = cursor->node;
+
+    if (!node || node == cursor->root)
+        return false;
+
+    kdl_node_t *sibling = next_sibling(cursor->doc, node);
+
+    if (!sibling)
+        return false;
+
+    enter(cursor, sibling);
+
+    return true;
+}
+
+bool kdl_cursor_parent(kdl_cursor_t *cursor) {
+    if (!cursor->node || !cursor->depth)
+        return false;
+
+    enter(cursor, cursor->node->parent);
+    --cursor->depth;
+
+    return true;
+}
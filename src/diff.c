@@ -0,0 +1,506 @@
+#include <string.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/diff.h>
+#include <cuddle/cursor.h>
+#include "siblings.h"
+
+// fnv-1a
+#define HASH_BASIS 0xCBF29CE484222325ull
+#define HASH_PRIME 0x100000001B3ull
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= HASH_PRIME;
+    }
+
+    return hash;
+}
+
+static uint64_t hash_word(uint64_t hash, uint64_t word) {
+    return hash_bytes(hash, &word, sizeof(word));
+}
+
+static uint64_t hash_string(uint64_t hash, const char *str) {
+    return hash_bytes(hash, str, strlen(str) + 1);
+}
+
+// murmur3's 64 bit finalizer
+static uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+static uint64_t hash_value(
+    kdl_document_t *doc, uint64_t hash, kdl_value_t *val
+) {
+    kdl_value_decode(doc, val);
+
+    hash = hash_word(hash, val->type);
+
+    char *annotation = kdl_value_annotation(doc, val);
+
+    if (annotation)
+        hash = hash_string(hash, annotation);
+
+    switch (val->type) {
+    case KDL_STRING:
+        return hash_string(hash, kdl_value_text(doc, val));
+    case KDL_NUMBER:;
+        // -0.0 == 0.0, so they need to hash the same
+        double number = val->data.number == 0.0 ? 0.0 : val->data.number;
+        uint64_t bits;
+
+        memcpy(&bits, &number, sizeof(bits));
+
+        return hash_word(hash, bits);
+    case KDL_BOOL:
+        return hash_word(hash, val->data.boolean);
+    case KDL_INT:
+    case KDL_UINT:
+    case KDL_TIMESTAMP:
+        return hash_word(hash, val->data.uinteger);
+    case KDL_UUID:
+        return hash_bytes(hash, val->data.uuid, sizeof(val->data.uuid));
+    default:
+        return hash;
+    }
+}
+
+// hashes a node whose children all have valid hashes
+static void hash_node(kdl_document_t *doc, kdl_node_t *node) {
+    uint64_t hash = hash_string(HASH_BASIS, node->id);
+
+    if (node->annotation)
+        hash = hash_string(hash, node->annotation);
+
+    hash = hash_word(hash, node->num_args);
+
+    for (size_t i = 0; i < node->num_args; ++i)
+        hash = hash_value(doc, hash, &node->args[i]);
+
+    // props are unordered, so each is hashed alone and the results summed
+    uint64_t props = 0;
+
+    for (size_t i = 0; i < node->num_props; ++i) {
+        kdl_prop_t *prop = &node->props[i];
+
+        props += mix(
+            hash_value(doc, hash_string(HASH_BASIS, prop->id), &prop->value)
+        );
+    }
+
+    hash = hash_word(hash, props);
+    hash = hash_word(hash, node->num_children);
+
+    for (size_t i = 0; i < node->num_children; ++i)
+        hash = hash_word(hash, node->children[i]->hash);
+
+    node->hash = mix(hash);
+    node->hash_valid = true;
+}
+
+uint64_t kdl_node_hash(kdl_document_t *doc, kdl_node_t *node) {
+    kdl_cursor_t cursor;
+
+    kdl_cursor_make(&cursor, doc, node);
+
+    // post-order, so children are always hashed first
+    while (kdl_cursor_next(&cursor)) {
+        if (cursor.node->hash_valid)
+            kdl_cursor_skip(&cursor);
+        else if (cursor.event == KDL_CURSOR_LEAVE)
+            hash_node(doc, cursor.node);
+    }
+
+    return node->hash;
+}
+
+uint64_t kdl_document_hash(kdl_document_t *doc) {
+    uint64_t hash = hash_word(HASH_BASIS, doc->num_nodes);
+
+    for (size_t i = 0; i < doc->num_nodes; ++i)
+        hash = hash_word(hash, kdl_node_hash(doc, doc->nodes[i]));
+
+    return mix(hash);
+}
+
+/*
+ * diffing
+ */
+
+typedef struct diff_state {
+    kdl_document_t *old_doc, *new_doc;
+    kdl_diff_fn emit;
+    void *ctx;
+
+    kdl_scratch_t scratch;
+} diff_state_t;
+
+static void emit_edit(diff_state_t *diff, kdl_diff_edit_t edit) {
+    diff->emit(&edit, diff->ctx);
+}
+
+static bool values_equal(diff_state_t *diff, kdl_value_t *a, kdl_value_t *b) {
+    kdl_value_decode(diff->old_doc, a);
+    kdl_value_decode(diff->new_doc, b);
+
+    char *a_annotation = kdl_value_annotation(diff->old_doc, a);
+    char *b_annotation = kdl_value_annotation(diff->new_doc, b);
+
+    if (a->type != b->type || !a_annotation != !b_annotation)
+        return false;
+
+    if (a_annotation && strcmp(a_annotation, b_annotation))
+        return false;
+
+    switch (a->type) {
+    case KDL_STRING:
+        return !strcmp(
+            kdl_value_text(diff->old_doc, a), kdl_value_text(diff->new_doc, b)
+        );
+    case KDL_NUMBER:
+        return a->data.number == b->data.number;
+    case KDL_BOOL:
+        return a->data.boolean == b->data.boolean;
+    case KDL_INT:
+    case KDL_UINT:
+    case KDL_TIMESTAMP:
+        return a->data.uinteger == b->data.uinteger;
+    case KDL_UUID:
+        return !memcmp(a->data.uuid, b->data.uuid, sizeof(a->data.uuid));
+    default:
+        return true;
+    }
+}
+
+static kdl_prop_t *lookup_prop(kdl_node_t *node, const char *id) {
+    for (size_t i = 0; i < node->num_props; ++i)
+        if (!strcmp(node->props[i].id, id))
+            return &node->props[i];
+
+    return NULL;
+}
+
+static void diff_args(diff_state_t *diff, kdl_node_t *old, kdl_node_t *new) {
+    size_t common = old->num_args < new->num_args
+        ? old->num_args
+        : new->num_args;
+
+    for (size_t i = 0; i < common; ++i) {
+        if (!values_equal(diff, &old->args[i], &new->args[i])) {
+            emit_edit(diff, (kdl_diff_edit_t){
+                .op = KDL_DIFF_ARG_CHANGED,
+                .old_node = old,
+                .new_node = new,
+                .index = i,
+                .old_value = &old->args[i],
+                .new_value = &new->args[i]
+            });
+        }
+    }
+
+    for (size_t i = common; i < old->num_args; ++i) {
+        emit_edit(diff, (kdl_diff_edit_t){
+            .op = KDL_DIFF_ARG_REMOVED,
+            .old_node = old,
+            .new_node = new,
+            .index = i,
+            .old_value = &old->args[i]
+        });
+    }
+
+    for (size_t i = common; i < new->num_args; ++i) {
+        emit_edit(diff, (kdl_diff_edit_t){
+            .op = KDL_DIFF_ARG_ADDED,
+            .old_node = old,
+            .new_node = new,
+            .index = i,
+            .new_value = &new->args[i]
+        });
+    }
+}
+
+static void diff_props(diff_state_t *diff, kdl_node_t *old, kdl_node_t *new) {
+    for (size_t i = 0; i < old->num_props; ++i) {
+        kdl_prop_t *old_prop = &old->props[i];
+        kdl_prop_t *new_prop = lookup_prop(new, old_prop->id);
+
+        if (!new_prop) {
+            emit_edit(diff, (kdl_diff_edit_t){
+                .op = KDL_DIFF_PROP_REMOVED,
+                .old_node = old,
+                .new_node = new,
+                .old_prop = old_prop
+            });
+        } else if (!values_equal(diff, &old_prop->value, &new_prop->value)) {
+            emit_edit(diff, (kdl_diff_edit_t){
+                .op = KDL_DIFF_PROP_CHANGED,
+                .old_node = old,
+                .new_node = new,
+                .old_prop = old_prop,
+                .new_prop = new_prop
+            });
+        }
+    }
+
+    for (size_t i = 0; i < new->num_props; ++i) {
+        if (!lookup_prop(old, new->props[i].id)) {
+            emit_edit(diff, (kdl_diff_edit_t){
+                .op = KDL_DIFF_PROP_ADDED,
+                .old_node = old,
+                .new_node = new,
+                .new_prop = &new->props[i]
+            });
+        }
+    }
+}
+
+/*
+ * the matched nodes that stay put are the longest run whose old indices are
+ * increasing in the new order, found with patience sorting. the rest moved.
+ * match has each new node's old index, or old_len for added nodes.
+ */
+static void mark_moved(
+    const size_t *match, size_t old_len, size_t new_len, size_t *tails,
+    size_t *prev, bool *moved
+) {
+    size_t num_tails = 0;
+
+    for (size_t i = 0; i < new_len; ++i) {
+        moved[i] = match[i] != old_len;
+
+        if (!moved[i])
+            continue;
+
+        // binary search for the first tail that ends at or past this match
+        size_t lo = 0, hi = num_tails;
+
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+
+            if (match[tails[mid]] < match[i])
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        prev[i] = lo ? tails[lo - 1] : new_len;
+        tails[lo] = i;
+
+        if (lo == num_tails)
+            ++num_tails;
+    }
+
+    // walk the longest run back, its nodes didn't move
+    for (size_t i = num_tails ? tails[num_tails - 1] : new_len; i != new_len;) {
+        moved[i] = false;
+        i = prev[i];
+    }
+}
+
+/*
+ * each window of siblings being walked has a frame on the scratch stack, with
+ * its matches right after it. a node whose children need diffing opens a frame
+ * for them on top, so any depth works without recursing.
+ */
+typedef struct diff_frame {
+    size_t parent; // the frame this one was opened from
+    size_t mark; // where the stack was before this frame
+
+    kdl_node_t **old_win, **new_win;
+    size_t start, old_len, new_len;
+    size_t match_at, moved_at;
+    size_t next; // the next new node to walk
+} diff_frame_t;
+
+/*
+ * matches up a window of siblings and emits its removed nodes, then returns the
+ * offset of its frame for the rest to be walked
+ */
+static size_t open_window(
+    diff_state_t *diff, size_t parent, kdl_node_t **old, size_t num_old,
+    kdl_node_t **new, size_t num_new
+) {
+    kdl_document_t *old_doc = diff->old_doc, *new_doc = diff->new_doc;
+    kdl_scratch_t *scratch = &diff->scratch;
+
+    // unchanged runs at either end are skipped by hash alone
+    size_t start = 0;
+
+    while (
+        start < num_old && start < num_new
+        && kdl_node_hash(old_doc, old[start])
+           == kdl_node_hash(new_doc, new[start])
+    ) {
+        ++start;
+    }
+
+    while (
+        num_old > start && num_new > start
+        && kdl_node_hash(old_doc, old[num_old - 1])
+           == kdl_node_hash(new_doc, new[num_new - 1])
+    ) {
+        --num_old;
+        --num_new;
+    }
+
+    // everything left in between is matched up by id
+    kdl_node_t **old_win = old + start, **new_win = new + start;
+    size_t old_len = num_old - start, new_len = num_new - start;
+
+    // the frame and matches are kept while the window is walked
+    size_t mark = scratch->len;
+    size_t frame_at = scratch_push(scratch, sizeof(diff_frame_t));
+    size_t match_at = scratch_push(scratch, new_len * sizeof(size_t));
+    size_t moved_at = scratch_push(scratch, new_len * sizeof(bool));
+    size_t temp = scratch->len;
+    size_t taken_at = scratch_push(scratch, old_len * sizeof(bool));
+    size_t tails_at = scratch_push(scratch, new_len * sizeof(size_t));
+    size_t prev_at = scratch_push(scratch, new_len * sizeof(size_t));
+    size_t index = id_index_make(scratch, old_win, old_len);
+
+    size_t *match = scratch_at(scratch, match_at);
+    bool *taken = scratch_at(scratch, taken_at);
+
+    memset(taken, 0, old_len * sizeof(*taken));
+
+    for (size_t i = 0; i < new_len; ++i) {
+        match[i] = id_index_take(scratch, index, old_win, new_win[i]->id);
+
+        if (match[i] != old_len)
+            taken[match[i]] = true;
+    }
+
+    for (size_t i = 0; i < old_len; ++i) {
+        if (!taken[i]) {
+            emit_edit(diff, (kdl_diff_edit_t){
+                .op = KDL_DIFF_NODE_REMOVED,
+                .old_node = old_win[i],
+                .index = start + i
+            });
+        }
+    }
+
+    mark_moved(
+        match, old_len, new_len, scratch_at(scratch, tails_at),
+        scratch_at(scratch, prev_at), scratch_at(scratch, moved_at)
+    );
+
+    scratch_pop(scratch, temp);
+
+    *(diff_frame_t *)scratch_at(scratch, frame_at) = (diff_frame_t){
+        .parent = parent,
+        .mark = mark,
+        .old_win = old_win,
+        .new_win = new_win,
+        .start = start,
+        .old_len = old_len,
+        .new_len = new_len,
+        .match_at = match_at,
+        .moved_at = moved_at
+    };
+
+    return frame_at;
+}
+
+static void diff_children(
+    diff_state_t *diff, kdl_node_t **old, size_t num_old, kdl_node_t **new,
+    size_t num_new
+) {
+    kdl_document_t *old_doc = diff->old_doc, *new_doc = diff->new_doc;
+    kdl_scratch_t *scratch = &diff->scratch;
+    size_t top = open_window(diff, SCRATCH_NONE, old, num_old, new, num_new);
+
+    while (top != SCRATCH_NONE) {
+        // opening a window pushes more, which can move the stack
+        diff_frame_t *frame = scratch_at(scratch, top);
+
+        if (frame->next == frame->new_len) {
+            top = frame->parent;
+            scratch_pop(scratch, frame->mark);
+
+            continue;
+        }
+
+        size_t i = frame->next++;
+        size_t matched = ((size_t *)scratch_at(scratch, frame->match_at))[i];
+        bool moved = ((bool *)scratch_at(scratch, frame->moved_at))[i];
+        kdl_node_t *new_node = frame->new_win[i];
+        size_t index = frame->start + i;
+
+        if (matched == frame->old_len) {
+            emit_edit(diff, (kdl_diff_edit_t){
+                .op = KDL_DIFF_NODE_ADDED,
+                .new_node = new_node,
+                .index = index
+            });
+
+            continue;
+        }
+
+        kdl_node_t *old_node = frame->old_win[matched];
+
+        if (moved) {
+            emit_edit(diff, (kdl_diff_edit_t){
+                .op = KDL_DIFF_NODE_MOVED,
+                .old_node = old_node,
+                .new_node = new_node,
+                .index = index
+            });
+        }
+
+        if (
+            kdl_node_hash(old_doc, old_node)
+            == kdl_node_hash(new_doc, new_node)
+        ) {
+            continue;
+        }
+
+        emit_edit(diff, (kdl_diff_edit_t){
+            .op = KDL_DIFF_NODE_CHANGED,
+            .old_node = old_node,
+            .new_node = new_node,
+            .index = index
+        });
+
+        diff_args(diff, old_node, new_node);
+        diff_props(diff, old_node, new_node);
+
+        top = open_window(
+            diff, top, old_node->children, old_node->num_children,
+            new_node->children, new_node->num_children
+        );
+    }
+}
+
+void kdl_document_diff(
+    kdl_document_t *old_doc, kdl_document_t *new_doc, kdl_diff_fn emit,
+    void *ctx
+) {
+    diff_state_t diff = {
+        .old_doc = old_doc,
+        .new_doc = new_doc,
+        .emit = emit,
+        .ctx = ctx
+    };
+
+    kdl_document_expand(old_doc);
+    kdl_document_expand(new_doc);
+    scratch_make(&diff.scratch, new_doc);
+
+    diff_children(
+        &diff, old_doc->nodes, old_doc->num_nodes, new_doc->nodes,
+        new_doc->num_nodes
+    );
+
+    scratch_free(&diff.scratch);
+}
@@ -1,15 +1,26 @@
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <cuddle/meta.h>
 #include <cuddle/cuddle.h>
+#include "token_parse.h"
+#include "load.h"
+#include "siblings.h"
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
 
 /*
- * i'm discarding hrefs all over the place in this file, TODO actually keep them
- * around with pointers and stuff, or just attach them to the pointer with fat
- * pointers
+ * smallest number of elements a node array is allocated with. a fixed block is
+ * reserved whole anyway, but with an allocator arrays are sized exactly, so
+ * they start from one.
  */
+#define MIN_ARRAY_CAP 8
+
+#define X(name) #name
+const char KDL_LIMITS[][32] = { KDL_LIMITS_X };
+#undef X
 
 void kdl_document_make(kdl_document_t *doc, kdl_document_buffers_t *bufs) {
     *doc = (kdl_document_t){0};
@@ -18,47 +29,259 @@ void kdl_document_make(kdl_document_t *doc, kdl_document_buffers_t *bufs) {
         &doc->node_table,
         bufs->node_blocks,
         sizeof(kdl_node_t),
-        bufs->num_node_blocks
+        bufs->num_node_blocks,
+        bufs->node_meta
     );
 
     kdl_htable_make(
         &doc->data_table,
         bufs->data_blocks,
         bufs->data_block_size,
-        bufs->num_data_blocks
+        bufs->num_data_blocks,
+        bufs->data_meta
     );
 
-    doc->nodes = kdl_htable_alloc(
-        &doc->data_table, &doc->nodes_ref, sizeof(*doc->nodes) * 256
-    );
+    kdl_span_table_make(&doc->spans, &KDL_DEFAULT_ALLOCATOR);
+}
+
+void kdl_document_make_alloc(
+    kdl_document_t *doc, const kdl_allocator_t *allocator
+) {
+    *doc = (kdl_document_t){0};
+
+    kdl_htable_make_alloc(&doc->node_table, allocator);
+    kdl_htable_make_alloc(&doc->data_table, allocator);
+    kdl_span_table_make(&doc->spans, allocator);
+}
+
+// gives up an on-demand document's source
+static void release_source(kdl_document_t *doc) {
+    if (doc->source_mapped)
+        kdl_unmap_file(doc->source, doc->source_len);
+
+    doc->source = NULL;
+    doc->source_len = 0;
+    doc->source_mapped = false;
+}
+
+void kdl_document_reset(kdl_document_t *doc) {
+    release_source(doc);
+    kdl_htable_reset(&doc->node_table);
+    kdl_htable_reset(&doc->data_table);
+    kdl_span_table_clear(&doc->spans);
+
+    doc->nodes = NULL;
+    doc->num_nodes = doc->cap_nodes = 0;
+    doc->limit_error = (kdl_limit_error_t){0};
+    doc->utf8_error = (kdl_utf8_error_t){0};
+    doc->decode_error = (kdl_decode_error_t){0};
+}
+
+void kdl_document_free(kdl_document_t *doc) {
+    release_source(doc);
+    kdl_htable_release(&doc->node_table);
+    kdl_htable_release(&doc->data_table);
+    kdl_span_table_release(&doc->spans);
+
+    doc->nodes = NULL;
+    doc->num_nodes = doc->cap_nodes = 0;
 }
 
 static char *dup_string(
-    kdl_document_t *doc, char *string, size_t length, kdl_href_t *out_ref
+    kdl_document_t *doc, const char *string, size_t length, kdl_href_t *out_ref
 ) {
     char *ptr = kdl_htable_alloc(&doc->data_table, out_ref, length + 1);
-    char *trav = ptr;
 
-    while ((*trav++ = *string++))
-        ;
+    memcpy(ptr, string, length + 1);
 
     return ptr;
 }
 
-static void extract_token_value(
-    kdl_document_t *doc, kdl_value_t *val, kdl_token_t *token
+// stores the text of a string or raw value, in the value if it's short enough
+static void store_string(
+    kdl_document_t *doc, kdl_value_t *val, const char *string, size_t length
+) {
+    if (length <= KDL_SMALL_STR_LEN) {
+        memmove(val->data.small, string, length);
+        val->data.small[length] = 0;
+        val->storage = KDL_STR_SMALL;
+    } else {
+        dup_string(doc, string, length, &val->data.str_ref);
+        val->storage = KDL_STR_TABLE;
+    }
+}
+
+/*
+ * makes room for one more element in an array with len elements. capacity
+ * doubles, and fixed data blocks never move so the array grows in place there.
+ * with an allocator it may move, so always use the returned array.
+ */
+static void *reserve_array(
+    kdl_document_t *doc, void *array, kdl_href_t *ref, size_t len, size_t *cap,
+    size_t elem_size
+) {
+    if (len < *cap)
+        return array;
+
+    size_t max_cap = doc->data_table.allocator
+        ? SIZE_MAX / elem_size
+        : doc->data_table.block_size / elem_size;
+
+    if (len >= max_cap) {
+        KDL_ERROR(
+            "an array of %zu elements doesn't fit in a data block of %zu bytes."
+            "\n", len + 1, doc->data_table.block_size
+        );
+    }
+
+    size_t old_cap = *cap;
+
+    if (old_cap)
+        *cap = old_cap * 2;
+    else
+        *cap = doc->data_table.allocator ? 1 : MIN_ARRAY_CAP;
+
+    if (*cap > max_cap)
+        *cap = max_cap;
+
+    if (!old_cap)
+        return kdl_htable_alloc(&doc->data_table, ref, *cap * elem_size);
+
+    return kdl_htable_realloc(&doc->data_table, ref, *cap * elem_size);
+}
+
+static kdl_value_t *reserve_arg(kdl_document_t *doc, kdl_node_t *node) {
+    node->args = reserve_array(
+        doc, node->args, &node->args_ref, node->num_args, &node->cap_args,
+        sizeof(*node->args)
+    );
+
+    return &node->args[node->num_args];
+}
+
+static kdl_prop_t *reserve_prop(kdl_document_t *doc, kdl_node_t *node) {
+    node->props = reserve_array(
+        doc, node->props, &node->props_ref, node->num_props, &node->cap_props,
+        sizeof(*node->props)
+    );
+
+    return &node->props[node->num_props];
+}
+
+/*
+ * an invalid hash always has invalid ancestors, since hashing a node hashes its
+ * children first. so this can stop at the first node that's already invalid.
+ */
+static void invalidate_hash(kdl_node_t *node) {
+    for (; node && node->hash_valid; node = node->parent)
+        node->hash_valid = false;
+}
+
+// a node's entry in the span table, or NULL if it doesn't have one
+static kdl_node_spans_t *find_spans(kdl_document_t *doc, kdl_node_t *node) {
+    kdl_span_table_t *spans = &doc->spans;
+    kdl_href_t *ref = &node->self_ref;
+
+    if (ref->index >= spans->cap_nodes)
+        return NULL;
+
+    kdl_node_spans_t *entry = &spans->nodes[ref->index];
+
+    return entry->count == ref->count ? entry : NULL;
+}
+
+// a node's values changed, so their spans don't line up anymore
+static void forget_value_spans(kdl_document_t *doc, kdl_node_t *node) {
+    kdl_node_spans_t *entry = find_spans(doc, node);
+
+    if (entry)
+        entry->num_args = entry->num_props = 0;
+}
+
+// inserts node into the children of parent, or the top level if it's NULL
+static void insert_child(
+    kdl_document_t *doc, kdl_node_t *parent, size_t index, kdl_node_t *node
+) {
+    kdl_node_t **children;
+    size_t len;
+
+    if (parent) {
+        children = parent->children = reserve_array(
+            doc, parent->children, &parent->children_ref, parent->num_children,
+            &parent->cap_children, sizeof(*parent->children)
+        );
+        len = parent->num_children++;
+    } else {
+        children = doc->nodes = reserve_array(
+            doc, doc->nodes, &doc->nodes_ref, doc->num_nodes, &doc->cap_nodes,
+            sizeof(*doc->nodes)
+        );
+        len = doc->num_nodes++;
+    }
+
+    memmove(
+        &children[index + 1], &children[index],
+        (len - index) * sizeof(*children)
+    );
+
+    children[index] = node;
+    node->parent = parent;
+
+    for (size_t i = index; i <= len; ++i)
+        children[i]->index = i;
+
+    invalidate_hash(parent);
+}
+
+static const kdl_annotation_decoder_t *find_decoder(
+    kdl_document_t *doc, const char *type
+) {
+    for (size_t i = 0; i < doc->num_decoders; ++i)
+        if (!strcmp(doc->decoders[i].type, type))
+            return &doc->decoders[i];
+
+    return NULL;
+}
+
+// returns false if a decoder rejected the value, which is left null
+static bool extract_token_value(
+    kdl_document_t *doc, kdl_value_t *val, kdl_token_t *token,
+    char *annotation, kdl_href_t annotation_ref
 ) {
+    KDL_PROFILE_BEGIN(KDL_PROF_EXTRACT_VALUE);
+
+    const kdl_annotation_decoder_t *decoder = annotation
+        ? find_decoder(doc, annotation)
+        : NULL;
+
+    val->raw = token->raw;
+    val->storage = KDL_STR_POINTER;
+    val->annotation_ref = annotation_ref;
+
+    // decoders always see decoded values
+    if (decoder && token->raw) {
+        val->raw = false;
+
+        if (token->type == KDL_TOK_STRING)
+            token->str_len = decode_escapes(token->string, token->str_len);
+        else if (!decode_number(token->string, &token->number))
+            KDL_ERROR("encountered an unknown value!\n");
+    }
+
     switch (token->type) {
     case KDL_TOK_STRING:
         val->type = KDL_STRING;
-        val->data.string = dup_string(
-            doc, token->string, token->str_len, &val->str_ref
-        );
+        val->data.string = token->string;
 
         break;
     case KDL_TOK_NUMBER:
         val->type = KDL_NUMBER;
-        val->data.number = token->number;
+
+        // raw numbers keep their text until decoded
+        if (val->raw)
+            val->data.string = token->string;
+        else
+            val->data.number = token->number;
 
         break;
     case KDL_TOK_BOOL:
@@ -76,185 +299,1438 @@ static void extract_token_value(
             KDL_TOKEN_TYPES[token->type]
         );
     }
+
+    if (decoder) {
+        bool has_text = token->type == KDL_TOK_STRING
+                     || token->type == KDL_TOK_NUMBER;
+
+        if (!decoder->decode(has_text ? token->string : NULL, val)) {
+            // it keeps its annotation, so that's freed along with it
+            *val = (kdl_value_t){
+                .type = KDL_NULL,
+                .annotation_ref = annotation_ref
+            };
+
+            KDL_PROFILE_END(KDL_PROF_EXTRACT_VALUE);
+
+            return false;
+        }
+    }
+
+    // text still in the token buffer is copied out
+    if (val->type == KDL_STRING || val->raw) {
+        const char *text = val->data.string;
+
+        store_string(
+            doc, val, text,
+            text == token->string ? token->str_len : strlen(text)
+        );
+    }
+
+    KDL_PROFILE_END(KDL_PROF_EXTRACT_VALUE);
+
+    return true;
 }
 
-// TODO add some memory knobs to turn
-static kdl_node_t *new_node(kdl_document_t *doc, kdl_token_t *token) {
+static kdl_node_t *new_node(
+    kdl_document_t *doc, const char *id, size_t id_len, bool id_is_identifier
+) {
+    KDL_PROFILE_BEGIN(KDL_PROF_NEW_NODE);
+
     kdl_href_t self_ref;
 
     kdl_node_t *node = kdl_htable_alloc(
         &doc->node_table, &self_ref, sizeof(*node)
     );
 
-    node->self_ref = self_ref;
+    // blocks are reused, so every field needs resetting
+    *node = (kdl_node_t){
+        .self_ref = self_ref,
+        .id_is_identifier = id_is_identifier
+    };
 
-    node->args = kdl_htable_alloc(
-        &doc->data_table, &node->args_ref, sizeof(*node->args) * 256
-    );
-    node->props = kdl_htable_alloc(
-        &doc->data_table, &node->props_ref, sizeof(*node->props) * 256
-    );
-    node->children = kdl_htable_alloc(
-        &doc->data_table, &node->children_ref, sizeof(*node->children) * 256
-    );
+    node->id = dup_string(doc, id, id_len, &node->id_ref);
 
-    node->id = dup_string(doc, token->string, token->str_len, &node->id_ref);
-    node->id_is_identifier = token->type == KDL_TOK_IDENTIFIER;
+    KDL_PROFILE_END(KDL_PROF_NEW_NODE);
 
     return node;
 }
 
-void kdl_document_load_file(kdl_document_t *doc, const char *filename) {
-    FILE *fp = fopen(filename, "r");
+void loader_make(kdl_loader_t *loader) {
+    *loader = (kdl_loader_t){0};
+}
 
-    if (!fp)
-        KDL_ERROR("couldn't load file: \"%s\"\n", filename);
+static bool hit_limit(
+    kdl_document_t *doc, kdl_limit_e limit, size_t max, size_t offset
+) {
+    doc->limit_error = (kdl_limit_error_t){
+        .limit = limit,
+        .max = max,
+        .offset = offset
+    };
 
-    // memory
-    char read_buf[4096], tok_buf[4096];
-    kdl_u8ch_t tzr_buf[4096];
+    return false;
+}
 
-    // tokenizing init
-    kdl_tokenizer_t tzr;
-    kdl_token_t token;
+// checks that loading a token won't take the document past its limits
+static bool check_limits(
+    kdl_document_t *doc, kdl_loader_t *loader, kdl_token_t *token,
+    const kdl_span_t *span
+) {
+    const kdl_limits_t *limits = doc->limits;
+    kdl_node_t *cur_node = loader->cur_node;
+    size_t offset = span ? loader->base + span->start : 0;
 
-    kdl_tokenizer_make(&tzr, tzr_buf, ARRAY_SIZE(tzr_buf));
-    kdl_token_make(&token, tok_buf);
+    switch (token->type) {
+    case KDL_TOK_IDENTIFIER:
+    case KDL_TOK_STRING:
+    case KDL_TOK_ANNOTATION:
+        if (limits->max_string_len && token->str_len > limits->max_string_len) {
+            return hit_limit(
+                doc, KDL_LIMIT_STRING_LEN, limits->max_string_len, offset
+            );
+        }
 
-    // document parsing state
-    kdl_node_t *node_stack[256]; // parent nodes
-    size_t node_stack_size = 0;
-    kdl_node_t *cur_node = NULL;
+        break;
+    default:
+        break;
+    }
 
-    bool await_prop = false;
+    if (token->node) {
+        kdl_htable_t *table = &doc->node_table;
 
-    while (fread(read_buf, sizeof(read_buf[0]), ARRAY_SIZE(read_buf), fp)) {
-        kdl_tok_feed(&tzr, read_buf, ARRAY_SIZE(read_buf));
+        if (
+            limits->max_nodes
+            && table->max_used - table->num_reusable >= limits->max_nodes
+        ) {
+            return hit_limit(doc, KDL_LIMIT_NODES, limits->max_nodes, offset);
+        }
+    } else if (token->property) {
+        if (limits->max_props && cur_node->num_props >= limits->max_props)
+            return hit_limit(doc, KDL_LIMIT_PROPS, limits->max_props, offset);
+    } else {
+        switch (token->type) {
+        case KDL_TOK_CHILD_BEGIN:
+            if (limits->max_depth && loader->depth >= limits->max_depth) {
+                return hit_limit(
+                    doc, KDL_LIMIT_DEPTH, limits->max_depth, offset
+                );
+            }
 
-        while (kdl_tok_next(&tzr, &token)) {
-            if (token.node) {
-                // create new node
-                cur_node = new_node(doc, &token);
+            break;
+        case KDL_TOK_CHILD_END:
+        case KDL_TOK_ANNOTATION:
+            break;
+        default:
+            if (
+                !loader->await_prop && cur_node && limits->max_args
+                && cur_node->num_args >= limits->max_args
+            ) {
+                return hit_limit(doc, KDL_LIMIT_ARGS, limits->max_args, offset);
+            }
 
-                // save node to tree
-                if (node_stack_size) {
-                    kdl_node_t *parent = node_stack[node_stack_size - 1];
+            break;
+        }
+    }
 
-                    parent->children[parent->num_children++] = cur_node;
-                } else {
-                    doc->nodes[doc->num_nodes++] = cur_node;
-                }
-            } else if (token.property) {
-                // property id
-                kdl_prop_t *prop = &cur_node->props[cur_node->num_props];
+    return true;
+}
 
-                prop->id = dup_string(
-                    doc, token.string, token.str_len, &prop->id_ref
-                );
+// checks what loading a token took from the tables, once it's loaded
+static bool check_arena(
+    kdl_document_t *doc, kdl_loader_t *loader, const kdl_span_t *span
+) {
+    size_t max = doc->limits->max_arena_bytes;
+    size_t bytes =
+        doc->node_table.bytes_requested + doc->data_table.bytes_requested;
 
-                prop->id_is_identifier = token.type == KDL_TOK_IDENTIFIER;
-                await_prop = true;
-            } else {
-                switch (token.type) {
-                case KDL_TOK_CHILD_BEGIN:
-                    node_stack[node_stack_size++] = cur_node;
+    if (max && bytes > max) {
+        return hit_limit(
+            doc, KDL_LIMIT_ARENA_BYTES, max,
+            span ? loader->base + span->start : 0
+        );
+    }
 
-                    break;
-                case KDL_TOK_CHILD_END:
-                    --node_stack_size;
+    return true;
+}
 
-                    break;
-                default:;
-                    kdl_value_t *value;
+// a token too long for the tokenizer's buffer stopped it
+static bool hit_overflow(
+    kdl_document_t *doc, kdl_loader_t *loader, kdl_tokenizer_t *tzr
+) {
+    size_t max = doc->limits->max_string_len;
 
-                    if (await_prop) {
-                        await_prop = false;
-                        value = &cur_node->props[cur_node->num_props++].value;
-                    } else {
-                        value = &cur_node->args[cur_node->num_args++];
-                    }
+    if (!max || max > tzr->buf_size)
+        max = tzr->buf_size;
 
-                    extract_token_value(doc, value, &token);
+    return hit_limit(
+        doc, KDL_LIMIT_STRING_LEN, max, loader->base + tzr->span.start
+    );
+}
 
-                    break;
-                }
-            }
-        }
-    }
+// fed data turned out not to be utf-8
+static bool hit_invalid_utf8(
+    kdl_document_t *doc, kdl_loader_t *loader, kdl_tokenizer_t *tzr
+) {
+    doc->utf8_error = tzr->utf8.error;
+    doc->utf8_error.offset += loader->base;
 
-    fclose(fp);
+    return false;
 }
 
-static inline void print_level(int level) {
-    printf("%*s", level * 4, "");
+// a decoder rejected the value at span
+static bool hit_rejected(
+    kdl_document_t *doc, kdl_loader_t *loader, const char *annotation,
+    const kdl_span_t *span
+) {
+    doc->decode_error = (kdl_decode_error_t){
+        .rejected = true,
+        .annotation = annotation,
+        .offset = span ? loader->base + span->start : 0
+    };
+
+    return false;
 }
 
-static void serialize_value(char *buf, size_t buf_size, kdl_value_t *val) {
-    switch (val->type) {
-    case KDL_STRING:
-        kdl_serialize_string(buf, buf_size, val->data.string);
+// checks a load's input against max_input_bytes before it's loaded
+static bool check_input(kdl_document_t *doc, size_t length) {
+    size_t max = doc->limits ? doc->limits->max_input_bytes : 0;
 
-        break;
-    case KDL_NUMBER:
-        kdl_serialize_number(buf, buf_size, val->data.number);
+    if (max && length > max)
+        return hit_limit(doc, KDL_LIMIT_INPUT_BYTES, max, max);
+
+    return true;
+}
+
+// called after load_token() has added the token to the document
+static void record_span(
+    kdl_document_t *doc, kdl_loader_t *loader, kdl_token_t *token,
+    const kdl_span_t *span
+) {
+    kdl_node_t *cur_node = loader->cur_node;
+    kdl_span_t at = {
+        loader->base + span->start,
+        loader->base + span->end
+    };
+
+    // annotations and property names start the span of what follows them
+    if (token->property || token->type == KDL_TOK_ANNOTATION) {
+        if (!loader->span_pending) {
+            loader->span_start = at.start;
+            loader->span_pending = true;
+        }
+
+        return;
+    }
+
+    if (loader->span_pending && token->type != KDL_TOK_CHILD_END) {
+        at.start = loader->span_start;
+        loader->span_pending = false;
+    }
 
+    if (token->node) {
+        kdl_node_spans_t *entry =
+            kdl_span_table_node(&doc->spans, cur_node->self_ref.index);
+
+        *entry = (kdl_node_spans_t){
+            .span = at,
+            .count = cur_node->self_ref.count
+        };
+
+        return;
+    }
+
+    kdl_node_spans_t *entry = cur_node ? find_spans(doc, cur_node) : NULL;
+
+    if (!entry)
+        return;
+
+    switch (token->type) {
+    case KDL_TOK_CHILD_BEGIN:
         break;
-    case KDL_BOOL:
-        kdl_serialize_bool(buf, buf_size, val->data.boolean);
+    case KDL_TOK_CHILD_END:
+        // cur_node is the node whose block just closed
+        entry->span.end = at.end;
 
         break;
-    case KDL_NULL:
-        kdl_serialize_null(buf, buf_size);
+    default:
+        // the value went to args if they grew
+        if (cur_node->num_args > entry->num_args)
+            kdl_span_table_push_arg(&doc->spans, entry, at);
+        else
+            kdl_span_table_push_prop(&doc->spans, entry, at);
+
+        entry->span.end = at.end;
 
         break;
     }
 }
 
-static void print_node(kdl_node_t *node, int level) {
-    char buf[256];
+bool load_token(
+    kdl_document_t *doc, kdl_loader_t *loader, kdl_token_t *token,
+    const kdl_span_t *span
+) {
+    if (doc->limits && !check_limits(doc, loader, token, span))
+        return false;
 
-    print_level(level);
+    if (token->node) {
+        // create new node and save it to the tree
+        kdl_node_t *parent = loader->parent;
+        kdl_node_t *node = new_node(
+            doc, token->string, token->str_len,
+            token->type == KDL_TOK_IDENTIFIER
+        );
 
-    if (node->id_is_identifier) {
-        printf("%s ", node->id);
+        insert_child(
+            doc, parent, parent ? parent->num_children : doc->num_nodes, node
+        );
+
+        node->annotation = loader->annotation;
+        node->annotation_ref = loader->annotation_ref;
+        loader->cur_node = node;
+        loader->annotation = NULL;
+        loader->annotation_ref = (kdl_href_t){0};
+    } else if (token->property) {
+        // property id
+        kdl_prop_t *prop = reserve_prop(doc, loader->cur_node);
+
+        prop->id = dup_string(
+            doc, token->string, token->str_len, &prop->id_ref
+        );
+
+        prop->id_is_identifier = token->type == KDL_TOK_IDENTIFIER;
+        loader->await_prop = true;
     } else {
-        kdl_serialize_string(buf, ARRAY_SIZE(buf), node->id);
-        printf("%s ", buf);
-    }
+        kdl_node_t *cur_node = loader->cur_node;
 
-    for (size_t i = 0; i < node->num_args; ++i) {
-        serialize_value(buf, ARRAY_SIZE(buf), &node->args[i]);
-        printf("%s ", buf);
-    }
+        switch (token->type) {
+        case KDL_TOK_CHILD_BEGIN:
+            if (!cur_node || cur_node->parent != loader->parent)
+                KDL_ERROR("children without a node to belong to.\n");
 
-    for (size_t i = 0; i < node->num_props; ++i) {
-        kdl_prop_t *prop = &node->props[i];
+            if (loader->defer) {
+                cur_node->children_deferred = true;
+                cur_node->children_start =
+                    loader->base + loader->defer->brace_offset + 1;
+                loader->deferred = cur_node;
 
-        if (prop->id_is_identifier) {
-            printf("%s=", prop->id);
-        } else {
-            kdl_serialize_string(buf, ARRAY_SIZE(buf), prop->id);
-            printf("%s=", buf);
-        }
+                kdl_tok_skip_children(loader->defer);
+            } else {
+                loader->parent = cur_node;
+                ++loader->depth;
+            }
 
-        serialize_value(buf, ARRAY_SIZE(buf), &prop->value);
-        printf("%s ", buf);
+            break;
+        case KDL_TOK_CHILD_END:
+            if (!loader->parent)
+                KDL_ERROR("unmatched '}'.\n");
+
+            loader->cur_node = loader->parent;
+            loader->parent = loader->parent->parent;
+            --loader->depth;
+
+            break;
+        case KDL_TOK_ANNOTATION:
+            loader->annotation = dup_string(
+                doc, token->string, token->str_len, &loader->annotation_ref
+            );
+
+            break;
+        default:;
+            kdl_value_t *value;
+
+            if (loader->await_prop) {
+                loader->await_prop = false;
+                value = &cur_node->props[cur_node->num_props++].value;
+            } else {
+                value = reserve_arg(doc, cur_node);
+                ++cur_node->num_args;
+            }
+
+            char *annotation = loader->annotation;
+            bool decoded = extract_token_value(
+                doc, value, token, annotation, loader->annotation_ref
+            );
+
+            loader->annotation = NULL;
+            loader->annotation_ref = (kdl_href_t){0};
+
+            if (!decoded)
+                return hit_rejected(doc, loader, annotation, span);
+
+            break;
+        }
     }
 
-    if (node->num_children) {
-        printf("{\n");
+    if (doc->record_spans)
+        record_span(doc, loader, token, span);
+
+    return !doc->limits || check_arena(doc, loader, span);
+}
+
+// records where a skipped block ended, once the tokenizer is past it
+static void end_deferred(kdl_document_t *doc, kdl_loader_t *loader) {
+    kdl_node_t *node = loader->deferred;
+
+    if (!node || loader->defer->skip_depth)
+        return;
 
-        for (size_t i = 0; i < node->num_children; ++i)
-            print_node(node->children[i], level + 1);
+    node->children_end = loader->base + loader->defer->skip_end;
+    loader->deferred = NULL;
 
-        print_level(level);
-        putchar('}');
+    kdl_node_spans_t *entry =
+        loader->defer->spans ? find_spans(doc, node) : NULL;
+
+    if (entry)
+        entry->span.end = node->children_end + 1;
+}
+
+static bool load_deferred_tokens(
+    kdl_document_t *doc, kdl_loader_t *loader, kdl_token_t *token
+) {
+    kdl_tokenizer_t *tzr = loader->defer;
+
+    while (kdl_tok_next(tzr, token)) {
+        end_deferred(doc, loader);
+
+        if (!load_token(doc, loader, token, tzr->spans ? &tzr->span : NULL))
+            return false;
     }
 
-    putchar('\n');
+    return !tzr->overflowed || hit_overflow(doc, loader, tzr);
 }
 
-void kdl_document_debug(kdl_document_t *doc) {
-    for (size_t i = 0; i < doc->num_nodes; ++i)
-        print_node(doc->nodes[i], 0);
+/*
+ * loads the nodes in source[start, end) into parent, leaving their children
+ * blocks deferred. tokens have to be taken one at a time, so that a block can
+ * be skipped right after its '{'. returns false if it stopped at a limit.
+ */
+static bool load_deferred(
+    kdl_document_t *doc, kdl_node_t *parent, size_t start, size_t end
+) {
+    char tzr_buf[4096], tok_buf[4096];
+    kdl_tokenizer_t tzr;
+    kdl_token_t token;
+    kdl_loader_t loader;
+
+    kdl_tokenizer_make(&tzr, tzr_buf, ARRAY_SIZE(tzr_buf));
+    kdl_token_make(&token, tok_buf);
+    tzr.lazy_values = doc->lazy_values;
+    tzr.spans = doc->record_spans || doc->limits || doc->num_decoders;
+    tzr.soft_overflow = doc->limits != NULL;
+
+    loader_make(&loader);
+    loader.parent = parent;
+    loader.defer = &tzr;
+    loader.base = start;
+
+    // the block is as deep as the nodes around it
+    for (kdl_node_t *node = parent; node; node = node->parent)
+        ++loader.depth;
+
+    if (!kdl_tok_feed(&tzr, doc->source + start, end - start))
+        return hit_invalid_utf8(doc, &loader, &tzr);
+
+    if (!load_deferred_tokens(doc, &loader, &token))
+        return false;
+
+    if (!kdl_tok_finish(&tzr))
+        return hit_invalid_utf8(doc, &loader, &tzr);
+
+    if (!load_deferred_tokens(doc, &loader, &token))
+        return false;
+
+    end_deferred(doc, &loader);
+
+    if (loader.deferred)
+        KDL_ERROR("unmatched '{'.\n");
+
+    return true;
+}
+
+void kdl_node_load_children(kdl_document_t *doc, kdl_node_t *node) {
+    if (!node->children_deferred)
+        return;
+
+    node->children_deferred = false;
+    load_deferred(doc, node, node->children_start, node->children_end);
+}
+
+void kdl_document_expand(kdl_document_t *doc) {
+    kdl_cursor_t cursor;
+
+    // the cursor loads blocks as it enters them
+    kdl_cursor_make(&cursor, doc, NULL);
+
+    while (
+        !doc->limit_error.limit && !doc->utf8_error.invalid
+        && !doc->decode_error.rejected && kdl_cursor_next(&cursor)
+    ) {
+        ;
+    }
+}
+
+bool kdl_document_load(kdl_document_t *doc, kdl_input_t *input) {
+    if (doc->on_demand) {
+        KDL_ERROR(
+            "on-demand documents have to be loaded from a file or memory.\n"
+        );
+    }
+
+    doc->limit_error = (kdl_limit_error_t){0};
+    doc->utf8_error = (kdl_utf8_error_t){0};
+    doc->decode_error = (kdl_decode_error_t){0};
+
+    // memory
+    char tzr_buf[4096], tok_bytes[4 * 4096];
+    kdl_token_t tokens[64];
+    kdl_span_t spans[ARRAY_SIZE(tokens)];
+
+    // tokenizing init
+    kdl_tokenizer_t tzr;
+    kdl_token_batch_t batch;
+
+    kdl_tokenizer_make(&tzr, tzr_buf, ARRAY_SIZE(tzr_buf));
+    kdl_token_batch_make(
+        &batch, tokens, ARRAY_SIZE(tokens), tok_bytes, ARRAY_SIZE(tok_bytes)
+    );
+
+    tzr.lazy_values = doc->lazy_values;
+
+    // the source is gone after loading, so lines are indexed as it's read
+    if (doc->record_spans)
+        kdl_span_table_unindex(&doc->spans);
+
+    // limits and decoders say where they stopped with spans
+    if (doc->record_spans || doc->limits || doc->num_decoders) {
+        tzr.spans = true;
+        batch.spans = spans;
+    }
+
+    tzr.soft_overflow = doc->limits != NULL;
+
+    // document parsing state
+    kdl_loader_t loader;
+    size_t total = 0;
+    bool finished = false;
+
+    loader_make(&loader);
+
+    while (!finished) {
+        const char *data;
+        size_t read = kdl_input_read(input, &data);
+
+        total += read;
+
+        if (!check_input(doc, total))
+            return false;
+
+        if (read) {
+            if (!kdl_tok_feed(&tzr, data, read))
+                return hit_invalid_utf8(doc, &loader, &tzr);
+
+            if (doc->record_spans)
+                kdl_span_table_index(&doc->spans, data, read);
+        } else {
+            if (!kdl_tok_finish(&tzr))
+                return hit_invalid_utf8(doc, &loader, &tzr);
+
+            finished = true;
+        }
+
+        // tokens are taken a batch at a time until more data is needed
+        while (kdl_tok_next_batch(&tzr, &batch)) {
+            for (size_t i = 0; i < batch.num_tokens; ++i) {
+                kdl_token_t *token = &batch.tokens[i];
+
+                if (!load_token(
+                    doc, &loader, token, batch.spans ? &batch.spans[i] : NULL
+                )) {
+                    return false;
+                }
+            }
+        }
+
+        if (tzr.overflowed)
+            return hit_overflow(doc, &loader, &tzr);
+    }
+
+    doc->spans.indexed = doc->record_spans;
+
+    return true;
+}
+
+bool kdl_document_load_memory(
+    kdl_document_t *doc, const char *data, size_t length
+) {
+    if (!doc->on_demand) {
+        kdl_input_t input;
+
+        kdl_input_memory(&input, data, length);
+
+        return kdl_document_load(doc, &input);
+    }
+
+    doc->limit_error = (kdl_limit_error_t){0};
+    doc->utf8_error = (kdl_utf8_error_t){0};
+    doc->decode_error = (kdl_decode_error_t){0};
+
+    // nodes deferred from an earlier source still need theirs
+    if (doc->source) {
+        kdl_document_expand(doc);
+
+        if (
+            doc->limit_error.limit || doc->utf8_error.invalid
+            || doc->decode_error.rejected
+        ) {
+            return false;
+        }
+
+        release_source(doc);
+    }
+
+    if (!check_input(doc, length))
+        return false;
+
+    doc->source = data;
+    doc->source_len = length;
+    kdl_span_table_unindex(&doc->spans);
+
+    return load_deferred(doc, NULL, 0, length);
+}
+
+bool kdl_document_load_file(kdl_document_t *doc, const char *filename) {
+    if (doc->on_demand) {
+        size_t length;
+        const char *data = kdl_map_file(filename, &length);
+        bool loaded = kdl_document_load_memory(doc, data, length);
+
+        // a file turned away before loading is still ours to unmap
+        if (doc->source == data)
+            doc->source_mapped = data != NULL;
+        else
+            kdl_unmap_file(data, length);
+
+        return loaded;
+    }
+
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+        KDL_ERROR("couldn't load file: \"%s\"\n", filename);
+
+    // split between the reads io_uring keeps in flight
+    char read_buf[32 * 1024];
+    kdl_input_t input;
+
+    kdl_input_uring(&input, fd, read_buf, ARRAY_SIZE(read_buf));
+
+    bool loaded = kdl_document_load(doc, &input);
+
+    kdl_input_close(&input);
+    close(fd);
+
+    return loaded;
+}
+
+bool kdl_node_span(kdl_document_t *doc, kdl_node_t *node, kdl_span_t *span) {
+    kdl_node_spans_t *entry = find_spans(doc, node);
+
+    if (entry)
+        *span = entry->span;
+
+    return entry != NULL;
+}
+
+bool kdl_arg_span(
+    kdl_document_t *doc, kdl_node_t *node, size_t index, kdl_span_t *span
+) {
+    kdl_node_spans_t *entry = find_spans(doc, node);
+
+    if (!entry || index >= entry->num_args)
+        return false;
+
+    *span = doc->spans.args[entry->args + index];
+
+    return true;
+}
+
+bool kdl_prop_span(
+    kdl_document_t *doc, kdl_node_t *node, size_t index, kdl_span_t *span
+) {
+    kdl_node_spans_t *entry = find_spans(doc, node);
+
+    if (!entry || index >= entry->num_props)
+        return false;
+
+    *span = doc->spans.props[entry->props + index];
+
+    return true;
+}
+
+kdl_location_t kdl_document_locate(kdl_document_t *doc, size_t offset) {
+    kdl_span_table_t *spans = &doc->spans;
+
+    if (!spans->indexed && doc->source) {
+        kdl_span_table_index(spans, doc->source, doc->source_len);
+        spans->indexed = true;
+    }
+
+    return kdl_span_table_locate(spans, offset);
+}
+
+kdl_value_t *kdl_value_decode(kdl_document_t *doc, kdl_value_t *val) {
+    if (!val->raw)
+        return val;
+
+    char *text = kdl_value_text(doc, val);
+
+    switch (val->type) {
+    case KDL_STRING:
+        // escapes only ever shrink a string, so decode where it sits
+        decode_escapes(text, strlen(text));
+
+        break;
+    case KDL_NUMBER:;
+        double number;
+
+        if (!decode_number(text, &number))
+            KDL_ERROR("encountered an unknown value!\n");
+
+        // the text isn't needed anymore
+        if (val->storage == KDL_STR_TABLE)
+            kdl_htable_free(&doc->data_table, &val->data.str_ref);
+
+        val->data.number = number;
+
+        break;
+    default:
+        break;
+    }
+
+    val->raw = false;
+
+    return val;
+}
+
+void kdl_document_stats(kdl_document_t *doc, kdl_document_stats_t *stats) {
+    kdl_htable_stats(&doc->node_table, &stats->nodes);
+    kdl_htable_stats(&doc->data_table, &stats->data);
+}
+
+/*
+ * mutation
+ */
+
+kdl_node_t *kdl_node_get(kdl_document_t *doc, kdl_href_t *node) {
+    return kdl_htable_get(&doc->node_table, node);
+}
+
+static kdl_node_t *get_live_node(kdl_document_t *doc, kdl_href_t *ref) {
+    kdl_node_t *node = kdl_node_get(doc, ref);
+
+    if (!node)
+        KDL_ERROR("tried to use a node that was already removed.\n");
+
+    return node;
+}
+
+// whether a value keeps text, which strings and undecoded raw values do
+static bool value_has_text(kdl_value_t *val) {
+    return val->type == KDL_STRING || val->raw;
+}
+
+// copies a value from src_doc, which can be doc
+static void copy_value(
+    kdl_document_t *doc, kdl_value_t *dst, kdl_document_t *src_doc,
+    kdl_value_t *src
+) {
+    char *annotation = kdl_value_annotation(src_doc, src);
+
+    *dst = *src;
+    dst->annotation_ref = (kdl_href_t){0};
+
+    if (value_has_text(src)) {
+        char *text = kdl_value_text(src_doc, src);
+
+        store_string(doc, dst, text, strlen(text));
+    }
+
+    if (annotation) {
+        dup_string(
+            doc, annotation, strlen(annotation), &dst->annotation_ref
+        );
+    }
+}
+
+static void free_value(kdl_document_t *doc, kdl_value_t *val) {
+    if (value_has_text(val) && val->storage == KDL_STR_TABLE)
+        kdl_htable_free(&doc->data_table, &val->data.str_ref);
+
+    if (val->annotation_ref.count)
+        kdl_htable_free(&doc->data_table, &val->annotation_ref);
+}
+
+// frees what a node owns except for its children
+static void free_node_data(kdl_document_t *doc, kdl_node_t *node) {
+    kdl_htable_t *data = &doc->data_table;
+
+    for (size_t i = 0; i < node->num_args; ++i)
+        free_value(doc, &node->args[i]);
+
+    for (size_t i = 0; i < node->num_props; ++i) {
+        kdl_htable_free(data, &node->props[i].id_ref);
+        free_value(doc, &node->props[i].value);
+    }
+
+    if (node->cap_args)
+        kdl_htable_free(data, &node->args_ref);
+    if (node->cap_props)
+        kdl_htable_free(data, &node->props_ref);
+    if (node->cap_children)
+        kdl_htable_free(data, &node->children_ref);
+
+    if (node->annotation)
+        kdl_htable_free(data, &node->annotation_ref);
+
+    kdl_htable_free(data, &node->id_ref);
+    kdl_htable_free(&doc->node_table, &node->self_ref);
+}
+
+static void free_node(kdl_document_t *doc, kdl_node_t *node) {
+    kdl_cursor_t cursor;
+    kdl_node_t *left = NULL;
+
+    kdl_cursor_make(&cursor, doc, node);
+
+    // nodes are freed once the cursor has moved past them
+    while (kdl_cursor_next(&cursor)) {
+        if (left)
+            free_node_data(doc, left);
+
+        // a deferred block has nothing to free, so it isn't loaded
+        cursor.node->children_deferred = false;
+
+        left = cursor.event == KDL_CURSOR_LEAVE ? cursor.node : NULL;
+    }
+
+    if (left)
+        free_node_data(doc, left);
+}
+
+// removes a node from its siblings and returns where it was
+static size_t detach_node(kdl_document_t *doc, kdl_node_t *node) {
+    kdl_node_t **siblings = node->parent ? node->parent->children : doc->nodes;
+    size_t *len = node->parent ? &node->parent->num_children : &doc->num_nodes;
+    size_t index = node->index;
+
+    memmove(
+        &siblings[index], &siblings[index + 1],
+        (--*len - index) * sizeof(*siblings)
+    );
+
+    for (size_t i = index; i < *len; ++i)
+        siblings[i]->index = i;
+
+    invalidate_hash(node->parent);
+
+    return index;
+}
+
+kdl_href_t kdl_node_append(
+    kdl_document_t *doc, kdl_href_t *parent, const char *id
+) {
+    kdl_node_t *parent_node = parent ? get_live_node(doc, parent) : NULL;
+
+    if (parent_node)
+        kdl_node_expand(doc, parent_node);
+
+    size_t index = parent_node ? parent_node->num_children : doc->num_nodes;
+
+    return kdl_node_insert(doc, parent, index, id);
+}
+
+kdl_href_t kdl_node_insert(
+    kdl_document_t *doc, kdl_href_t *parent, size_t index, const char *id
+) {
+    kdl_node_t *parent_node = parent ? get_live_node(doc, parent) : NULL;
+
+    if (parent_node)
+        kdl_node_expand(doc, parent_node);
+
+    size_t len = parent_node ? parent_node->num_children : doc->num_nodes;
+
+    if (index > len)
+        KDL_ERROR("tried to insert a node at %zu of %zu.\n", index, len);
+
+    kdl_node_t *node = new_node(doc, id, strlen(id), kdl_is_identifier(id));
+
+    insert_child(doc, parent_node, index, node);
+
+    return node->self_ref;
+}
+
+void kdl_node_remove(kdl_document_t *doc, kdl_href_t *ref) {
+    kdl_node_t *node = get_live_node(doc, ref);
+
+    detach_node(doc, node);
+    free_node(doc, node);
+}
+
+void kdl_node_move(kdl_document_t *doc, kdl_href_t *ref, size_t index) {
+    kdl_node_t *node = get_live_node(doc, ref);
+    size_t len = node->parent ? node->parent->num_children : doc->num_nodes;
+
+    if (index >= len)
+        KDL_ERROR("tried to move a node to %zu of %zu.\n", index, len);
+
+    // removing first leaves room, so this never has to grow
+    detach_node(doc, node);
+    insert_child(doc, node->parent, index, node);
+}
+
+void kdl_node_push_arg(
+    kdl_document_t *doc, kdl_href_t *ref, kdl_value_t *value
+) {
+    kdl_node_t *node = get_live_node(doc, ref);
+    kdl_value_t copy = *value; // value may be in args, which can move
+
+    copy_value(doc, reserve_arg(doc, node), doc, &copy);
+    ++node->num_args;
+
+    invalidate_hash(node);
+    forget_value_spans(doc, node);
+}
+
+void kdl_node_erase_arg(kdl_document_t *doc, kdl_href_t *ref, size_t index) {
+    kdl_node_t *node = get_live_node(doc, ref);
+
+    if (index >= node->num_args) {
+        KDL_ERROR(
+            "tried to erase arg %zu of %zu.\n", index, node->num_args
+        );
+    }
+
+    free_value(doc, &node->args[index]);
+
+    memmove(
+        &node->args[index], &node->args[index + 1],
+        (--node->num_args - index) * sizeof(*node->args)
+    );
+
+    invalidate_hash(node);
+    forget_value_spans(doc, node);
+}
+
+static kdl_prop_t *find_prop(kdl_node_t *node, const char *id) {
+    for (size_t i = 0; i < node->num_props; ++i)
+        if (!strcmp(node->props[i].id, id))
+            return &node->props[i];
+
+    return NULL;
+}
+
+// value is from src_doc, see copy_value()
+static void set_prop(
+    kdl_document_t *doc, kdl_node_t *node, const char *id,
+    kdl_document_t *src_doc, kdl_value_t *value
+) {
+    kdl_prop_t *prop = find_prop(node, id);
+    kdl_value_t copy = *value; // value may be in props, which can move
+    kdl_value_t old = {0};
+    bool replaced = prop != NULL;
+
+    if (replaced) {
+        // the old value is freed after copying, in case it's the new one
+        old = prop->value;
+    } else {
+        prop = reserve_prop(doc, node);
+        ++node->num_props;
+
+        prop->id = dup_string(doc, id, strlen(id), &prop->id_ref);
+        prop->id_is_identifier = kdl_is_identifier(id);
+    }
+
+    copy_value(doc, &prop->value, src_doc, &copy);
+
+    if (replaced)
+        free_value(doc, &old);
+
+    invalidate_hash(node);
+    forget_value_spans(doc, node);
+}
+
+void kdl_node_set_prop(
+    kdl_document_t *doc, kdl_href_t *ref, const char *id, kdl_value_t *value
+) {
+    set_prop(doc, get_live_node(doc, ref), id, doc, value);
+}
+
+bool kdl_node_remove_prop(
+    kdl_document_t *doc, kdl_href_t *ref, const char *id
+) {
+    kdl_node_t *node = get_live_node(doc, ref);
+    kdl_prop_t *prop = find_prop(node, id);
+
+    if (!prop)
+        return false;
+
+    kdl_htable_free(&doc->data_table, &prop->id_ref);
+    free_value(doc, &prop->value);
+
+    size_t index = prop - node->props;
+
+    memmove(
+        prop, prop + 1, (--node->num_props - index) * sizeof(*node->props)
+    );
+
+    invalidate_hash(node);
+    forget_value_spans(doc, node);
+
+    return true;
+}
+
+/*
+ * cloning and merging
+ */
+
+/*
+ * after the tables have been copied wholesale, every pointer in dst still
+ * points into src. everything in the data table is pointed to from the start
+ * of its block, so the href next to a pointer says where it went, and nodes
+ * carry their own href. values only hold hrefs, so they carry over as they are.
+ * live node blocks are the ones with an odd count.
+ */
+static void relocate_document(kdl_document_t *dst) {
+    kdl_htable_t *dst_nodes = &dst->node_table, *dst_data = &dst->data_table;
+
+#define RELOCATE_NODE(ptr) ((ptr) = kdl_htable_get(dst_nodes, &(ptr)->self_ref))
+#define RELOCATE_DATA(ptr, ref) ((ptr) = kdl_htable_get(dst_data, &(ref)))
+
+    if (dst->cap_nodes) {
+        RELOCATE_DATA(dst->nodes, dst->nodes_ref);
+
+        for (size_t i = 0; i < dst->num_nodes; ++i)
+            RELOCATE_NODE(dst->nodes[i]);
+    }
+
+    for (size_t i = 0; i < dst_nodes->max_used; ++i) {
+        if (!(dst_nodes->counts[i] & 1))
+            continue;
+
+        kdl_node_t *node = kdl_htable_block(dst_nodes, i);
+
+        RELOCATE_DATA(node->id, node->id_ref);
+
+        if (node->annotation)
+            RELOCATE_DATA(node->annotation, node->annotation_ref);
+
+        if (node->parent)
+            RELOCATE_NODE(node->parent);
+
+        if (node->cap_args)
+            RELOCATE_DATA(node->args, node->args_ref);
+        if (node->cap_props)
+            RELOCATE_DATA(node->props, node->props_ref);
+        if (node->cap_children)
+            RELOCATE_DATA(node->children, node->children_ref);
+
+        for (size_t j = 0; j < node->num_props; ++j)
+            RELOCATE_DATA(node->props[j].id, node->props[j].id_ref);
+
+        for (size_t j = 0; j < node->num_children; ++j)
+            RELOCATE_NODE(node->children[j]);
+    }
+
+#undef RELOCATE_NODE
+#undef RELOCATE_DATA
+}
+
+// copies what a node owns except for its children
+static kdl_node_t *copy_node_data(
+    kdl_document_t *doc, kdl_node_t *parent, size_t index,
+    kdl_document_t *src_doc, kdl_node_t *src
+) {
+    kdl_node_t *node = new_node(
+        doc, src->id, strlen(src->id), src->id_is_identifier
+    );
+
+    insert_child(doc, parent, index, node);
+
+    if (src->annotation) {
+        node->annotation = dup_string(
+            doc, src->annotation, strlen(src->annotation),
+            &node->annotation_ref
+        );
+    }
+
+    for (size_t i = 0; i < src->num_args; ++i) {
+        copy_value(doc, reserve_arg(doc, node), src_doc, &src->args[i]);
+        ++node->num_args;
+    }
+
+    for (size_t i = 0; i < src->num_props; ++i) {
+        kdl_prop_t *prop = reserve_prop(doc, node), *src_prop = &src->props[i];
+
+        prop->id = dup_string(
+            doc, src_prop->id, strlen(src_prop->id), &prop->id_ref
+        );
+        prop->id_is_identifier = src_prop->id_is_identifier;
+        copy_value(doc, &prop->value, src_doc, &src_prop->value);
+
+        ++node->num_props;
+    }
+
+    return node;
+}
+
+// deep copies a node from src_doc into index of parent's children
+static kdl_node_t *copy_node(
+    kdl_document_t *doc, kdl_node_t *parent, size_t index,
+    kdl_document_t *src_doc, kdl_node_t *src
+) {
+    kdl_cursor_t cursor;
+    kdl_node_t *copy = NULL;
+
+    // a subtree walk never looks at the top level, so no document is needed
+    kdl_cursor_make(&cursor, NULL, src);
+
+    while (kdl_cursor_next(&cursor)) {
+        kdl_node_t *node = cursor.node;
+
+        if (cursor.event == KDL_CURSOR_ENTER) {
+            kdl_node_t *node_copy = copy_node_data(
+                doc, parent, node == src ? index : parent->num_children,
+                src_doc, node
+            );
+
+            if (node == src)
+                copy = node_copy;
+
+            // copies of children go in this copy until it's left
+            if (node->num_children)
+                parent = node_copy;
+        } else if (node->num_children) {
+            parent = parent->parent;
+        }
+    }
+
+    return copy;
+}
+
+// makes dst from bufs, or from src's allocator if there are none
+static void make_clone(
+    kdl_document_t *dst, kdl_document_buffers_t *bufs, kdl_document_t *src
+) {
+    const kdl_allocator_t *allocator = src->node_table.allocator;
+
+    if (bufs)
+        kdl_document_make(dst, bufs);
+    else if (allocator)
+        kdl_document_make_alloc(dst, allocator);
+    else
+        kdl_document_make_alloc(dst, &KDL_DEFAULT_ALLOCATOR);
+
+    dst->lazy_values = src->lazy_values;
+}
+
+void kdl_document_clone(
+    kdl_document_t *dst, kdl_document_buffers_t *bufs, kdl_document_t *src
+) {
+    // a clone doesn't share the source, so it gets everything loaded
+    kdl_document_expand(src);
+    make_clone(dst, bufs, src);
+
+    // same block layout means the tables can be copied as they are
+    if (
+        kdl_htable_copy(&dst->node_table, &src->node_table)
+        && kdl_htable_copy(&dst->data_table, &src->data_table)
+    ) {
+        dst->nodes = src->nodes;
+        dst->nodes_ref = src->nodes_ref;
+        dst->num_nodes = src->num_nodes;
+        dst->cap_nodes = src->cap_nodes;
+
+        relocate_document(dst);
+
+        return;
+    }
+
+    // otherwise copy node by node, starting over in case one table was copied
+    kdl_document_free(dst);
+    make_clone(dst, bufs, src);
+
+    for (size_t i = 0; i < src->num_nodes; ++i)
+        copy_node(dst, NULL, i, src, src->nodes[i]);
+}
+
+static kdl_merge_mode_e merge_mode(
+    const kdl_merge_rules_t *rules, const char *id
+) {
+    for (size_t i = 0; i < rules->num_rules; ++i)
+        if (!strcmp(rules->rules[i].id, id))
+            return rules->rules[i].mode;
+
+    return rules->default_mode;
+}
+
+// merges everything but children
+static void merge_node_data(
+    kdl_document_t *doc, kdl_node_t *node, kdl_document_t *src_doc,
+    kdl_node_t *src
+) {
+    if (src->annotation) {
+        if (node->annotation)
+            kdl_htable_free(&doc->data_table, &node->annotation_ref);
+
+        node->annotation = dup_string(
+            doc, src->annotation, strlen(src->annotation),
+            &node->annotation_ref
+        );
+
+        invalidate_hash(node);
+    }
+
+    // args are replaced as a whole, since their meaning is positional
+    if (src->num_args) {
+        for (size_t i = 0; i < node->num_args; ++i)
+            free_value(doc, &node->args[i]);
+
+        node->num_args = 0;
+
+        for (size_t i = 0; i < src->num_args; ++i) {
+            copy_value(doc, reserve_arg(doc, node), src_doc, &src->args[i]);
+            ++node->num_args;
+        }
+
+        invalidate_hash(node);
+        forget_value_spans(doc, node);
+    }
+
+    for (size_t i = 0; i < src->num_props; ++i)
+        set_prop(doc, node, src->props[i].id, src_doc, &src->props[i].value);
+}
+
+/*
+ * each set of children being merged into has a frame on the scratch stack,
+ * with its id index right after it. merging into a node opens a frame for its
+ * children on top, so any depth works without recursing.
+ */
+typedef struct merge_frame {
+    size_t parent; // the frame this one was opened from
+    size_t mark; // where the stack was before this frame
+
+    kdl_node_t *node; // NULL for the top level
+    kdl_node_t **src_children;
+    size_t num_src, base_len, by_id;
+    size_t next; // the next overlay node to merge
+} merge_frame_t;
+
+static size_t open_merge(
+    kdl_document_t *doc, kdl_scratch_t *scratch, size_t parent,
+    kdl_node_t *node, kdl_node_t **src_children, size_t num_src
+) {
+    /*
+     * only nodes which were there before this merge are matched against. they
+     * keep their places, since replacements go where they were and everything
+     * else is appended.
+     */
+    size_t base_len = node ? node->num_children : doc->num_nodes;
+    size_t mark = scratch->len;
+    size_t frame_at = scratch_push(scratch, sizeof(merge_frame_t));
+    size_t by_id = id_index_make(
+        scratch, node ? node->children : doc->nodes, base_len
+    );
+
+    *(merge_frame_t *)scratch_at(scratch, frame_at) = (merge_frame_t){
+        .parent = parent,
+        .mark = mark,
+        .node = node,
+        .src_children = src_children,
+        .num_src = num_src,
+        .base_len = base_len,
+        .by_id = by_id
+    };
+
+    return frame_at;
+}
+
+static void merge_children(
+    kdl_document_t *doc, kdl_document_t *src_doc,
+    const kdl_merge_rules_t *rules, kdl_scratch_t *scratch
+) {
+    size_t top = open_merge(
+        doc, scratch, SCRATCH_NONE, NULL, src_doc->nodes, src_doc->num_nodes
+    );
+
+    while (top != SCRATCH_NONE) {
+        // opening a frame pushes more, which can move the stack
+        merge_frame_t *frame = scratch_at(scratch, top);
+
+        if (frame->next == frame->num_src) {
+            top = frame->parent;
+            scratch_pop(scratch, frame->mark);
+
+            continue;
+        }
+
+        kdl_node_t *parent = frame->node;
+        kdl_node_t *src = frame->src_children[frame->next++];
+        kdl_node_t **siblings = parent ? parent->children : doc->nodes;
+        size_t len = parent ? parent->num_children : doc->num_nodes;
+        kdl_merge_mode_e mode = merge_mode(rules, src->id);
+
+        // the nth overlay node with an id matches the nth base node with it
+        size_t at = id_index_take(scratch, frame->by_id, siblings, src->id);
+        kdl_node_t *match = mode == KDL_MERGE_APPEND || at == frame->base_len
+            ? NULL
+            : siblings[at];
+
+        if (!match) {
+            copy_node(doc, parent, len, src_doc, src);
+        } else if (mode == KDL_MERGE_REPLACE) {
+            size_t index = detach_node(doc, match);
+
+            free_node(doc, match);
+            copy_node(doc, parent, index, src_doc, src);
+        } else {
+            merge_node_data(doc, match, src_doc, src);
+
+            top = open_merge(
+                doc, scratch, top, match, src->children, src->num_children
+            );
+        }
+    }
+}
+
+void kdl_document_merge(
+    kdl_document_t *doc, kdl_document_t *overlay,
+    const kdl_merge_rules_t *rules
+) {
+    kdl_scratch_t scratch;
+
+    kdl_document_expand(doc);
+    kdl_document_expand(overlay);
+    scratch_make(&scratch, doc);
+
+    merge_children(doc, overlay, rules, &scratch);
+
+    scratch_free(&scratch);
+}
+
+static inline void print_level(int level) {
+    printf("%*s", level * 4, "");
+}
+
+static void serialize_value(
+    kdl_document_t *doc, char *buf, size_t buf_size, kdl_value_t *val
+) {
+    kdl_value_decode(doc, val);
+
+    switch (val->type) {
+    case KDL_STRING:
+        kdl_serialize_string(buf, buf_size, kdl_value_text(doc, val));
+
+        break;
+    case KDL_NUMBER:
+        kdl_serialize_number(buf, buf_size, val->data.number);
+
+        break;
+    case KDL_BOOL:
+        kdl_serialize_bool(buf, buf_size, val->data.boolean);
+
+        break;
+    case KDL_NULL:
+        kdl_serialize_null(buf, buf_size);
+
+        break;
+    case KDL_INT:
+        kdl_serialize_int(buf, buf_size, val->data.integer);
+
+        break;
+    case KDL_UINT:
+        kdl_serialize_uint(buf, buf_size, val->data.uinteger);
+
+        break;
+    case KDL_UUID:
+        kdl_serialize_uuid(buf, buf_size, val->data.uuid);
+
+        break;
+    case KDL_TIMESTAMP:
+        kdl_serialize_timestamp(buf, buf_size, val->data.timestamp);
+
+        break;
+    }
+}
+
+static void print_annotation(char *annotation) {
+    char buf[256];
+
+    if (!annotation)
+        return;
+
+    if (kdl_is_identifier(annotation)) {
+        printf("(%s)", annotation);
+    } else {
+        kdl_serialize_string(buf, ARRAY_SIZE(buf), annotation);
+        printf("(%s)", buf);
+    }
+}
+
+// prints a node up to its children
+static void print_node(kdl_document_t *doc, kdl_node_t *node, int level) {
+    char buf[256];
+
+    print_level(level);
+    print_annotation(node->annotation);
+
+    if (node->id_is_identifier) {
+        printf("%s ", node->id);
+    } else {
+        kdl_serialize_string(buf, ARRAY_SIZE(buf), node->id);
+        printf("%s ", buf);
+    }
+
+    for (size_t i = 0; i < node->num_args; ++i) {
+        print_annotation(kdl_value_annotation(doc, &node->args[i]));
+        serialize_value(doc, buf, ARRAY_SIZE(buf), &node->args[i]);
+        printf("%s ", buf);
+    }
+
+    for (size_t i = 0; i < node->num_props; ++i) {
+        kdl_prop_t *prop = &node->props[i];
+
+        if (prop->id_is_identifier) {
+            printf("%s=", prop->id);
+        } else {
+            kdl_serialize_string(buf, ARRAY_SIZE(buf), prop->id);
+            printf("%s=", buf);
+        }
+
+        print_annotation(kdl_value_annotation(doc, &prop->value));
+        serialize_value(doc, buf, ARRAY_SIZE(buf), &prop->value);
+        printf("%s ", buf);
+    }
+
+    kdl_node_expand(doc, node);
+
+    if (node->num_children)
+        putchar('{');
+
+    putchar('\n');
+}
+
+void kdl_document_debug(kdl_document_t *doc) {
+    kdl_cursor_t cursor;
+
+    kdl_cursor_make(&cursor, doc, NULL);
+
+    while (kdl_cursor_next(&cursor)) {
+        if (cursor.event == KDL_CURSOR_ENTER) {
+            print_node(doc, cursor.node, cursor.depth);
+        } else if (cursor.node->num_children) {
+            print_level(cursor.depth);
+            printf("}\n");
+        }
+    }
 }
@@ -0,0 +1,298 @@
+#include <string.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/extract.h>
+#include "token_parse.h"
+
+#define BIT(i) ((uint64_t)1 << (i))
+
+void kdl_extractor_make(
+    kdl_extractor_t *ex, kdl_extract_fn callback, void *ctx,
+    char *tzr_buf, size_t tzr_buf_size, char *tok_buf
+) {
+    *ex = (kdl_extractor_t){
+        .callback = callback,
+        .ctx = ctx,
+        .prop_name = tok_buf + tzr_buf_size,
+        .annotation = tok_buf + 2 * tzr_buf_size
+    };
+
+    kdl_tokenizer_make(&ex->tzr, tzr_buf, tzr_buf_size);
+    kdl_token_make(&ex->token, tok_buf);
+
+    // only the values of matching nodes are ever decoded
+    ex->tzr.lazy_values = true;
+}
+
+static size_t new_rule(kdl_extractor_t *ex) {
+    if (ex->num_rules == KDL_EXTRACT_MAX_RULES) {
+        KDL_ERROR(
+            "an extractor can't have more than %d rules.\n",
+            KDL_EXTRACT_MAX_RULES
+        );
+    }
+
+    return ex->num_rules++;
+}
+
+// '**' can match no levels at all, so the segment after it applies as well
+static uint64_t closure(kdl_extractor_t *ex, uint64_t segments) {
+    for (size_t i = 0; i < ex->num_segments; ++i) {
+        kdl_extract_segment_t *seg = &ex->segments[i];
+
+        if ((segments & BIT(i)) && seg->any_depth && !seg->last)
+            segments |= BIT(i + 1);
+    }
+
+    return segments;
+}
+
+static inline bool is_blank(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+size_t kdl_extractor_add_path(kdl_extractor_t *ex, const char *path) {
+    size_t rule = new_rule(ex), first = ex->num_segments;
+    const char *trav = path;
+
+    while (1) {
+        while (is_blank(*trav))
+            ++trav;
+
+        const char *start = trav, *end;
+
+        while (*trav && *trav != '>')
+            ++trav;
+
+        for (end = trav; end > start && is_blank(end[-1]); --end)
+            ;
+
+        if (end == start)
+            KDL_ERROR("extract path \"%s\" has an empty segment.\n", path);
+
+        if (ex->num_segments == KDL_EXTRACT_MAX_SEGMENTS) {
+            KDL_ERROR(
+                "an extractor's paths can't have more than %d segments.\n",
+                KDL_EXTRACT_MAX_SEGMENTS
+            );
+        }
+
+        size_t len = end - start;
+
+        ex->segments[ex->num_segments++] = (kdl_extract_segment_t){
+            .name = start,
+            .name_len = len,
+            .rule = rule,
+            .any_name = len == 1 && start[0] == '*',
+            .any_depth = len == 2 && start[0] == '*' && start[1] == '*'
+        };
+
+        if (!*trav++)
+            break;
+    }
+
+    ex->segments[ex->num_segments - 1].last = true;
+    ex->frames[0].segments = closure(ex, ex->frames[0].segments | BIT(first));
+
+    return rule;
+}
+
+size_t kdl_extractor_add_pred(
+    kdl_extractor_t *ex, kdl_extract_pred_fn fn, void *ctx
+) {
+    size_t rule = new_rule(ex);
+
+    ex->preds[ex->num_preds] = (kdl_extract_pred_t){
+        .fn = fn,
+        .ctx = ctx,
+        .rule = rule
+    };
+
+    ex->frames[0].preds |= BIT(ex->num_preds++);
+
+    return rule;
+}
+
+// finds the rules a node matches, and what applies to its children
+static void match_node(kdl_extractor_t *ex, kdl_token_t *token) {
+    kdl_extract_frame_t *frame = &ex->frames[ex->depth];
+    uint64_t segments = 0, preds = 0, rules = 0;
+    uint64_t left = frame->segments;
+
+    for (size_t i = 0; left; ++i, left >>= 1) {
+        kdl_extract_segment_t *seg = &ex->segments[i];
+
+        if (!(left & 1))
+            continue;
+
+        if (seg->any_depth) {
+            // '**' takes this node and stays for the next level
+            segments |= BIT(i);
+
+            if (seg->last)
+                rules |= BIT(seg->rule);
+        } else if (
+            seg->any_name
+            || (
+                seg->name_len == token->str_len
+                && !memcmp(seg->name, token->string, seg->name_len)
+            )
+        ) {
+            if (seg->last)
+                rules |= BIT(seg->rule);
+            else
+                segments |= BIT(i + 1);
+        }
+    }
+
+    left = frame->preds;
+
+    for (size_t i = 0; left; ++i, left >>= 1) {
+        if (!(left & 1))
+            continue;
+
+        kdl_extract_pred_t *pred = &ex->preds[i];
+        unsigned verdict = pred->fn(token->string, ex->depth, pred->ctx);
+
+        if (verdict & KDL_EXTRACT_MATCH)
+            rules |= BIT(pred->rule);
+
+        if (verdict & KDL_EXTRACT_DESCEND)
+            preds |= BIT(i);
+    }
+
+    ex->node_children = (kdl_extract_frame_t){
+        .segments = closure(ex, segments),
+        .preds = preds
+    };
+    ex->node_rules = rules;
+}
+
+// values are loaded lazily, so matching values are decoded here
+static void decode_value(kdl_token_t *token) {
+    if (!token->raw)
+        return;
+
+    if (token->type == KDL_TOK_STRING)
+        token->str_len = decode_escapes(token->string, token->str_len);
+    else if (!decode_number(token->string, &token->number))
+        KDL_ERROR("encountered an unknown value!\n");
+
+    token->raw = false;
+}
+
+static void extract_token(kdl_extractor_t *ex, kdl_token_t *token) {
+    // annotations are held until the node or value they belong to
+    if (token->type == KDL_TOK_ANNOTATION) {
+        memcpy(ex->annotation, token->string, token->str_len + 1);
+        ex->has_annotation = true;
+
+        return;
+    }
+
+    kdl_extract_event_t event = {
+        .depth = ex->depth,
+        .annotation = ex->has_annotation ? ex->annotation : NULL
+    };
+
+    ex->has_annotation = false;
+
+    if (token->node) {
+        match_node(ex, token);
+        ex->await_prop = false;
+
+        if (ex->node_rules) {
+            event.type = KDL_EXTRACT_NODE;
+            event.rules = ex->node_rules;
+            event.name = token->string;
+
+            ex->callback(&event, ex->ctx);
+        }
+    } else if (token->property) {
+        ex->await_prop = true;
+
+        if (ex->node_rules)
+            memcpy(ex->prop_name, token->string, token->str_len + 1);
+    } else {
+        switch (token->type) {
+        case KDL_TOK_CHILD_BEGIN:
+            if (!ex->node_children.segments && !ex->node_children.preds) {
+                // nothing in here can match
+                kdl_tok_skip_children(&ex->tzr);
+            } else if (ex->depth == KDL_EXTRACT_MAX_DEPTH) {
+                KDL_ERROR(
+                    "extracting nested deeper than KDL_EXTRACT_MAX_DEPTH.\n"
+                );
+            } else {
+                ex->frames[++ex->depth] = ex->node_children;
+            }
+
+            ex->node_children = (kdl_extract_frame_t){0};
+            ex->node_rules = 0;
+
+            break;
+        case KDL_TOK_CHILD_END:
+            if (!ex->depth)
+                KDL_ERROR("unmatched '}' while extracting.\n");
+
+            --ex->depth;
+            ex->node_children = (kdl_extract_frame_t){0};
+            ex->node_rules = 0;
+
+            break;
+        default:;
+            bool is_prop = ex->await_prop;
+
+            ex->await_prop = false;
+
+            if (!ex->node_rules)
+                break;
+
+            decode_value(token);
+
+            event.type = is_prop ? KDL_EXTRACT_PROP : KDL_EXTRACT_ARG;
+            event.rules = ex->node_rules;
+            event.depth = ex->depth;
+            event.name = is_prop ? ex->prop_name : NULL;
+            event.value = token;
+
+            ex->callback(&event, ex->ctx);
+
+            break;
+        }
+    }
+}
+
+bool kdl_extractor_feed(
+    kdl_extractor_t *ex, const char *data, size_t length
+) {
+    if (!kdl_tok_feed(&ex->tzr, data, length))
+        return false;
+
+    while (kdl_tok_next(&ex->tzr, &ex->token))
+        extract_token(ex, &ex->token);
+
+    return true;
+}
+
+bool kdl_extractor_finish(kdl_extractor_t *ex) {
+    if (!kdl_tok_finish(&ex->tzr))
+        return false;
+
+    while (kdl_tok_next(&ex->tzr, &ex->token))
+        extract_token(ex, &ex->token);
+
+    return true;
+}
+
+bool kdl_extractor_read(kdl_extractor_t *ex, kdl_input_t *input) {
+    const char *data;
+    size_t read;
+
+    while ((read = kdl_input_read(input, &data))) {
+        if (!kdl_extractor_feed(ex, data, read))
+            return false;
+    }
+
+    return kdl_extractor_finish(ex);
+}
@@ -1,35 +1,337 @@
+#include <string.h>
+#include <limits.h>
+
 #include <cuddle/meta.h>
 #include <cuddle/htable.h>
 
+#define MIN_TABLE_BLOCKS 64
+
 void kdl_htable_make(
-    kdl_htable_t *table, void *blocks, size_t block_size, size_t num_blocks
+    kdl_htable_t *table, void *blocks, size_t block_size, size_t num_blocks,
+    unsigned *meta
 ) {
-    *table = (kdl_htable_t){
-        .blocks = (char *)blocks,
-        .block_size = block_size,
-        .num_blocks = num_blocks
-    };
+    if (num_blocks > UINT_MAX) {
+        KDL_ERROR(
+            "tried to make a htable with %zu blocks, the most is %u.\n",
+            num_blocks, UINT_MAX
+        );
+    } else if (num_blocks && !meta) {
+        KDL_ERROR("tried to make a htable of fixed blocks without meta.\n");
+    }
+
+    table->allocator = NULL;
+    table->blocks = (char *)blocks;
+    table->ptrs = NULL;
+    table->caps = NULL;
+    table->block_size = block_size;
+    table->num_blocks = num_blocks;
+
+    table->counts = meta;
+    table->reusable = meta + num_blocks;
+    table->sizes = meta + 2 * num_blocks;
+
+    if (num_blocks)
+        memset(table->counts, 0, num_blocks * sizeof(*table->counts));
+
+    table->num_reusable = table->max_used = 0;
+    table->bytes_requested = table->num_allocs = 0;
+}
+
+void kdl_htable_make_alloc(
+    kdl_htable_t *table, const kdl_allocator_t *allocator
+) {
+    table->allocator = allocator;
+    table->blocks = NULL;
+    table->ptrs = NULL;
+    table->caps = NULL;
+    table->block_size = 0;
+    table->num_blocks = 0;
+
+    table->counts = table->reusable = table->sizes = NULL;
+
+    table->num_reusable = table->max_used = 0;
+    table->bytes_requested = table->num_allocs = 0;
+}
+
+// gives an allocator table's block memory, reusing what reset() kept if it fits
+static void alloc_block(kdl_htable_t *table, size_t index, size_t size) {
+    const kdl_allocator_t *allocator = table->allocator;
+    char **ptr = &table->ptrs[index];
+    unsigned *cap = &table->caps[index];
+
+    if (*ptr && *cap >= size)
+        return;
+
+    if (*ptr)
+        allocator->free(*ptr, *cap, allocator->ctx);
+
+    *cap = size ? size : 1;
+    *ptr = allocator->alloc(*cap, allocator->ctx);
+
+    if (!*ptr)
+        KDL_ERROR("out of memory.\n");
+}
+
+// grows one of an allocator table's bookkeeping arrays
+static void *grow_array(
+    kdl_htable_t *table, void *array, size_t elem_size, size_t cap
+) {
+    const kdl_allocator_t *allocator = table->allocator;
+    size_t old_size = table->num_blocks * elem_size;
+    void *grown = array
+        ? allocator->realloc(array, old_size, cap * elem_size, allocator->ctx)
+        : allocator->alloc(cap * elem_size, allocator->ctx);
+
+    if (!grown)
+        KDL_ERROR("out of memory.\n");
+
+    return grown;
+}
+
+static void grow_table(kdl_htable_t *table) {
+    size_t cap = table->num_blocks ? table->num_blocks * 2 : MIN_TABLE_BLOCKS;
+
+    if (cap > UINT_MAX)
+        KDL_ERROR("tried to alloc a new block but none were left.\n");
+
+    table->ptrs = grow_array(table, table->ptrs, sizeof(*table->ptrs), cap);
+    table->caps = grow_array(table, table->caps, sizeof(*table->caps), cap);
+    table->counts =
+        grow_array(table, table->counts, sizeof(*table->counts), cap);
+    table->reusable =
+        grow_array(table, table->reusable, sizeof(*table->reusable), cap);
+    table->sizes = grow_array(table, table->sizes, sizeof(*table->sizes), cap);
+
+    memset(
+        table->ptrs + table->num_blocks, 0,
+        (cap - table->num_blocks) * sizeof(*table->ptrs)
+    );
+    memset(
+        table->counts + table->num_blocks, 0,
+        (cap - table->num_blocks) * sizeof(*table->counts)
+    );
+
+    table->num_blocks = cap;
+}
+
+void kdl_htable_release(kdl_htable_t *table) {
+    const kdl_allocator_t *allocator = table->allocator;
+
+    if (!allocator)
+        return;
+
+    kdl_htable_clear(table);
+
+    if (table->num_blocks) {
+        allocator->free(
+            table->ptrs, table->num_blocks * sizeof(*table->ptrs),
+            allocator->ctx
+        );
+        allocator->free(
+            table->caps, table->num_blocks * sizeof(*table->caps),
+            allocator->ctx
+        );
+        allocator->free(
+            table->counts, table->num_blocks * sizeof(*table->counts),
+            allocator->ctx
+        );
+        allocator->free(
+            table->reusable, table->num_blocks * sizeof(*table->reusable),
+            allocator->ctx
+        );
+        allocator->free(
+            table->sizes, table->num_blocks * sizeof(*table->sizes),
+            allocator->ctx
+        );
+    }
+
+    kdl_htable_make_alloc(table, allocator);
 }
 
 void *kdl_htable_alloc(kdl_htable_t *table, kdl_href_t *ref, size_t size) {
-    // assert that this size is 
-    // TODO remove this with a compilation flag? 
-    if (size > table->block_size) {
+    // assert that this size is
+    // TODO remove this with a compilation flag?
+    if (!table->allocator && size > table->block_size) {
         KDL_ERROR(
             "tried to alloc %zu bytes in a htable with blocks of size %zu.\n",
             size, table->block_size
         );
+    } else if (size > UINT_MAX) {
+        KDL_ERROR("tried to alloc %zu bytes in a htable.\n", size);
     }
 
-    if (table->num_reusable) // reuse a block
+    if (table->num_reusable) { // reuse a block
         ref->index = table->reusable[--table->num_reusable];
-    else if (table->max_used == table->num_blocks)
-        KDL_ERROR("tried to alloc a new block but none were left.\n");
-    else // use a new block
+    } else if (table->max_used == table->num_blocks) {
+        if (!table->allocator)
+            KDL_ERROR("tried to alloc a new block but none were left.\n");
+
+        grow_table(table);
+        ref->index = table->max_used++;
+    } else { // use a new block
         ref->index = table->max_used++;
+    }
+
+    if (table->allocator)
+        alloc_block(table, ref->index, size);
 
     ref->count = ++table->counts[ref->index];
 
-    return table->blocks + ref->index * table->block_size;
+    table->sizes[ref->index] = size;
+    table->bytes_requested += size;
+    ++table->num_allocs;
+
+    return kdl_htable_block(table, ref->index);
+}
+
+void *kdl_htable_realloc(kdl_htable_t *table, kdl_href_t *ref, size_t size) {
+    void *ptr = kdl_htable_get(table, ref);
+
+    if (!ptr)
+        KDL_ERROR("tried to realloc a block that was already freed.\n");
+
+    if (!table->allocator && size > table->block_size) {
+        KDL_ERROR(
+            "tried to realloc %zu bytes in a htable with blocks of size %zu.\n",
+            size, table->block_size
+        );
+    } else if (size > UINT_MAX) {
+        KDL_ERROR("tried to realloc %zu bytes in a htable.\n", size);
+    }
+
+    unsigned *cap = table->caps ? &table->caps[ref->index] : NULL;
+
+    // allocations only ever grow
+    if (table->allocator && size > *cap) {
+        const kdl_allocator_t *allocator = table->allocator;
+
+        ptr = allocator->realloc(ptr, *cap, size, allocator->ctx);
+
+        if (!ptr)
+            KDL_ERROR("out of memory.\n");
+
+        table->ptrs[ref->index] = ptr;
+        *cap = size;
+    }
+
+    table->bytes_requested -= table->sizes[ref->index];
+    table->bytes_requested += size;
+    table->sizes[ref->index] = size;
+
+    return ptr;
+}
+
+void kdl_htable_free(kdl_htable_t *table, kdl_href_t *ref) {
+    void *ptr = kdl_htable_get(table, ref);
+
+    if (!ptr)
+        KDL_ERROR("tried to free a block that was already freed.\n");
+
+    // ref can live in the block itself, like a node's self_ref
+    unsigned index = ref->index, size = table->sizes[index];
+
+    if (table->allocator) {
+        table->allocator->free(ptr, table->caps[index], table->allocator->ctx);
+        table->ptrs[index] = NULL;
+    }
+
+    table->bytes_requested -= size;
+    ++table->counts[index];
+    table->reusable[table->num_reusable++] = index;
 }
 
+void kdl_htable_clear(kdl_htable_t *table) {
+    // reset() keeps the memory of blocks that aren't live
+    if (table->allocator) {
+        for (size_t i = 0; i < table->max_used; ++i) {
+            if (table->ptrs[i]) {
+                table->allocator->free(
+                    table->ptrs[i], table->caps[i], table->allocator->ctx
+                );
+                table->ptrs[i] = NULL;
+            }
+        }
+    }
+
+    if (table->counts)
+        memset(table->counts, 0, table->num_blocks * sizeof(*table->counts));
+
+    table->num_reusable = table->max_used = 0;
+    table->bytes_requested = table->num_allocs = 0;
+}
+
+void kdl_htable_reset(kdl_htable_t *table) {
+    for (size_t i = 0; i < table->max_used; ++i) {
+        if (table->counts[i] & 1)
+            ++table->counts[i];
+
+        // stacked so blocks are handed out in order, like a fresh table
+        table->reusable[i] = table->max_used - 1 - i;
+    }
+
+    table->num_reusable = table->max_used;
+    table->bytes_requested = table->num_allocs = 0;
+}
+
+bool kdl_htable_copy(kdl_htable_t *dst, kdl_htable_t *src) {
+    if (
+        !dst->allocator
+        && (
+            src->allocator
+            || dst->block_size != src->block_size
+            || dst->num_blocks < src->max_used
+        )
+    ) {
+        return false;
+    }
+
+    while (dst->num_blocks < src->max_used)
+        grow_table(dst);
+
+    // only the requested bytes of live blocks, blocks are mostly slack
+    for (size_t i = 0; i < src->max_used; ++i) {
+        if (src->counts[i] & 1) {
+            if (dst->allocator)
+                alloc_block(dst, i, src->sizes[i]);
+
+            memcpy(
+                kdl_htable_block(dst, i), kdl_htable_block(src, i),
+                src->sizes[i]
+            );
+        }
+    }
+
+    memcpy(dst->counts, src->counts, src->max_used * sizeof(*src->counts));
+    memcpy(dst->sizes, src->sizes, src->max_used * sizeof(*src->sizes));
+    memcpy(
+        dst->reusable, src->reusable,
+        src->num_reusable * sizeof(*src->reusable)
+    );
+
+    dst->num_reusable = src->num_reusable;
+    dst->max_used = src->max_used;
+    dst->bytes_requested = src->bytes_requested;
+    dst->num_allocs = src->num_allocs;
+
+    return true;
+}
+
+void kdl_htable_stats(kdl_htable_t *table, kdl_htable_stats_t *stats) {
+    size_t in_use = table->max_used - table->num_reusable;
+    size_t reserved = table->allocator
+        ? table->bytes_requested
+        : in_use * table->block_size;
+
+    *stats = (kdl_htable_stats_t){
+        .num_blocks = table->num_blocks,
+        .block_size = table->block_size,
+        .blocks_in_use = in_use,
+        .max_used = table->max_used,
+        .num_reusable = table->num_reusable,
+        .num_allocs = table->num_allocs,
+
+        .bytes_requested = table->bytes_requested,
+        .bytes_reserved = reserved,
+        .bytes_wasted = reserved - table->bytes_requested
+    };
+}
@@ -0,0 +1,341 @@
+// syscall(), mmap() and posix_fadvise() aren't c99
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/input.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+void kdl_input_make(kdl_input_t *input, kdl_read_fn read, void *ctx) {
+    *input = (kdl_input_t){
+        .read = read,
+        .ctx = ctx,
+        .fd = -1
+    };
+}
+
+static size_t read_memory(const char **data, void *ctx) {
+    kdl_input_t *input = ctx;
+    size_t length = input->length;
+
+    *data = input->data;
+    input->length = 0;
+
+    return length;
+}
+
+void kdl_input_memory(kdl_input_t *input, const char *data, size_t length) {
+    kdl_input_make(input, read_memory, input);
+
+    input->data = data;
+    input->length = length;
+}
+
+static size_t read_fd(const char **data, void *ctx) {
+    kdl_input_t *input = ctx;
+    ssize_t got;
+
+    do {
+        got = read(input->fd, input->buf, input->buf_size);
+    } while (got < 0 && errno == EINTR);
+
+    if (got < 0)
+        KDL_ERROR("couldn't read input: %s\n", strerror(errno));
+
+    *data = input->buf;
+
+    return got;
+}
+
+void kdl_input_fd(kdl_input_t *input, int fd, char *buf, size_t buf_size) {
+    kdl_input_make(input, read_fd, input);
+
+    input->fd = fd;
+    input->buf = buf;
+    input->buf_size = buf_size;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    // a hint, so failing (like on a pipe) doesn't matter
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+static size_t read_file(const char **data, void *ctx) {
+    kdl_input_t *input = ctx;
+    size_t got = fread(input->buf, 1, input->buf_size, input->fp);
+
+    if (!got && ferror(input->fp))
+        KDL_ERROR("couldn't read input.\n");
+
+    *data = input->buf;
+
+    return got;
+}
+
+void kdl_input_file(kdl_input_t *input, FILE *fp, char *buf, size_t buf_size) {
+    kdl_input_make(input, read_file, input);
+
+    input->fp = fp;
+    input->buf = buf;
+    input->buf_size = buf_size;
+}
+
+#ifdef __linux__
+
+static int uring_enter(
+    kdl_uring_t *ring, unsigned to_submit, unsigned min_complete
+) {
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    int res;
+
+    do {
+        res = syscall(
+            __NR_io_uring_enter, ring->ring_fd, to_submit, min_complete, flags,
+            NULL, 0
+        );
+    } while (res < 0 && errno == EINTR);
+
+    if (res < 0)
+        KDL_ERROR("io_uring_enter failed: %s\n", strerror(errno));
+
+    return res;
+}
+
+static bool uring_setup(kdl_uring_t *ring) {
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    ring->ring_fd = syscall(__NR_io_uring_setup, KDL_URING_DEPTH, &params);
+
+    if (ring->ring_fd < 0)
+        return false;
+
+    ring->sq_size = params.sq_off.array
+        + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes
+        + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ptr = mmap(
+        NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING
+    );
+    ring->cq_ptr = mmap(
+        NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING
+    );
+    ring->sqes = mmap(
+        NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES
+    );
+
+    if (
+        ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED
+        || ring->sqes == MAP_FAILED
+    ) {
+        KDL_ERROR("couldn't map io_uring: %s\n", strerror(errno));
+    }
+
+    char *sq = ring->sq_ptr, *cq = ring->cq_ptr;
+
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+
+    return true;
+}
+
+// starts reads into every piece that isn't busy, in file order
+static void uring_submit(kdl_input_t *input) {
+    kdl_uring_t *ring = &input->uring;
+    unsigned tail = *ring->sq_tail, submitted = 0;
+
+    for (unsigned i = 0; i < KDL_URING_DEPTH && !ring->eof; ++i) {
+        if (ring->in_flight[i] || (int)i == ring->handed_out)
+            continue;
+
+        struct io_uring_sqe *sqe =
+            (struct io_uring_sqe *)ring->sqes + (tail & *ring->sq_mask);
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = input->fd;
+        sqe->addr = (unsigned long)(input->buf + i * ring->piece_size);
+        sqe->len = ring->piece_size;
+        sqe->off = ring->next_offset;
+        sqe->user_data = i;
+
+        ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+        ++tail;
+
+        ring->offsets[i] = ring->next_offset;
+        ring->next_offset += ring->piece_size;
+        ring->in_flight[i] = true;
+        ring->done[i] = false;
+        ring->queue[
+            (ring->queue_start + ring->queue_len++) % KDL_URING_DEPTH
+        ] = i;
+
+        ++submitted;
+    }
+
+    if (submitted) {
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+        uring_enter(ring, submitted, 0);
+    }
+}
+
+// waits for a piece's read to complete
+static void uring_wait(kdl_uring_t *ring, unsigned piece) {
+    while (!ring->done[piece]) {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            uring_enter(ring, 0, 1);
+
+            continue;
+        }
+
+        for (; head != tail; ++head) {
+            struct io_uring_cqe *cqe =
+                (struct io_uring_cqe *)ring->cqes + (head & *ring->cq_mask);
+
+            ring->results[cqe->user_data] = cqe->res;
+            ring->done[cqe->user_data] = true;
+        }
+
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    ring->in_flight[piece] = false;
+}
+
+// throws out the reads still queued, their offsets are no good anymore
+static void uring_drain(kdl_uring_t *ring) {
+    for (; ring->queue_len; --ring->queue_len) {
+        uring_wait(ring, ring->queue[ring->queue_start]);
+        ring->queue_start = (ring->queue_start + 1) % KDL_URING_DEPTH;
+    }
+}
+
+static size_t read_uring(const char **data, void *ctx) {
+    kdl_input_t *input = ctx;
+    kdl_uring_t *ring = &input->uring;
+
+    // the last chunk has been used up, so its piece can be read into again
+    ring->handed_out = -1;
+    uring_submit(input);
+
+    if (!ring->queue_len)
+        return 0;
+
+    unsigned piece = ring->queue[ring->queue_start];
+
+    ring->queue_start = (ring->queue_start + 1) % KDL_URING_DEPTH;
+    --ring->queue_len;
+
+    uring_wait(ring, piece);
+
+    int res = ring->results[piece];
+
+    if (res < 0)
+        KDL_ERROR("couldn't read input: %s\n", strerror(-res));
+
+    if ((size_t)res < ring->piece_size) {
+        // the end of the file, or a short read which the rest has to follow
+        ring->eof = !res;
+        ring->next_offset = ring->offsets[piece] + res;
+        uring_drain(ring);
+    }
+
+    ring->handed_out = piece;
+    *data = input->buf + piece * ring->piece_size;
+
+    return res;
+}
+
+#endif
+
+void kdl_input_uring(kdl_input_t *input, int fd, char *buf, size_t buf_size) {
+    kdl_input_fd(input, fd, buf, buf_size);
+
+#ifdef __linux__
+    kdl_uring_t *ring = &input->uring;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+
+    if (buf_size < KDL_URING_DEPTH || offset < 0 || !uring_setup(ring))
+        return;
+
+    ring->piece_size = buf_size / KDL_URING_DEPTH;
+    ring->next_offset = offset;
+    ring->handed_out = -1;
+
+    input->read = read_uring;
+    input->uring_active = true;
+#endif
+}
+
+void kdl_input_close(kdl_input_t *input) {
+#ifdef __linux__
+    kdl_uring_t *ring = &input->uring;
+
+    if (!input->uring_active)
+        return;
+
+    uring_drain(ring);
+
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->cq_ptr, ring->cq_size);
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->ring_fd);
+
+    input->uring_active = false;
+#else
+    (void)input;
+#endif
+}
+
+const char *kdl_map_file(const char *filename, size_t *length) {
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st))
+        KDL_ERROR("couldn't load file: \"%s\"\n", filename);
+
+    *length = st.st_size;
+
+    if (!*length) {
+        close(fd);
+
+        return NULL;
+    }
+
+    void *data = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (data == MAP_FAILED)
+        KDL_ERROR("couldn't map file: \"%s\"\n", filename);
+
+    return data;
+}
+
+void kdl_unmap_file(const char *data, size_t length) {
+    if (data)
+        munmap((void *)data, length);
+}
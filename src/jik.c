@@ -0,0 +1,844 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/jik.h>
+#include "token_parse.h"
+
+static void write_str(kdl_output_t *out, const char *str) {
+    kdl_output_write(out, str, strlen(str));
+}
+
+/*
+ * json and kdl strings escape the same things, except for how they write the
+ * control chars that don't have a short escape
+ */
+static void write_string(
+    kdl_output_t *out, const char *str, size_t len, bool json
+) {
+    const char *end = str + len;
+
+    kdl_output_char(out, '"');
+
+    while (str < end) {
+        // runs of plain chars are written at once
+        const char *run = str;
+
+        while (
+            str < end && (unsigned char)*str >= ' ' && *str != '"'
+            && *str != '\\'
+        ) {
+            ++str;
+        }
+
+        kdl_output_write(out, run, str - run);
+
+        if (str == end)
+            break;
+
+        char escape[16];
+
+        switch (*str) {
+#define ESC_CASE(ch, esc) case ch: strcpy(escape, esc); break
+        ESC_CASE('\n', "\\n");
+        ESC_CASE('\r', "\\r");
+        ESC_CASE('\t', "\\t");
+        ESC_CASE('\b', "\\b");
+        ESC_CASE('\f', "\\f");
+        ESC_CASE('\\', "\\\\");
+        ESC_CASE('"', "\\\"");
+#undef ESC_CASE
+        default:
+            sprintf(escape, json ? "\\u%04x" : "\\u{%x}", (unsigned)*str);
+
+            break;
+        }
+
+        write_str(out, escape);
+        ++str;
+    }
+
+    kdl_output_char(out, '"');
+}
+
+static void write_name(kdl_output_t *out, const char *name, size_t len) {
+    // names with nulls in them have to be quoted to keep all of them
+    if (strlen(name) == len && kdl_is_identifier(name))
+        kdl_output_write(out, name, len);
+    else
+        write_string(out, name, len, false);
+}
+
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool is_json_number(const char *str) {
+    str += *str == '-';
+
+    if (*str == '0')
+        ++str;
+    else if (*str >= '1' && *str <= '9')
+        while (*str >= '0' && *str <= '9')
+            ++str;
+    else
+        return false;
+
+    if (*str == '.') {
+        if (!(*++str >= '0' && *str <= '9'))
+            return false;
+
+        while (*str >= '0' && *str <= '9')
+            ++str;
+    }
+
+    if (*str == 'e' || *str == 'E') {
+        ++str;
+        str += *str == '+' || *str == '-';
+
+        if (!(*str >= '0' && *str <= '9'))
+            return false;
+
+        while (*str >= '0' && *str <= '9')
+            ++str;
+    }
+
+    return !*str;
+}
+
+static inline bool is_dash(const char *name, size_t len) {
+    return len == 1 && name[0] == '-';
+}
+
+/*
+ * jik to json
+ */
+
+void kdl_jik_decoder_make(
+    kdl_jik_decoder_t *dec, kdl_output_t *out, char *tzr_buf,
+    size_t tzr_buf_size, char *tok_buf, char *pending_buf
+) {
+    *dec = (kdl_jik_decoder_t){
+        .out = out
+    };
+
+    kdl_tokenizer_make(&dec->tzr, tzr_buf, tzr_buf_size);
+    kdl_token_make(&dec->token, tok_buf);
+    kdl_token_make(&dec->pending, pending_buf);
+}
+
+static void write_json_value(kdl_output_t *out, kdl_token_t *token) {
+    switch (token->type) {
+    case KDL_TOK_STRING:
+        write_string(out, token->string, token->str_len, true);
+
+        break;
+    case KDL_TOK_NUMBER:
+        // numbers are copied as they were written whenever json allows it
+        if (is_json_number(token->string)) {
+            kdl_output_write(out, token->string, token->str_len);
+        } else if (isfinite(token->number)) {
+            char buf[32];
+
+            // the shortest text that reads back as the same double
+            for (int precision = 15; precision <= 17; ++precision) {
+                snprintf(buf, sizeof(buf), "%.*g", precision, token->number);
+
+                if (strtod(buf, NULL) == token->number)
+                    break;
+            }
+
+            write_str(out, buf);
+        } else {
+            KDL_ERROR("%s can't be written as json.\n", token->string);
+        }
+
+        break;
+    case KDL_TOK_BOOL:
+        write_str(out, token->boolean ? "true" : "false");
+
+        break;
+    case KDL_TOK_NULL:
+        write_str(out, "null");
+
+        break;
+    default:
+        KDL_ERROR(
+            "expected a value, found %s.\n", KDL_TOKEN_TYPES[token->type]
+        );
+    }
+}
+
+static kdl_jik_container_e parse_annotation(kdl_token_t *token) {
+    if (!strcmp(token->string, "array"))
+        return KDL_JIK_ARRAY;
+    else if (!strcmp(token->string, "object"))
+        return KDL_JIK_OBJECT;
+
+    return KDL_JIK_UNDECIDED;
+}
+
+// writes a comma unless this is the first thing in a json container
+static void begin_item(kdl_jik_decoder_t *dec) {
+    if (!dec->first)
+        kdl_output_char(dec->out, ',');
+
+    dec->first = false;
+}
+
+// makes the current node an array, writing its first arg if it's been held
+static void open_array(kdl_jik_decoder_t *dec) {
+    kdl_output_char(dec->out, '[');
+    dec->first = true;
+
+    if (dec->node == KDL_JIK_NODE_LITERAL) {
+        write_json_value(dec->out, &dec->pending);
+        dec->first = false;
+    }
+
+    dec->node = KDL_JIK_NODE_ARRAY;
+}
+
+static void end_node(kdl_jik_decoder_t *dec) {
+    kdl_output_t *out = dec->out;
+
+    switch (dec->node) {
+    case KDL_JIK_NODE_NONE:
+        return;
+    case KDL_JIK_NODE_EMPTY:
+        if (dec->annotation == KDL_JIK_ARRAY) {
+            write_str(out, "[]");
+        } else if (dec->annotation == KDL_JIK_OBJECT) {
+            write_str(out, "{}");
+        } else {
+            KDL_ERROR(
+                "a jik node with nothing in it needs an (array) or (object) "
+                "annotation.\n"
+            );
+        }
+
+        break;
+    case KDL_JIK_NODE_LITERAL:
+        if (dec->annotation == KDL_JIK_ARRAY) {
+            open_array(dec);
+            kdl_output_char(out, ']');
+        } else {
+            write_json_value(out, &dec->pending);
+        }
+
+        break;
+    case KDL_JIK_NODE_ARRAY:
+        kdl_output_char(out, ']');
+
+        break;
+    case KDL_JIK_NODE_OBJECT:
+        kdl_output_char(out, '}');
+
+        break;
+    }
+
+    dec->node = KDL_JIK_NODE_NONE;
+    dec->first = false;
+}
+
+static void begin_node(kdl_jik_decoder_t *dec, kdl_token_t *token) {
+    bool dash = is_dash(token->string, token->str_len);
+
+    end_node(dec);
+
+    if (!dec->depth) {
+        if (dec->has_root)
+            KDL_ERROR("jik documents have exactly one top level node.\n");
+        else if (!dash)
+            KDL_ERROR("the top level jik node must be named '-'.\n");
+
+        dec->has_root = true;
+    } else {
+        kdl_jik_container_e *container = &dec->containers[dec->depth - 1];
+
+        // children blocks without an annotation go by their first child
+        if (*container == KDL_JIK_UNDECIDED) {
+            *container = dash ? KDL_JIK_ARRAY : KDL_JIK_OBJECT;
+            kdl_output_char(dec->out, dash ? '[' : '{');
+            dec->first = true;
+        }
+
+        begin_item(dec);
+
+        if (*container == KDL_JIK_OBJECT) {
+            write_string(dec->out, token->string, token->str_len, true);
+            kdl_output_char(dec->out, ':');
+        } else if (!dash) {
+            KDL_ERROR("jik array items must be named '-'.\n");
+        }
+    }
+
+    dec->node = KDL_JIK_NODE_EMPTY;
+    dec->annotation = dec->next_annotation;
+}
+
+static void begin_children(kdl_jik_decoder_t *dec) {
+    kdl_jik_container_e container;
+
+    if (dec->depth == KDL_JIK_MAX_DEPTH)
+        KDL_ERROR("jik nested deeper than KDL_JIK_MAX_DEPTH.\n");
+
+    switch (dec->node) {
+    case KDL_JIK_NODE_NONE:
+        KDL_ERROR("children without a node to belong to.\n");
+    case KDL_JIK_NODE_EMPTY:
+        container = dec->annotation;
+
+        if (container == KDL_JIK_ARRAY) {
+            open_array(dec);
+        } else if (container == KDL_JIK_OBJECT) {
+            kdl_output_char(dec->out, '{');
+            dec->first = true;
+        }
+
+        break;
+    case KDL_JIK_NODE_LITERAL:
+        open_array(dec);
+        /* fallthru */
+    case KDL_JIK_NODE_ARRAY:
+        container = KDL_JIK_ARRAY;
+
+        break;
+    default:
+        container = KDL_JIK_OBJECT;
+
+        break;
+    }
+
+    dec->containers[dec->depth++] = container;
+    dec->node = KDL_JIK_NODE_NONE;
+}
+
+static void end_children(kdl_jik_decoder_t *dec) {
+    if (!dec->depth)
+        KDL_ERROR("unmatched '}'.\n");
+
+    end_node(dec);
+
+    switch (dec->containers[--dec->depth]) {
+    case KDL_JIK_UNDECIDED:
+        KDL_ERROR(
+            "a jik node with nothing in it needs an (array) or (object) "
+            "annotation.\n"
+        );
+    case KDL_JIK_ARRAY:
+        kdl_output_char(dec->out, ']');
+
+        break;
+    case KDL_JIK_OBJECT:
+        kdl_output_char(dec->out, '}');
+
+        break;
+    }
+
+    dec->first = false;
+}
+
+static void decode_token(kdl_jik_decoder_t *dec, kdl_token_t *token) {
+    kdl_output_t *out = dec->out;
+
+    if (token->type == KDL_TOK_ANNOTATION) {
+        dec->next_annotation = parse_annotation(token);
+
+        return;
+    }
+
+    if (token->node) {
+        begin_node(dec, token);
+    } else if (token->property) {
+        if (dec->node == KDL_JIK_NODE_EMPTY) {
+            kdl_output_char(out, '{');
+            dec->node = KDL_JIK_NODE_OBJECT;
+            dec->first = true;
+        } else if (dec->node != KDL_JIK_NODE_OBJECT) {
+            KDL_ERROR("jik nodes can't have both args and props.\n");
+        }
+
+        begin_item(dec);
+        write_string(out, token->string, token->str_len, true);
+        kdl_output_char(out, ':');
+
+        dec->await_prop = true;
+    } else if (token->type == KDL_TOK_CHILD_BEGIN) {
+        begin_children(dec);
+    } else if (token->type == KDL_TOK_CHILD_END) {
+        end_children(dec);
+    } else if (dec->await_prop) {
+        write_json_value(out, token);
+        dec->await_prop = false;
+    } else {
+        switch (dec->node) {
+        case KDL_JIK_NODE_EMPTY:;
+            // held until the node ends or something else shows up
+            char *buf = dec->pending.string;
+
+            dec->pending = *token;
+            dec->pending.string = buf;
+            memcpy(buf, token->string, token->str_len + 1);
+
+            dec->node = KDL_JIK_NODE_LITERAL;
+
+            break;
+        case KDL_JIK_NODE_LITERAL:
+            open_array(dec);
+            /* fallthru */
+        case KDL_JIK_NODE_ARRAY:
+            begin_item(dec);
+            write_json_value(out, token);
+
+            break;
+        default:
+            KDL_ERROR("jik nodes can't have both args and props.\n");
+        }
+    }
+
+    // annotations only count for the node right after them
+    dec->next_annotation = KDL_JIK_UNDECIDED;
+}
+
+bool kdl_jik_decoder_feed(kdl_jik_decoder_t *dec, char *data, size_t length) {
+    if (!kdl_tok_feed(&dec->tzr, data, length))
+        return false;
+
+    while (kdl_tok_next(&dec->tzr, &dec->token))
+        decode_token(dec, &dec->token);
+
+    return true;
+}
+
+bool kdl_jik_decoder_finish(kdl_jik_decoder_t *dec) {
+    if (!kdl_tok_finish(&dec->tzr))
+        return false;
+
+    while (kdl_tok_next(&dec->tzr, &dec->token))
+        decode_token(dec, &dec->token);
+
+    end_node(dec);
+
+    if (dec->depth)
+        KDL_ERROR("jik ended with an unclosed '{'.\n");
+    else if (!dec->has_root)
+        KDL_ERROR("jik documents have exactly one top level node.\n");
+
+    kdl_output_char(dec->out, '\n');
+    kdl_output_flush(dec->out);
+
+    return true;
+}
+
+/*
+ * json to jik
+ */
+
+void kdl_jik_encoder_make(
+    kdl_jik_encoder_t *enc, kdl_output_t *out, char *buf, size_t buf_size,
+    char *name_buf
+) {
+    *enc = (kdl_jik_encoder_t){
+        .out = out,
+        .buf = buf,
+        .buf_size = buf_size,
+        .name = name_buf
+    };
+
+    // the top level value is a node named '-'
+    enc->name[0] = '-';
+    enc->name_len = 1;
+}
+
+static void append(kdl_jik_encoder_t *enc, const char *data, size_t len) {
+    if (enc->buf_len + len >= enc->buf_size) {
+        KDL_ERROR(
+            "json token is longer than the supplied buffer. please supply a "
+            "larger buffer.\n"
+        );
+    }
+
+    memcpy(enc->buf + enc->buf_len, data, len);
+    enc->buf_len += len;
+}
+
+static void append_char(kdl_jik_encoder_t *enc, kdl_u8ch_t ch) {
+    char mbs[4];
+    size_t len;
+
+    kdl_utf8_to_mbs(ch, mbs, &len);
+    append(enc, mbs, len);
+}
+
+// a high surrogate that wasn't followed by a low one is replaced
+static void end_surrogate(kdl_jik_encoder_t *enc) {
+    if (enc->high_surrogate) {
+        enc->high_surrogate = 0;
+        append_char(enc, 0xFFFD);
+    }
+}
+
+static void append_code_unit(kdl_jik_encoder_t *enc, unsigned unit) {
+    if (unit >= 0xD800 && unit < 0xDC00) {
+        end_surrogate(enc);
+        enc->high_surrogate = unit;
+    } else if (unit >= 0xDC00 && unit < 0xE000) {
+        if (enc->high_surrogate) {
+            append_char(
+                enc,
+                0x10000 + ((enc->high_surrogate - 0xD800) << 10)
+                + (unit - 0xDC00)
+            );
+            enc->high_surrogate = 0;
+        } else {
+            append_char(enc, 0xFFFD);
+        }
+    } else {
+        end_surrogate(enc);
+        append_char(enc, unit);
+    }
+}
+
+static void write_indent(kdl_jik_encoder_t *enc, size_t level) {
+    for (size_t i = 0; i < level; ++i)
+        write_str(enc->out, "    ");
+}
+
+static void set_name(kdl_jik_encoder_t *enc, const char *name, size_t len) {
+    memcpy(enc->name, name, len);
+    enc->name[len] = '\0';
+    enc->name_len = len;
+}
+
+/*
+ * writes the line of a container that was just opened, now that it's known to
+ * have something in it
+ */
+static void write_opening(kdl_jik_encoder_t *enc, bool dash_key) {
+    kdl_output_t *out = enc->out;
+
+    write_indent(enc, enc->depth - 1);
+
+    // an object that starts with a '-' member would read as an array
+    if (dash_key)
+        write_str(out, "(object)");
+
+    write_name(out, enc->name, enc->name_len);
+    write_str(out, " {\n");
+
+    enc->opening = KDL_JIK_UNDECIDED;
+}
+
+static void after_value(kdl_jik_encoder_t *enc) {
+    enc->expect = enc->depth
+        ? KDL_JIK_EXPECT_COMMA_OR_END
+        : KDL_JIK_EXPECT_NOTHING;
+}
+
+static void close_container(kdl_jik_encoder_t *enc) {
+    kdl_output_t *out = enc->out;
+    kdl_jik_container_e container = enc->containers[--enc->depth];
+
+    write_indent(enc, enc->depth);
+
+    if (enc->opening) {
+        // empty containers are annotated so they don't read as empty nodes
+        write_str(out, container == KDL_JIK_ARRAY ? "(array)" : "(object)");
+        write_name(out, enc->name, enc->name_len);
+        kdl_output_char(out, '\n');
+
+        enc->opening = KDL_JIK_UNDECIDED;
+    } else {
+        write_str(out, "}\n");
+    }
+
+    after_value(enc);
+}
+
+// token is one of []{}:, or a letter for the start of a string, number or word
+static void encode_value(kdl_jik_encoder_t *enc, char token) {
+    kdl_output_t *out = enc->out;
+
+    if (enc->opening) {
+        write_opening(enc, false);
+        set_name(enc, "-", 1);
+    }
+
+    switch (token) {
+    case '[':
+    case '{':
+        if (enc->depth == KDL_JIK_MAX_DEPTH)
+            KDL_ERROR("json nested deeper than KDL_JIK_MAX_DEPTH.\n");
+
+        enc->opening = token == '[' ? KDL_JIK_ARRAY : KDL_JIK_OBJECT;
+        enc->containers[enc->depth++] = enc->opening;
+        enc->expect = token == '['
+            ? KDL_JIK_EXPECT_VALUE_OR_END
+            : KDL_JIK_EXPECT_KEY_OR_END;
+
+        return;
+    case 's':
+    case 'n':
+    case 'w':
+        write_indent(enc, enc->depth);
+        write_name(out, enc->name, enc->name_len);
+        kdl_output_char(out, ' ');
+
+        if (token == 's')
+            write_string(out, enc->buf, enc->buf_len, false);
+        else
+            kdl_output_write(out, enc->buf, enc->buf_len);
+
+        kdl_output_char(out, '\n');
+
+        after_value(enc);
+
+        return;
+    default:
+        KDL_ERROR("expected a json value, found '%c'.\n", token);
+    }
+}
+
+static void encode_token(kdl_jik_encoder_t *enc, char token) {
+    switch (enc->expect) {
+    case KDL_JIK_EXPECT_VALUE_OR_END:
+        if (token == ']') {
+            close_container(enc);
+
+            return;
+        }
+        /* fallthru */
+    case KDL_JIK_EXPECT_VALUE:
+        encode_value(enc, token);
+
+        return;
+    case KDL_JIK_EXPECT_KEY_OR_END:
+        if (token == '}') {
+            close_container(enc);
+
+            return;
+        }
+        /* fallthru */
+    case KDL_JIK_EXPECT_KEY:
+        if (token != 's')
+            KDL_ERROR("expected a json object key.\n");
+
+        enc->buf[enc->buf_len] = '\0';
+
+        if (enc->opening)
+            write_opening(enc, is_dash(enc->buf, enc->buf_len));
+
+        set_name(enc, enc->buf, enc->buf_len);
+        enc->expect = KDL_JIK_EXPECT_COLON;
+
+        return;
+    case KDL_JIK_EXPECT_COLON:
+        if (token != ':')
+            KDL_ERROR("expected ':' after a json object key.\n");
+
+        enc->expect = KDL_JIK_EXPECT_VALUE;
+
+        return;
+    case KDL_JIK_EXPECT_COMMA_OR_END: {
+        kdl_jik_container_e container = enc->containers[enc->depth - 1];
+
+        if (token == ',') {
+            if (container == KDL_JIK_ARRAY) {
+                set_name(enc, "-", 1);
+                enc->expect = KDL_JIK_EXPECT_VALUE;
+            } else {
+                enc->expect = KDL_JIK_EXPECT_KEY;
+            }
+        } else if (token == (container == KDL_JIK_ARRAY ? ']' : '}')) {
+            close_container(enc);
+        } else {
+            KDL_ERROR("expected ',' or the end of a json container.\n");
+        }
+
+        return;
+    }
+    case KDL_JIK_EXPECT_NOTHING:
+        KDL_ERROR("found more json after the top level value.\n");
+    }
+}
+
+// ends a number or word, which only end once something else shows up
+static void end_bare_token(kdl_jik_encoder_t *enc) {
+    enc->buf[enc->buf_len] = '\0';
+
+    if (enc->lex == KDL_JIK_LEX_NUMBER) {
+        if (!is_json_number(enc->buf))
+            KDL_ERROR("invalid json number: %s\n", enc->buf);
+
+        encode_token(enc, 'n');
+    } else {
+        if (
+            strcmp(enc->buf, "true") && strcmp(enc->buf, "false")
+            && strcmp(enc->buf, "null")
+        ) {
+            KDL_ERROR("invalid json: %s\n", enc->buf);
+        }
+
+        encode_token(enc, 'w');
+    }
+
+    enc->lex = KDL_JIK_LEX_NONE;
+}
+
+// chars that can be in numbers and words
+static inline bool is_bare_char(char ch) {
+    return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || ch == '-'
+        || ch == '+' || ch == '.' || ch == 'E';
+}
+
+void kdl_jik_encoder_feed(
+    kdl_jik_encoder_t *enc, const char *data, size_t length
+) {
+    const char *trav = data, *end = data + length;
+
+    while (trav < end) {
+        char ch = *trav;
+
+        switch (enc->lex) {
+        case KDL_JIK_LEX_NONE:
+            switch (ch) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                break;
+            case '[':
+            case ']':
+            case '{':
+            case '}':
+            case ':':
+            case ',':
+                encode_token(enc, ch);
+
+                break;
+            case '"':
+                enc->lex = KDL_JIK_LEX_STRING;
+                enc->buf_len = 0;
+
+                break;
+            default:
+                // numbers and words are read until something else shows up
+                if (ch == '-' || (ch >= '0' && ch <= '9'))
+                    enc->lex = KDL_JIK_LEX_NUMBER;
+                else if (ch >= 'a' && ch <= 'z')
+                    enc->lex = KDL_JIK_LEX_WORD;
+                else
+                    KDL_ERROR("unexpected char in json: '%c'\n", ch);
+
+                enc->buf_len = 0;
+
+                continue;
+            }
+
+            break;
+        case KDL_JIK_LEX_STRING: {
+            // runs of plain chars are copied at once
+            const char *run = trav;
+
+            while (
+                trav < end && (unsigned char)*trav >= ' ' && *trav != '"'
+                && *trav != '\\'
+            ) {
+                ++trav;
+            }
+
+            if (trav > run) {
+                end_surrogate(enc);
+                append(enc, run, trav - run);
+            }
+
+            if (trav == end)
+                continue;
+
+            if (*trav == '"') {
+                end_surrogate(enc);
+                enc->lex = KDL_JIK_LEX_NONE;
+                encode_token(enc, 's');
+            } else if (*trav == '\\') {
+                enc->lex = KDL_JIK_LEX_ESCAPE;
+            } else {
+                KDL_ERROR("json strings can't contain control chars.\n");
+            }
+
+            break;
+        }
+        case KDL_JIK_LEX_ESCAPE:
+            enc->lex = KDL_JIK_LEX_STRING;
+
+            if (ch == 'u') {
+                enc->lex = KDL_JIK_LEX_UNICODE;
+                enc->escape_digits = 0;
+                enc->code_unit = 0;
+
+                break;
+            }
+
+            end_surrogate(enc);
+
+            switch (ch) {
+#define ESC_CASE(ch, esc) case ch: append(enc, esc, 1); break
+            ESC_CASE('n', "\n");
+            ESC_CASE('r', "\r");
+            ESC_CASE('t', "\t");
+            ESC_CASE('b', "\b");
+            ESC_CASE('f', "\f");
+            ESC_CASE('/', "/");
+            ESC_CASE('\\', "\\");
+            ESC_CASE('"', "\"");
+#undef ESC_CASE
+            default:
+                KDL_ERROR("invalid json escape: '\\%c'\n", ch);
+            }
+
+            break;
+        case KDL_JIK_LEX_UNICODE: {
+            int digit = hex_digit(ch);
+
+            if (digit < 0)
+                KDL_ERROR("invalid json unicode escape.\n");
+
+            enc->code_unit = enc->code_unit << 4 | digit;
+
+            if (++enc->escape_digits == 4) {
+                append_code_unit(enc, enc->code_unit);
+                enc->lex = KDL_JIK_LEX_STRING;
+            }
+
+            break;
+        }
+        case KDL_JIK_LEX_NUMBER:
+        case KDL_JIK_LEX_WORD: {
+            const char *run = trav;
+
+            while (trav < end && is_bare_char(*trav))
+                ++trav;
+
+            append(enc, run, trav - run);
+
+            // the char that ended the token still needs to be read
+            if (trav < end)
+                end_bare_token(enc);
+
+            continue;
+        }
+        }
+
+        ++trav;
+    }
+}
+
+void kdl_jik_encoder_finish(kdl_jik_encoder_t *enc) {
+    if (enc->lex == KDL_JIK_LEX_NUMBER || enc->lex == KDL_JIK_LEX_WORD)
+        end_bare_token(enc);
+    else if (enc->lex != KDL_JIK_LEX_NONE)
+        KDL_ERROR("json ended in the middle of a string.\n");
+
+    if (enc->expect != KDL_JIK_EXPECT_NOTHING)
+        KDL_ERROR("json ended before its top level value did.\n");
+
+    kdl_output_flush(enc->out);
+}
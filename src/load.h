@@ -0,0 +1,45 @@
+#ifndef KDL_LOAD_H
+#define KDL_LOAD_H
+
+/*
+ * building a document out of tokens, shared by the loader in dom.c and the
+ * pipelined loader in pipeline.c
+ */
+typedef struct kdl_loader {
+    // nodes know their parents, so nesting needs no stack
+    kdl_node_t *parent, *cur_node;
+
+    // an annotation waits for the node or value after it
+    char *annotation;
+    kdl_href_t annotation_ref;
+
+    bool await_prop;
+
+    // how many children blocks the next token is in, checked against limits
+    size_t depth;
+
+    /*
+     * on-demand loads leave children blocks for later, using the tokenizer to
+     * skip them. base is where the tokenizer's stream starts in the source.
+     */
+    kdl_tokenizer_t *defer;
+    size_t base;
+    kdl_node_t *deferred; // while its block is being skipped
+
+    // where an annotation or property name before the next value started
+    size_t span_start;
+    bool span_pending;
+} kdl_loader_t;
+
+void loader_make(kdl_loader_t *);
+/*
+ * adds the next token of a stream to the document. span is where the token is
+ * in the stream when spans are being recorded, limits checked or values
+ * decoded, and NULL otherwise. returns false if the token hits one of the
+ * document's limits or is a value a decoder rejects.
+ */
+bool load_token(
+    kdl_document_t *, kdl_loader_t *, kdl_token_t *, const kdl_span_t *span
+);
+
+#endif
@@ -0,0 +1,238 @@
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/cuddle.h>
+#include "load.h"
+
+#define RING_SLOTS 8
+#define BATCH_TOKENS 256
+// split between the reads io_uring keeps in flight
+#define READ_SIZE (256 * 1024)
+#define TZR_SIZE 4096
+#define CACHE_LINE 64
+
+// spins on the other thread before yielding to it
+#define MAX_SPINS 256
+
+typedef struct slot {
+    kdl_token_batch_t batch;
+    kdl_token_t tokens[BATCH_TOKENS];
+    kdl_span_t spans[BATCH_TOKENS];
+    char bytes[4 * TZR_SIZE];
+} slot_t;
+
+/*
+ * a lock-free single producer, single consumer ring of token batches. head
+ * counts the batches the tokenizer has published and is only written by it,
+ * tail counts the batches the builder is done with and is only written by it.
+ * they sit on their own cache lines so the threads don't fight over one. an
+ * empty batch ends the stream.
+ */
+typedef struct pipeline {
+    size_t head;
+    char pad_head[CACHE_LINE - sizeof(size_t)];
+    size_t tail;
+    char pad_tail[CACHE_LINE - sizeof(size_t)];
+
+    slot_t slots[RING_SLOTS];
+
+    // tokenizer thread
+    kdl_input_t *input;
+    bool lazy_values, spans;
+    char tzr_buf[TZR_SIZE];
+
+    // set by the builder once it's stopped loading, so there's no more to read
+    bool stop;
+
+    // read once the tokenizer thread is joined
+    kdl_utf8_error_t utf8_error;
+} pipeline_t;
+
+static inline void backoff(unsigned *spins) {
+    if (++*spins >= MAX_SPINS) {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+// waits for the slot of the next batch to be free
+static slot_t *claim_slot(pipeline_t *pl, size_t head) {
+    unsigned spins = 0;
+
+    while (head - __atomic_load_n(&pl->tail, __ATOMIC_ACQUIRE) == RING_SLOTS)
+        backoff(&spins);
+
+    return &pl->slots[head % RING_SLOTS];
+}
+
+static void *tokenize_thread(void *arg) {
+    pipeline_t *pl = arg;
+    kdl_tokenizer_t tzr;
+
+    kdl_tokenizer_make(&tzr, pl->tzr_buf, TZR_SIZE);
+    tzr.lazy_values = pl->lazy_values;
+    tzr.spans = pl->spans;
+
+    size_t head = 0;
+    bool finished = false;
+
+    while (!finished && !__atomic_load_n(&pl->stop, __ATOMIC_RELAXED)) {
+        const char *data;
+        size_t read = kdl_input_read(pl->input, &data);
+
+        bool fed = read
+            ? kdl_tok_feed(&tzr, data, read)
+            : kdl_tok_finish(&tzr);
+
+        if (!fed) {
+            // the builder loads what came before and stops
+            pl->utf8_error = tzr.utf8.error;
+        }
+
+        finished = !read || !fed;
+
+        // an empty slot is left claimed until there's more data
+        while (kdl_tok_next_batch(&tzr, &claim_slot(pl, head)->batch))
+            __atomic_store_n(&pl->head, ++head, __ATOMIC_RELEASE);
+    }
+
+    // publish the last, empty, batch
+    __atomic_store_n(&pl->head, ++head, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+// fixed buffer documents have no allocator, so buffers come from malloc
+static const kdl_allocator_t *buffer_allocator(kdl_document_t *doc) {
+    return doc->node_table.allocator
+        ? doc->node_table.allocator
+        : &KDL_DEFAULT_ALLOCATOR;
+}
+
+bool kdl_document_load_pipelined(kdl_document_t *doc, kdl_input_t *input) {
+    if (doc->on_demand) {
+        KDL_ERROR(
+            "on-demand documents have to be loaded from a file or memory.\n"
+        );
+    }
+
+    /*
+     * the span table and line index are kept on one thread, and a load that
+     * stops at a limit can't leave the tokenizer thread waiting on the ring
+     */
+    if (doc->record_spans || doc->limits)
+        return kdl_document_load(doc, input);
+
+    doc->limit_error = (kdl_limit_error_t){0};
+    doc->utf8_error = (kdl_utf8_error_t){0};
+    doc->decode_error = (kdl_decode_error_t){0};
+
+    const kdl_allocator_t *allocator = buffer_allocator(doc);
+
+    pipeline_t *pl = allocator->alloc(sizeof(*pl), allocator->ctx);
+
+    if (!pl)
+        KDL_ERROR("out of memory.\n");
+
+    pl->head = pl->tail = 0;
+    pl->input = input;
+    pl->utf8_error = (kdl_utf8_error_t){0};
+    pl->lazy_values = doc->lazy_values;
+    pl->stop = false;
+
+    // decoders say where a value they rejected was with spans
+    pl->spans = doc->num_decoders != 0;
+
+    for (size_t i = 0; i < RING_SLOTS; ++i) {
+        slot_t *slot = &pl->slots[i];
+
+        kdl_token_batch_make(
+            &slot->batch, slot->tokens, BATCH_TOKENS, slot->bytes,
+            sizeof(slot->bytes)
+        );
+
+        if (pl->spans)
+            slot->batch.spans = slot->spans;
+    }
+
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, tokenize_thread, pl)) {
+        allocator->free(pl, sizeof(*pl), allocator->ctx);
+
+        return kdl_document_load(doc, input);
+    }
+
+    // build the tree from batches as they're published
+    kdl_loader_t loader;
+    size_t tail = 0;
+    bool loaded = true;
+
+    loader_make(&loader);
+
+    while (1) {
+        unsigned spins = 0;
+
+        while (__atomic_load_n(&pl->head, __ATOMIC_ACQUIRE) == tail)
+            backoff(&spins);
+
+        kdl_token_batch_t *batch = &pl->slots[tail % RING_SLOTS].batch;
+
+        if (!batch->num_tokens)
+            break;
+
+        // once loading stops, batches are only drained for the tokenizer to end
+        for (size_t i = 0; loaded && i < batch->num_tokens; ++i) {
+            loaded = load_token(
+                doc, &loader, &batch->tokens[i],
+                batch->spans ? &batch->spans[i] : NULL
+            );
+
+            if (!loaded)
+                __atomic_store_n(&pl->stop, true, __ATOMIC_RELAXED);
+        }
+
+        __atomic_store_n(&pl->tail, ++tail, __ATOMIC_RELEASE);
+    }
+
+    pthread_join(thread, NULL);
+    doc->utf8_error = pl->utf8_error;
+    allocator->free(pl, sizeof(*pl), allocator->ctx);
+
+    return loaded && !doc->utf8_error.invalid;
+}
+
+bool kdl_document_load_file_pipelined(
+    kdl_document_t *doc, const char *filename
+) {
+    // on-demand loading only reads the top level, so there's little to overlap
+    if (doc->on_demand)
+        return kdl_document_load_file(doc, filename);
+
+    const kdl_allocator_t *allocator = buffer_allocator(doc);
+
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+        KDL_ERROR("couldn't load file: \"%s\"\n", filename);
+
+    char *read_buf = allocator->alloc(READ_SIZE, allocator->ctx);
+
+    if (!read_buf)
+        KDL_ERROR("out of memory.\n");
+
+    kdl_input_t input;
+
+    kdl_input_uring(&input, fd, read_buf, READ_SIZE);
+
+    bool loaded = kdl_document_load_pipelined(doc, &input);
+
+    kdl_input_close(&input);
+    allocator->free(read_buf, READ_SIZE, allocator->ctx);
+    close(fd);
+
+    return loaded;
+}
@@ -0,0 +1,15 @@
+#include <cuddle/profile.h>
+
+#define X(name) #name
+const char KDL_PROFILE_STAGES[][32] = { KDL_PROFILE_STAGES_X };
+#undef X
+
+kdl_profile_t kdl_profile_counters;
+
+void kdl_profile_read(kdl_profile_t *out) {
+    *out = kdl_profile_counters;
+}
+
+void kdl_profile_reset(void) {
+    kdl_profile_counters = (kdl_profile_t){{0}, {0}};
+}
@@ -1,5 +1,7 @@
 // TODO can I do this without stdio.h?
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
 
 #include <cuddle/serialize.h>
 
@@ -48,3 +50,117 @@ void kdl_serialize_bool(char *buf, size_t buf_size, bool boolean) {
 void kdl_serialize_null(char *buf, size_t buf_size) {
     snprintf(buf, buf_size, "null");
 }
+
+void kdl_serialize_int(char *buf, size_t buf_size, int64_t integer) {
+    snprintf(buf, buf_size, "%" PRId64, integer);
+}
+
+void kdl_serialize_uint(char *buf, size_t buf_size, uint64_t uinteger) {
+    snprintf(buf, buf_size, "%" PRIu64, uinteger);
+}
+
+void kdl_serialize_uuid(char *buf, size_t buf_size, const unsigned char *uuid) {
+    snprintf(
+        buf, buf_size,
+        "\"%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-"
+        "%02x%02x%02x%02x%02x%02x\"",
+        uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5], uuid[6], uuid[7],
+        uuid[8], uuid[9], uuid[10], uuid[11], uuid[12], uuid[13], uuid[14],
+        uuid[15]
+    );
+}
+
+void kdl_serialize_timestamp(char *buf, size_t buf_size, int64_t timestamp) {
+    // floor division, so times before the epoch land on the right day
+    int64_t micros = timestamp % 86400000000;
+
+    if (micros < 0)
+        micros += 86400000000;
+
+    int64_t days = (timestamp - micros) / 86400000000;
+
+    // the inverse of days_from_civil() in annotation.c
+    days += 719468;
+
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned day_of_era = (unsigned)(days - era * 146097);
+    unsigned year_of_era = (day_of_era - day_of_era / 1460
+                         + day_of_era / 36524 - day_of_era / 146096) / 365;
+    unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4
+                         - year_of_era / 100);
+    unsigned mp = (5 * day_of_year + 2) / 153;
+    unsigned day = day_of_year - (153 * mp + 2) / 5 + 1;
+    unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    int64_t year = year_of_era + era * 400 + (month <= 2);
+
+    int64_t seconds = micros / 1000000;
+    int written = snprintf(
+        buf, buf_size, "\"%04" PRId64 "-%02u-%02uT%02d:%02d:%02d",
+        year, month, day, (int)(seconds / 3600), (int)(seconds / 60 % 60),
+        (int)(seconds % 60)
+    );
+
+    if (written < 0 || (size_t)written >= buf_size)
+        return;
+
+    if (micros % 1000000) {
+        snprintf(
+            buf + written, buf_size - written, ".%06dZ\"",
+            (int)(micros % 1000000)
+        );
+    } else {
+        snprintf(buf + written, buf_size - written, "Z\"");
+    }
+}
+
+bool kdl_is_identifier(const char *id) {
+    if (!*id || (*id >= '0' && *id <= '9'))
+        return false;
+
+    if ((*id == '-' || *id == '+') && id[1] >= '0' && id[1] <= '9')
+        return false;
+
+    if (!strcmp(id, "true") || !strcmp(id, "false") || !strcmp(id, "null"))
+        return false;
+
+    for (; *id; ++id)
+        if ((unsigned char)*id <= ' ' || strchr("\\/(){}<>;[]=,\"", *id))
+            return false;
+
+    return true;
+}
+
+void kdl_output_make(
+    kdl_output_t *out, char *buf, size_t buf_size, kdl_write_fn write,
+    void *ctx
+) {
+    *out = (kdl_output_t){
+        .buf = buf,
+        .buf_size = buf_size,
+        .write = write,
+        .ctx = ctx
+    };
+}
+
+void kdl_output_write(kdl_output_t *out, const char *data, size_t length) {
+    // anything that won't fit after a flush skips the buffer
+    if (out->buf_len + length > out->buf_size) {
+        kdl_output_flush(out);
+
+        if (length >= out->buf_size) {
+            out->write(data, length, out->ctx);
+
+            return;
+        }
+    }
+
+    memcpy(out->buf + out->buf_len, data, length);
+    out->buf_len += length;
+}
+
+void kdl_output_flush(kdl_output_t *out) {
+    if (out->buf_len)
+        out->write(out->buf, out->buf_len, out->ctx);
+
+    out->buf_len = 0;
+}
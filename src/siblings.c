@@ -0,0 +1,165 @@
+#include <string.h>
+#include <stdint.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/dom.h>
+#include "siblings.h"
+
+#define MIN_SCRATCH 4096
+// every push starts here, so anything can be put on the stack
+#define SCRATCH_ALIGN 16
+
+#define NO_SIBLING SIZE_MAX
+
+void scratch_make(kdl_scratch_t *scratch, kdl_document_t *doc) {
+    const kdl_allocator_t *allocator = doc->node_table.allocator;
+
+    *scratch = (kdl_scratch_t){
+        .allocator = allocator ? allocator : &KDL_DEFAULT_ALLOCATOR
+    };
+}
+
+void scratch_free(kdl_scratch_t *scratch) {
+    const kdl_allocator_t *allocator = scratch->allocator;
+
+    if (scratch->bytes)
+        allocator->free(scratch->bytes, scratch->cap, allocator->ctx);
+
+    *scratch = (kdl_scratch_t){
+        .allocator = allocator
+    };
+}
+
+size_t scratch_push(kdl_scratch_t *scratch, size_t size) {
+    const kdl_allocator_t *allocator = scratch->allocator;
+    size_t offset = (scratch->len + SCRATCH_ALIGN - 1) & ~(SCRATCH_ALIGN - 1);
+
+    if (offset + size > scratch->cap) {
+        size_t cap = scratch->cap ? scratch->cap : MIN_SCRATCH;
+
+        while (cap < offset + size)
+            cap *= 2;
+
+        char *bytes = scratch->bytes
+            ? allocator->realloc(
+                scratch->bytes, scratch->cap, cap, allocator->ctx
+            )
+            : allocator->alloc(cap, allocator->ctx);
+
+        if (!bytes)
+            KDL_ERROR("out of memory.\n");
+
+        scratch->bytes = bytes;
+        scratch->cap = cap;
+    }
+
+    scratch->len = offset + size;
+
+    return offset;
+}
+
+/*
+ * id indices are open addressed hash tables of ids, kept at most half full.
+ * each id's slot has the first sibling with it, and next links every sibling
+ * to the one after it with the same id.
+ */
+typedef struct id_index {
+    size_t cap, len;
+} id_index_t;
+
+typedef struct id_slot {
+    uint64_t hash;
+    size_t first; // NO_SIBLING for an empty slot
+    size_t take; // the next sibling to hand out
+} id_slot_t;
+
+// fnv-1a
+static uint64_t hash_id(const char *id) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (const char *ch = id; *ch; ++ch) {
+        hash ^= (unsigned char)*ch;
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+// finds the slot for an id, or the empty slot it would go in
+static id_slot_t *find_slot(
+    id_slot_t *slots, size_t cap, kdl_node_t **nodes, uint64_t hash,
+    const char *id
+) {
+    for (size_t i = hash & (cap - 1);; i = (i + 1) & (cap - 1)) {
+        id_slot_t *slot = &slots[i];
+
+        if (
+            slot->first == NO_SIBLING
+            || (slot->hash == hash && !strcmp(nodes[slot->first]->id, id))
+        ) {
+            return slot;
+        }
+    }
+}
+
+size_t id_index_make(kdl_scratch_t *scratch, kdl_node_t **nodes, size_t len) {
+    size_t cap = 1;
+
+    while (cap < 2 * len)
+        cap *= 2;
+
+    size_t offset = scratch_push(
+        scratch,
+        sizeof(id_index_t) + cap * sizeof(id_slot_t) + len * sizeof(size_t)
+    );
+
+    id_index_t *index = scratch_at(scratch, offset);
+    id_slot_t *slots = (id_slot_t *)(index + 1);
+    size_t *next = (size_t *)(slots + cap);
+
+    index->cap = cap;
+    index->len = len;
+
+    for (size_t i = 0; i < cap; ++i)
+        slots[i].first = NO_SIBLING;
+
+    // take is the last sibling with the id until they're all linked
+    for (size_t i = 0; i < len; ++i) {
+        uint64_t hash = hash_id(nodes[i]->id);
+        id_slot_t *slot = find_slot(slots, cap, nodes, hash, nodes[i]->id);
+
+        next[i] = NO_SIBLING;
+
+        if (slot->first == NO_SIBLING) {
+            slot->hash = hash;
+            slot->first = i;
+        } else {
+            next[slot->take] = i;
+        }
+
+        slot->take = i;
+    }
+
+    for (size_t i = 0; i < cap; ++i)
+        slots[i].take = slots[i].first;
+
+    return offset;
+}
+
+size_t id_index_take(
+    kdl_scratch_t *scratch, size_t offset, kdl_node_t **nodes, const char *id
+) {
+    id_index_t *index = scratch_at(scratch, offset);
+    id_slot_t *slots = (id_slot_t *)(index + 1);
+    size_t *next = (size_t *)(slots + index->cap);
+
+    id_slot_t *slot = find_slot(slots, index->cap, nodes, hash_id(id), id);
+    size_t taken = slot->first == NO_SIBLING ? NO_SIBLING : slot->take;
+
+    if (taken == NO_SIBLING)
+        return index->len;
+
+    slot->take = next[taken];
+
+    return taken;
+}
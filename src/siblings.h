@@ -0,0 +1,54 @@
+#ifndef KDL_SIBLINGS_H
+#define KDL_SIBLINGS_H
+
+/*
+ * matching up sibling nodes by id, shared by merging in dom.c and diffing in
+ * diff.c. the nth node with an id among one set of siblings matches the nth
+ * node with that id among the other.
+ *
+ * everything is kept on a scratch stack from the document's allocator, or
+ * malloc with fixed buffers. a walk pushes what each level of the tree needs
+ * and pops it on the way back up, so the memory is reused from one level to
+ * the next. offsets into the stack stay good when it grows, pointers don't.
+ * walks keep their frames here too, so any depth works without recursing.
+ */
+typedef struct kdl_scratch {
+    const kdl_allocator_t *allocator;
+    char *bytes;
+    size_t len, cap;
+} kdl_scratch_t;
+
+void scratch_make(kdl_scratch_t *, kdl_document_t *);
+void scratch_free(kdl_scratch_t *);
+// reserves size bytes on top and returns their offset
+size_t scratch_push(kdl_scratch_t *, size_t size);
+
+static inline void *scratch_at(kdl_scratch_t *scratch, size_t offset) {
+    return scratch->bytes + offset;
+}
+
+// an offset for nothing, like the parent of a walk's first frame
+#define SCRATCH_NONE SIZE_MAX
+
+// pops everything from offset up
+static inline void scratch_pop(kdl_scratch_t *scratch, size_t offset) {
+    scratch->len = offset;
+}
+
+/*
+ * an index of siblings by id on the scratch stack, which returns its offset.
+ * each id keeps its nodes in order and hands them out one at a time, so what's
+ * taken for the nth node with an id is the nth sibling with it.
+ */
+size_t id_index_make(kdl_scratch_t *, kdl_node_t **nodes, size_t len);
+
+/*
+ * the position of the next sibling with this id which hasn't been taken, or
+ * the number of siblings if there isn't one. nodes doesn't have to be the array
+ * the index was made from, as long as each position still has the same id.
+ */
+size_t id_index_take(
+    kdl_scratch_t *, size_t offset, kdl_node_t **nodes, const char *id
+);
+
+#endif
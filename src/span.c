@@ -0,0 +1,176 @@
+#include <string.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/span.h>
+
+#define MIN_CAP 64
+
+void kdl_span_table_make(
+    kdl_span_table_t *table, const kdl_allocator_t *allocator
+) {
+    *table = (kdl_span_table_t){
+        .allocator = allocator
+    };
+}
+
+void kdl_span_table_clear(kdl_span_table_t *table) {
+    if (table->nodes)
+        memset(table->nodes, 0, table->cap_nodes * sizeof(*table->nodes));
+
+    table->num_args = table->num_props = 0;
+    kdl_span_table_unindex(table);
+}
+
+void kdl_span_table_release(kdl_span_table_t *table) {
+    const kdl_allocator_t *allocator = table->allocator;
+
+    if (table->nodes) {
+        allocator->free(
+            table->nodes, table->cap_nodes * sizeof(*table->nodes),
+            allocator->ctx
+        );
+    }
+
+    if (table->args) {
+        allocator->free(
+            table->args, table->cap_args * sizeof(*table->args), allocator->ctx
+        );
+    }
+
+    if (table->props) {
+        allocator->free(
+            table->props, table->cap_props * sizeof(*table->props),
+            allocator->ctx
+        );
+    }
+
+    if (table->newlines) {
+        allocator->free(
+            table->newlines, table->cap_newlines * sizeof(*table->newlines),
+            allocator->ctx
+        );
+    }
+
+    kdl_span_table_make(table, allocator);
+}
+
+// grows an array to hold at least min elements, zeroing the new ones
+static void *grow_spans(
+    kdl_span_table_t *table, void *array, size_t elem_size, size_t *cap,
+    size_t min
+) {
+    const kdl_allocator_t *allocator = table->allocator;
+    size_t new_cap = *cap ? *cap : MIN_CAP;
+
+    while (new_cap < min)
+        new_cap *= 2;
+
+    void *grown = array
+        ? allocator->realloc(
+            array, *cap * elem_size, new_cap * elem_size, allocator->ctx
+        )
+        : allocator->alloc(new_cap * elem_size, allocator->ctx);
+
+    if (!grown)
+        KDL_ERROR("out of memory.\n");
+
+    memset(
+        (char *)grown + *cap * elem_size, 0, (new_cap - *cap) * elem_size
+    );
+    *cap = new_cap;
+
+    return grown;
+}
+
+kdl_node_spans_t *kdl_span_table_node(
+    kdl_span_table_t *table, unsigned index
+) {
+    if (index >= table->cap_nodes) {
+        table->nodes = grow_spans(
+            table, table->nodes, sizeof(*table->nodes), &table->cap_nodes,
+            (size_t)index + 1
+        );
+    }
+
+    return &table->nodes[index];
+}
+
+void kdl_span_table_push_arg(
+    kdl_span_table_t *table, kdl_node_spans_t *node, kdl_span_t span
+) {
+    if (table->num_args == table->cap_args) {
+        table->args = grow_spans(
+            table, table->args, sizeof(*table->args), &table->cap_args,
+            table->num_args + 1
+        );
+    }
+
+    // a node's values all come before the next node's
+    if (!node->num_args)
+        node->args = table->num_args;
+
+    table->args[table->num_args++] = span;
+    ++node->num_args;
+}
+
+void kdl_span_table_push_prop(
+    kdl_span_table_t *table, kdl_node_spans_t *node, kdl_span_t span
+) {
+    if (table->num_props == table->cap_props) {
+        table->props = grow_spans(
+            table, table->props, sizeof(*table->props), &table->cap_props,
+            table->num_props + 1
+        );
+    }
+
+    if (!node->num_props)
+        node->props = table->num_props;
+
+    table->props[table->num_props++] = span;
+    ++node->num_props;
+}
+
+void kdl_span_table_index(
+    kdl_span_table_t *table, const char *text, size_t length
+) {
+    const char *end = text + length;
+
+    for (const char *nl = text; (nl = memchr(nl, '\n', end - nl)); ++nl) {
+        if (table->num_newlines == table->cap_newlines) {
+            table->newlines = grow_spans(
+                table, table->newlines, sizeof(*table->newlines),
+                &table->cap_newlines, table->num_newlines + 1
+            );
+        }
+
+        table->newlines[table->num_newlines++] = table->text_len + (nl - text);
+    }
+
+    table->text_len += length;
+}
+
+void kdl_span_table_unindex(kdl_span_table_t *table) {
+    table->num_newlines = table->text_len = 0;
+    table->indexed = false;
+}
+
+kdl_location_t kdl_span_table_locate(kdl_span_table_t *table, size_t offset) {
+    // finds how many newlines come before offset
+    size_t lo = 0, hi = table->num_newlines;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (table->newlines[mid] < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    size_t line_start = lo ? table->newlines[lo - 1] + 1 : 0;
+
+    return (kdl_location_t){
+        .line = lo + 1,
+        .column = offset - line_start + 1
+    };
+}
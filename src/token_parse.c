@@ -1,71 +1,102 @@
 #include <math.h>
+#include <string.h>
 
 #include <cuddle/meta.h>
 #include <cuddle/cuddle.h>
+#include "token_parse.h"
 
-// TODO str_size and check
-static inline void append_ch(kdl_token_t *token, char ch) {
-    token->string[token->str_len++] = ch;
-}
+/*
+ * tokens are first copied out of the tokenizer buffer as raw utf-8, and then
+ * decoded in place. decoding never makes a string longer, which lets lazy
+ * values (see kdl_tokenizer_t.lazy_values) be decoded later where they sit.
+ */
 
 // TODO str_size and check
-static void append_u8ch(kdl_token_t *token, kdl_u8ch_t ch) {
-    if (ch < 0x80) {
-        append_ch(token, ch);
-    } else {
-        char decoded[4];
-        size_t size;
+// copies up to len bytes or a null, returns whether a backslash was copied
+static bool copy_str(kdl_token_t *token, const char *str, size_t len) {
+    const char *null = memchr(str, '\0', len);
 
-        kdl_utf8_to_mbs(ch, decoded, &size);
+    if (null)
+        len = null - str;
 
-        for (size_t i = 0; i < size; ++i)
-            token->string[token->str_len++] = decoded[i];
-    }
-}
+    memcpy(token->string, str, len);
+    token->string[len] = 0;
+    token->str_len = len;
 
-static void copy_u8str(kdl_token_t *token, kdl_u8ch_t *u8str) {
-    token->str_len = 0;
+    return memchr(str, '\\', len) != NULL;
+}
 
-    while (*u8str)
-        append_u8ch(token, *u8str++);
+int hex_digit(char ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    else if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    else if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
 
-    token->string[token->str_len] = 0;
+    return -1;
 }
 
-static void parse_escaped_string(kdl_tokenizer_t *tzr, kdl_token_t *token) {
-    kdl_u8ch_t *trav = tzr->buf + 1;
+size_t decode_escapes(char *str, size_t len) {
+    char *trav = str, *end = str + len, *out = str;
 
-    token->str_len = 0;
-
-    while (*trav && *trav != L'"') {
-        if (*trav == L'\\') {
+    while (trav < end) {
+        if (*trav == '\\' && trav + 1 < end) {
             ++trav;
 
             // handle string escape
             switch (*trav) {
-#define ESC_CASE(ch, esc) case ch: append_ch(token, esc); break
-            ESC_CASE(L'n', '\n');
-            ESC_CASE(L'r', '\r');
-            ESC_CASE(L't', '\t');
-            ESC_CASE(L'\\', '\\');
-            ESC_CASE(L'/', '/');
-            ESC_CASE(L'"', '"');
-            ESC_CASE(L'b', '\b');
-            ESC_CASE(L'f', '\f');
+#define ESC_CASE(ch, esc) case ch: *out++ = esc; break
+            ESC_CASE('n', '\n');
+            ESC_CASE('r', '\r');
+            ESC_CASE('t', '\t');
+            ESC_CASE('\\', '\\');
+            ESC_CASE('/', '/');
+            ESC_CASE('"', '"');
+            ESC_CASE('b', '\b');
+            ESC_CASE('f', '\f');
 #undef ESC_CASE
-            case L'u':;
+            case 'u':;
                 // parse unicode escape sequence
                 kdl_u8ch_t ch = 0;
 
-                for (size_t i = 0; i < 6; ++i) {
+                // \u{...} as the spec writes it
+                if (trav + 1 < end && trav[1] == '{') {
+                    char *close = memchr(trav, '}', end - trav);
+
+                    if (close) {
+                        ++trav;
+
+                        // at most 6 digits count, like the bare form
+                        for (int i = 0; i < 6 && ++trav < close; ++i) {
+                            int digit = hex_digit(*trav);
+
+                            if (digit < 0)
+                                break;
+
+                            ch = ch * 16 + digit;
+                        }
+
+                        trav = close;
+
+                        size_t size;
+
+                        kdl_utf8_to_mbs(ch, out, &size);
+                        out += size;
+
+                        break;
+                    }
+                }
+
+                for (size_t i = 0; i < 6 && trav + 1 < end; ++i) {
                     ++trav;
 
-                    unsigned diff = *trav - L'0'; // unsigned to avoid >= 0 cmp
+                    unsigned diff = *trav - '0'; // unsigned to avoid >= 0 cmp
 
                     if (diff < 10) {
                         ch *= 16;
                         ch += diff;
-                    } else if ((diff = *trav - L'A') < 6) {
+                    } else if ((diff = *trav - 'A') < 6) {
                         ch *= 16;
                         ch += diff + 10;
                     } else {
@@ -75,53 +106,45 @@ static void parse_escaped_string(kdl_tokenizer_t *tzr, kdl_token_t *token) {
                     }
                 }
 
-                append_u8ch(token, ch);
+                size_t size;
+
+                kdl_utf8_to_mbs(ch, out, &size);
+                out += size;
 
                 break;
             default:
-                append_u8ch(token, *trav);
+                *out++ = *trav;
 
                 break;
             }
         } else {
-            append_u8ch(token, *trav);
+            *out++ = *trav;
         }
 
         ++trav;
     }
 
-    token->string[token->str_len] = 0;
-}
-
-static void parse_raw_string(kdl_tokenizer_t *tzr, kdl_token_t *token) {
-    // chop off ending quote
-    size_t i;
-
-    for (i = tzr->buf_len; tzr->buf[i] != L'"'; --i)
-        ;
-
-    tzr->buf[i] = L'\0';
+    *out = 0;
 
-    // copy from after beginning quote
-    copy_u8str(token, tzr->buf + 1);
+    return out - str;
 }
 
-static inline long parse_sign(kdl_u8ch_t **trav) {
-    long sign = **trav == L'-' ? -1 : 1;
+static inline long parse_sign(const char **trav) {
+    long sign = **trav == '-' ? -1 : 1;
 
-    *trav += **trav == L'-' || **trav == L'+';
+    *trav += **trav == '-' || **trav == '+';
 
     return sign;
 }
 
-static long parse_num_base(kdl_u8ch_t **trav, int base) {
+static long parse_num_base(const char **trav, int base) {
     long integral = 0;
 
     while (1) {
-        if (**trav >= L'0' && **trav < L'0' + base) {
+        if (**trav >= '0' && **trav < '0' + base) {
             integral *= base;
-            integral += **trav - L'0';
-        } else if (**trav != L'_') {
+            integral += **trav - '0';
+        } else if (**trav != '_') {
             return integral;
         }
 
@@ -129,21 +152,21 @@ static long parse_num_base(kdl_u8ch_t **trav, int base) {
     }
 }
 
-static long parse_hex(kdl_u8ch_t **trav) {
+static long parse_hex(const char **trav) {
     long integral = 0;
 
     while (1) {
         // TODO this could definitely be a lot cleaner
-        if (**trav >= L'0' && **trav <= L'9') {
+        if (**trav >= '0' && **trav <= '9') {
             integral *= 16;
-            integral += **trav - L'0';
-        } else if (**trav >= L'A' && **trav <= L'F') {
+            integral += **trav - '0';
+        } else if (**trav >= 'A' && **trav <= 'F') {
             integral *= 16;
-            integral += 10 + **trav - L'A';
-        } else if (**trav >= L'a' && **trav <= L'f') {
+            integral += 10 + **trav - 'A';
+        } else if (**trav >= 'a' && **trav <= 'f') {
             integral *= 16;
-            integral += 10 + **trav - L'a';
-        } else if (**trav != L'_') {
+            integral += 10 + **trav - 'a';
+        } else if (**trav != '_') {
             return integral;
         }
 
@@ -151,18 +174,18 @@ static long parse_hex(kdl_u8ch_t **trav) {
     }
 }
 
-static double parse_dec(kdl_u8ch_t **trav) {
+static double parse_dec(const char **trav) {
     double number = parse_num_base(trav, 10);
 
     // fractional values
-    if (**trav == L'.') {
+    if (**trav == '.') {
         double fractional = 0.0, multiplier = 0.1;
 
         ++*trav;
 
-        while (**trav != L'e' && **trav != L'E' && **trav) {
-            if (**trav != L'_') {
-                fractional += (double)(**trav - L'0') * multiplier;
+        while (**trav != 'e' && **trav != 'E' && **trav) {
+            if (**trav != '_') {
+                fractional += (double)(**trav - '0') * multiplier;
                 multiplier *= 0.1;
             }
 
@@ -173,7 +196,7 @@ static double parse_dec(kdl_u8ch_t **trav) {
         number += fractional;
 
         // exponents
-        if (**trav == L'e' || **trav == L'E') {
+        if (**trav == 'e' || **trav == 'E') {
             ++*trav;
 
             number *= pow(
@@ -186,25 +209,24 @@ static double parse_dec(kdl_u8ch_t **trav) {
     return number;
 }
 
-// returns if number was valid
-static bool parse_number(kdl_tokenizer_t *tzr, kdl_token_t *token) {
-    kdl_u8ch_t *trav = tzr->buf;
+bool decode_number(const char *str, double *out_number) {
+    const char *trav = str;
     double sign = parse_sign(&trav);
     double number;
 
-    if (*trav == L'0') {
+    if (*trav == '0') {
         switch (*(trav + 1)) {
-        case L'x':
+        case 'x':
             trav += 2;
             number = parse_hex(&trav);
 
             break;
-        case L'b':
+        case 'b':
             trav += 2;
             number = parse_num_base(&trav, 2);
 
             break;
-        case L'o':
+        case 'o':
             trav += 2;
             number = parse_num_base(&trav, 8);
 
@@ -218,11 +240,9 @@ static bool parse_number(kdl_tokenizer_t *tzr, kdl_token_t *token) {
         number = parse_dec(&trav);
     }
 
-    number *= sign;
-
     // return validity
     if (!*trav) {
-        token->number = number;
+        *out_number = number * sign;
 
         return true;
     }
@@ -230,56 +250,93 @@ static bool parse_number(kdl_tokenizer_t *tzr, kdl_token_t *token) {
     return false;
 }
 
-static void type_characters_token(kdl_tokenizer_t *tzr, kdl_token_t *token) {
+static void type_characters_token(
+    kdl_tokenizer_t *tzr, kdl_token_t *token, bool lazy
+) {
     switch (tzr->buf[0]) {
-    case L't':
+    case 't':
         token->type = KDL_TOK_BOOL;
         token->boolean = true;
 
         return;
-    case L'f':
+    case 'f':
         token->type = KDL_TOK_BOOL;
         token->boolean = false;
 
         return;
-    case L'n':
+    case 'n':
         token->type = KDL_TOK_NULL;
 
         return;
     default:
-        if (parse_number(tzr, token)) {
-            token->type = KDL_TOK_NUMBER;
+        token->type = KDL_TOK_NUMBER;
 
-            return;
-        }
+        copy_str(token, tzr->buf, tzr->buf_len);
+
+        if (lazy)
+            token->raw = true;
+        else if (!decode_number(token->string, &token->number))
+            KDL_ERROR("encountered an unknown value!\n");
 
-        KDL_ERROR("encountered an unknown value!\n");
+        return;
     }
 }
 
 void generate_token(kdl_tokenizer_t *tzr, kdl_token_t *token) {
+    KDL_PROFILE_BEGIN(KDL_PROF_GENERATE_TOKEN);
+
+    // node and property names are always decoded
+    bool is_name = tzr->state == KDL_SEQ_ASSIGNMENT || tzr->expect_node;
+    bool lazy = tzr->lazy_values && !is_name;
+
+    token->raw = false;
+
     // find token type and parse
     switch (tzr->last_state) {
     case KDL_SEQ_STRING:
         token->type = KDL_TOK_STRING;
-        parse_escaped_string(tzr, token);
+
+        // copy from between the quotes
+        if (copy_str(token, tzr->buf + 1, tzr->buf_len - 2)) {
+            if (lazy)
+                token->raw = true;
+            else
+                token->str_len = decode_escapes(token->string, token->str_len);
+        }
 
         break;
-    case KDL_SEQ_RAW_STR:
+    case KDL_SEQ_RAW_STR:;
         token->type = KDL_TOK_STRING;
-        parse_raw_string(tzr, token);
+
+        // chop off ending quote
+        size_t end;
+
+        for (end = tzr->buf_len; tzr->buf[end] != '"'; --end)
+            ;
+
+        copy_str(token, tzr->buf + 1, end - 1);
 
         break;
     case KDL_SEQ_CHARACTER:
-        if (tzr->state == KDL_SEQ_ASSIGNMENT || tzr->expect_node) {
+        if (is_name) {
             token->type = KDL_TOK_IDENTIFIER;
 
             // copy identifier
-            copy_u8str(token, tzr->buf);
+            copy_str(token, tzr->buf, tzr->buf_len);
         } else {
-            type_characters_token(tzr, token);
+            type_characters_token(tzr, token, lazy);
+        }
 
-            break;
+        break;
+    case KDL_SEQ_ANNOTATION:
+        token->type = KDL_TOK_ANNOTATION;
+
+        // copy from between the parens, and the quotes of a quoted type
+        if (tzr->buf[1] == '"') {
+            if (copy_str(token, tzr->buf + 2, tzr->buf_len - 4))
+                token->str_len = decode_escapes(token->string, token->str_len);
+        } else {
+            copy_str(token, tzr->buf + 1, tzr->buf_len - 2);
         }
 
         break;
@@ -307,4 +364,6 @@ void generate_token(kdl_tokenizer_t *tzr, kdl_token_t *token) {
     }
 
     token->property = tzr->state == KDL_SEQ_ASSIGNMENT;
+
+    KDL_PROFILE_END(KDL_PROF_GENERATE_TOKEN);
 }
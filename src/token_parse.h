@@ -3,4 +3,15 @@
 
 void generate_token(kdl_tokenizer_t *, kdl_token_t *);
 
+/*
+ * decoders for raw utf-8 token text, shared with lazy value decoding in dom.c
+ */
+
+// decodes string escapes in place and returns the new length
+size_t decode_escapes(char *str, size_t len);
+// returns whether str was a valid number
+bool decode_number(const char *str, double *out_number);
+// the value of a hex digit, or -1
+int hex_digit(char ch);
+
 #endif
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include <cuddle/meta.h>
 #include <cuddle/tokenize.h>
 #include "token_parse.h"
@@ -7,7 +9,7 @@ const char KDL_TOKEN_TYPES[][32] = { KDL_TOKEN_TYPES_X };
 const char KDL_TOKENIZER_STATES[][32] = { KDL_TOKENIZER_STATES_X };
 #undef X
 
-void kdl_tokenizer_make(kdl_tokenizer_t *tzr, kdl_u8ch_t *buffer, size_t buf_size) {
+void kdl_tokenizer_make(kdl_tokenizer_t *tzr, char *buffer, size_t buf_size) {
     *tzr = (kdl_tokenizer_t){
         .buf = buffer,
         .buf_size = buf_size,
@@ -15,114 +17,240 @@ void kdl_tokenizer_make(kdl_tokenizer_t *tzr, kdl_u8ch_t *buffer, size_t buf_siz
     };
 }
 
+void kdl_tokenizer_reset(kdl_tokenizer_t *tzr) {
+    bool lazy_values = tzr->lazy_values, spans = tzr->spans;
+    bool soft_overflow = tzr->soft_overflow;
+
+    kdl_tokenizer_make(tzr, tzr->buf, tzr->buf_size);
+    tzr->lazy_values = lazy_values;
+    tzr->spans = spans;
+    tzr->soft_overflow = soft_overflow;
+}
+
 void kdl_token_make(kdl_token_t *token, char *buffer) {
     *token = (kdl_token_t){
         .string = buffer
     };
 }
 
-void kdl_tok_feed(kdl_tokenizer_t *tzr, char *data, size_t length) {
-    kdl_utf8_feed(&tzr->utf8, data, length);
+void kdl_token_batch_make(
+    kdl_token_batch_t *batch, kdl_token_t *tokens, size_t max_tokens,
+    char *bytes, size_t bytes_size
+) {
+    *batch = (kdl_token_batch_t){
+        .tokens = tokens,
+        .max_tokens = max_tokens,
+        .bytes = bytes,
+        .bytes_size = bytes_size
+    };
+}
+
+bool kdl_tok_feed(kdl_tokenizer_t *tzr, const char *data, size_t length) {
+    tzr->offset += tzr->utf8.data_len;
+
+    return kdl_utf8_feed(&tzr->utf8, data, length);
 }
 
-static bool is_whitespace(kdl_u8ch_t ch) {
+bool kdl_tok_finish(kdl_tokenizer_t *tzr) {
+    // tokens are only split once the next char arrives, so end with a break
+    static char end[] = "\n";
+
+    // feeding nothing first ends the stream, which catches an unfinished char
+    return kdl_tok_feed(tzr, NULL, 0) && kdl_tok_feed(tzr, end, 1);
+}
+
+/*
+ * the tokenizer is driven by two tables: every codepoint maps to a character
+ * class, and outside of sequences each class maps straight to a state. only
+ * ascii is direct-indexed, the few non-ascii codepoints kdl cares about are
+ * caught by unicode_class().
+ */
+typedef enum char_class {
+    CC_OTHER,
+    CC_WHITESPACE,
+    CC_NEWLINE,
+    CC_BREAK, // ';' and WEOF, breaks that don't end c++ comments
+    CC_CHILD_BEGIN,
+    CC_CHILD_END,
+    CC_EQUALS,
+    CC_PAREN_OPEN,
+    CC_PAREN_CLOSE,
+    CC_BACKSLASH,
+    CC_QUOTE,
+    CC_SLASH,
+    CC_STAR,
+    CC_DASH,
+    CC_HASH,
+
+    NUM_CHAR_CLASSES
+} char_class_e;
+
+static const unsigned char ASCII_CLASSES[0x80] = {
+    [0x09] = CC_WHITESPACE,
+    [0x20] = CC_WHITESPACE,
+    [0x0A] = CC_NEWLINE,
+    [0x0C] = CC_NEWLINE,
+    [0x0D] = CC_NEWLINE,
+    [';'] = CC_BREAK,
+    ['{'] = CC_CHILD_BEGIN,
+    ['}'] = CC_CHILD_END,
+    ['='] = CC_EQUALS,
+    ['('] = CC_PAREN_OPEN,
+    [')'] = CC_PAREN_CLOSE,
+    ['\\'] = CC_BACKSLASH,
+    ['"'] = CC_QUOTE,
+    ['/'] = CC_SLASH,
+    ['*'] = CC_STAR,
+    ['-'] = CC_DASH,
+    ['#'] = CC_HASH,
+};
+
+static char_class_e unicode_class(kdl_u8ch_t ch) {
+    // skip the switch for the ranges most non-ascii text lives in
+    if (ch > 0x3000 || (ch > 0xA0 && ch < 0x1680))
+        return CC_OTHER;
+
     switch (ch) {
-    case 0x0009:
-    case 0x0020:
     case 0x00A0:
     case 0x1680:
     case 0x202F:
     case 0x205F:
     case 0x3000:
-        return true;
-
-    default:
-        return ch >= 0x2000 && ch <= 0x200A;
-
-    }
-}
-
-static bool is_newline(kdl_u8ch_t ch) {
-    switch (ch) {
-    case 0x000A:
-    case 0x000C:
-    case 0x000D:
+        return CC_WHITESPACE;
     case 0x0085:
     case 0x2028:
     case 0x2029:
-        return true;
+        return CC_NEWLINE;
+    case (kdl_u8ch_t)WEOF:
+        return CC_BREAK;
 
     default:
-        return false;
+        return ch >= 0x2000 && ch <= 0x200A ? CC_WHITESPACE : CC_OTHER;
 
     }
 }
 
-static inline bool is_break(kdl_u8ch_t ch) {
-    return is_newline(ch) || ch == L';' || ch == (kdl_u8ch_t)WEOF;
+static inline char_class_e char_class(kdl_u8ch_t ch) {
+    return (unsigned)ch < 0x80 ? ASCII_CLASSES[ch] : unicode_class(ch);
 }
 
+// the state each class starts when the tokenizer isn't in a toggled state
+static const unsigned char CLASS_STATES[NUM_CHAR_CLASSES] = {
+    [CC_OTHER] = KDL_SEQ_CHARACTER,
+    [CC_WHITESPACE] = KDL_SEQ_WHITESPACE,
+    [CC_NEWLINE] = KDL_SEQ_BREAK,
+    [CC_BREAK] = KDL_SEQ_BREAK,
+    [CC_CHILD_BEGIN] = KDL_SEQ_CHILD_BEGIN,
+    [CC_CHILD_END] = KDL_SEQ_CHILD_END,
+    [CC_EQUALS] = KDL_SEQ_ASSIGNMENT,
+    [CC_PAREN_OPEN] = KDL_SEQ_ANNOTATION,
+    [CC_PAREN_CLOSE] = KDL_SEQ_CHARACTER,
+    [CC_BACKSLASH] = KDL_SEQ_BREAK_ESC,
+    [CC_QUOTE] = KDL_SEQ_STRING,
+    [CC_SLASH] = KDL_SEQ_CHARACTER,
+    [CC_STAR] = KDL_SEQ_CHARACTER,
+    [CC_DASH] = KDL_SEQ_CHARACTER,
+    [CC_HASH] = KDL_SEQ_CHARACTER,
+};
+
 // assumes that tokenizer isn't in a special sequence (like a string or comment)
 static kdl_tokenizer_state_e detect_next_state(
-    kdl_tokenizer_t *tzr, kdl_u8ch_t ch
+    kdl_tokenizer_t *tzr, char_class_e cc
 ) {
-    // character classes
-    if (is_whitespace(ch))
-        return KDL_SEQ_WHITESPACE;
-    else if (is_break(ch))
-        return KDL_SEQ_BREAK;
+    // only quotes and comment openers depend on the chars before them
+    if (tzr->state != KDL_SEQ_CHARACTER)
+        return CLASS_STATES[cc];
 
-    // direct char mappings
-    switch (ch) {
-    case L'{': return KDL_SEQ_CHILD_BEGIN;
-    case L'}': return KDL_SEQ_CHILD_END;
-    case L'=': return KDL_SEQ_ASSIGNMENT;
-    case L'(': return KDL_SEQ_ANNOTATION;
-    case L'\\': return KDL_SEQ_BREAK_ESC;
-    case L'"':
+    switch (cc) {
+    case CC_QUOTE:
         // could be raw string or string
-        if (tzr->state == KDL_SEQ_CHARACTER) {
-            if (tzr->last_char == L'r') {
-                // no '#'s
-                tzr->raw_count = 1;
-
-                return KDL_SEQ_RAW_STR;
-            } else if (tzr->buf[0] == L'r') {
-                // check for 1+ '#'s
-                tzr->raw_count = 1;
-                tzr->buf[tzr->buf_len] = tzr->last_char;
-
-                for (size_t i = 1; i <= tzr->buf_len; ++i) {
-                    if (tzr->buf[i] == L'#')
-                        ++tzr->raw_count;
-                    else
-                        return KDL_SEQ_STRING;
-                }
-
-                return KDL_SEQ_RAW_STR;
+        if (tzr->last_char == L'r') {
+            // no '#'s
+            tzr->raw_count = 1;
+
+            return KDL_SEQ_RAW_STR;
+        } else if (
+            tzr->buf_len && tzr->buf[0] == 'r' && tzr->last_char == L'#'
+        ) {
+            // check for 1+ '#'s, the last of which isn't buffered yet
+            tzr->raw_count = 2;
+
+            for (size_t i = 1; i < tzr->buf_len; ++i) {
+                if (tzr->buf[i] == '#')
+                    ++tzr->raw_count;
+                else
+                    return KDL_SEQ_STRING;
             }
-        }
 
-        return KDL_SEQ_STRING;
-    }
+            return KDL_SEQ_RAW_STR;
+        }
 
+        break;
     // multi char mappings
-    if (tzr->state == KDL_SEQ_CHARACTER && tzr->last_char == L'/') {
-        switch (ch) {
-        case L'*':
+    case CC_STAR:
+        if (tzr->last_char == L'/')
             return KDL_SEQ_C_COMM;
-        case L'/':
+
+        break;
+    case CC_SLASH:
+        if (tzr->last_char == L'/')
             return KDL_SEQ_CPP_COMM;
-        case L'-':
-            if (tzr->buf_len == 0)
-                return KDL_SEQ_SD_COMM;
 
-            break;
+        break;
+    case CC_DASH:
+        if (tzr->last_char == L'/' && tzr->buf_len == 0)
+            return KDL_SEQ_SD_COMM;
+
+        break;
+    default:
+        break;
+    }
+
+    return CLASS_STATES[cc];
+}
+
+// makes sure len more bytes and a null fit in the token buffer
+static inline bool reserve_buf(kdl_tokenizer_t *tzr, size_t len) {
+    if (tzr->buf_len + len >= tzr->buf_size) {
+        if (!tzr->soft_overflow) {
+            KDL_ERROR(
+                "tokenizer tried to write past the end of the supplied buffer. "
+                "please supply a larger buffer.\n"
+            );
         }
+
+        // running out of data is what stops kdl_tok_next()
+        tzr->overflowed = true;
+        tzr->utf8.data_idx = tzr->utf8.data_len;
+
+        return false;
     }
 
-    // unidentified, must be identifier or non-string data type
-    return KDL_SEQ_CHARACTER;
+    return true;
+}
+
+static inline void store_char(kdl_tokenizer_t *tzr, kdl_u8ch_t ch) {
+    size_t size = 1;
+
+    if (!reserve_buf(tzr, 4))
+        return;
+
+    if (ch < 0x80)
+        tzr->buf[tzr->buf_len] = ch;
+    else
+        kdl_utf8_to_mbs(ch, tzr->buf + tzr->buf_len, &size);
+
+    tzr->buf_len += size;
+    tzr->buf[tzr->buf_len] = '\0';
+}
+
+static inline size_t u8ch_width(kdl_u8ch_t ch) {
+    return ch < 0x80 ? 1 : ch < 0x800 ? 2 : ch < 0x10000 ? 3 : 4;
+}
+
+// the stream offset of ch, which was just read
+static inline size_t char_offset(kdl_tokenizer_t *tzr, kdl_u8ch_t ch) {
+    return tzr->offset + tzr->utf8.data_idx - u8ch_width(ch);
 }
 
 /*
@@ -130,15 +258,22 @@ static kdl_tokenizer_state_e detect_next_state(
  * up through the tokenizer state machine. anything else is out of scope.
  */
 static void consume_char(kdl_tokenizer_t *tzr, kdl_u8ch_t ch) {
+    KDL_PROFILE_BEGIN(KDL_PROF_CONSUME_CHAR);
+
     // reset flags sent to tok_next()
     tzr->token_break = false;
 
     if (tzr->reset_buf) {
         tzr->reset_buf = false;
         tzr->buf_len = 0;
+
+        // last_char is the first char of the next token
+        if (tzr->spans)
+            tzr->span.start = char_offset(tzr, ch) - u8ch_width(tzr->last_char);
     }
 
     // detect state changes
+    char_class_e cc = char_class(ch);
     kdl_tokenizer_state_e next_state = tzr->state;
     bool force_change = false;
 
@@ -150,18 +285,25 @@ static void consume_char(kdl_tokenizer_t *tzr, kdl_u8ch_t ch) {
         tzr->force_detect = false;
         force_change = true;
 
-        next_state = detect_next_state(tzr, ch);
+        next_state = detect_next_state(tzr, cc);
     } else {
         switch (tzr->state) {
         default:
-            next_state = detect_next_state(tzr, ch);
+            next_state = detect_next_state(tzr, cc);
+
+            break;
+        case KDL_SEQ_CHILD_BEGIN:
+        case KDL_SEQ_CHILD_END:
+            // every brace is its own token, even right after another one
+            next_state = detect_next_state(tzr, cc);
+            force_change = true;
 
             break;
         case KDL_SEQ_C_COMM:
             // track nested comments and stuff
-            if (tzr->last_char == L'/' && ch == L'*') {
+            if (tzr->last_char == L'/' && cc == CC_STAR) {
                 ++tzr->c_comm_level;
-            } else if (tzr->last_char == L'*' && ch == L'/') {
+            } else if (tzr->last_char == L'*' && cc == CC_SLASH) {
                 if (tzr->c_comm_level)
                     --tzr->c_comm_level;
                 else
@@ -170,30 +312,36 @@ static void consume_char(kdl_tokenizer_t *tzr, kdl_u8ch_t ch) {
 
             break;
         case KDL_SEQ_CPP_COMM:
-            if (is_newline(ch))
+            if (cc == CC_NEWLINE)
                 next_state = KDL_SEQ_BREAK;
 
             break;
         case KDL_SEQ_STRING:
-            tzr->force_detect = ch == L'"' && tzr->last_char != L'\\';
+            // an escaped backslash can't escape the closing quote
+            if (tzr->str_escape)
+                tzr->str_escape = false;
+            else if (cc == CC_BACKSLASH)
+                tzr->str_escape = true;
+            else
+                tzr->force_detect = cc == CC_QUOTE;
 
             break;
         case KDL_SEQ_RAW_STR:
             // await matching '#' sequence
-            if (ch == L'"' && tzr->last_char != L'\\') {
+            if (cc == CC_QUOTE && tzr->last_char != L'\\') {
                 tzr->raw_current = 1;
-            } else if (tzr->raw_current && ch == L'#') {
+            } else if (tzr->raw_current && cc == CC_HASH) {
                 ++tzr->raw_current;
             } else {
                 if (tzr->raw_current == tzr->raw_count)
-                    next_state = detect_next_state(tzr, ch);
+                    next_state = detect_next_state(tzr, cc);
 
                 tzr->raw_current = 0;
             }
 
             break;
         case KDL_SEQ_ANNOTATION:
-            tzr->force_detect = ch == L')';
+            tzr->force_detect = cc == CC_PAREN_CLOSE;
 
             break;
         }
@@ -226,6 +374,7 @@ static void consume_char(kdl_tokenizer_t *tzr, kdl_u8ch_t ch) {
             /* fallthru */
         case KDL_SEQ_STRING:
         case KDL_SEQ_RAW_STR:
+        case KDL_SEQ_ANNOTATION:
         // below cases don't return values, but are necessary for proper parsing
         case KDL_SEQ_CHILD_BEGIN:
         case KDL_SEQ_CHILD_END:
@@ -237,21 +386,144 @@ static void consume_char(kdl_tokenizer_t *tzr, kdl_u8ch_t ch) {
         }
     }
 
-    // store token
-    if (tzr->buf_len < (tzr->buf_size - 1)) {
-        tzr->buf[tzr->buf_len] = tzr->last_char;
-        tzr->buf[++tzr->buf_len] = L'\0';
-    } else {
-        KDL_ERROR(
-            "tokenizer tried to write past the end of the supplied buffer. plea"
-            "se supply a larger buffer.\n"
-        );
-    }
+    // store token, comments are never returned so they aren't kept
+    if (tzr->state != KDL_SEQ_C_COMM && tzr->state != KDL_SEQ_CPP_COMM)
+        store_char(tzr, tzr->last_char);
 
     // store state
     tzr->last_state = tzr->state;
     tzr->state = next_state;
     tzr->last_char = ch;
+
+    KDL_PROFILE_END(KDL_PROF_CONSUME_CHAR);
+}
+
+/*
+ * bulk skipping
+ *
+ * most chars inside of strings and comments don't do anything but get
+ * buffered, so runs of them are consumed at once. validation guarantees that
+ * ascii bytes never show up inside of multibyte chars, so runs can be found by
+ * scanning bytes for whatever could end them.
+ */
+#define SKIP_BIT(state) (1 << ((state) - KDL_SEQ_STRING))
+#define SKIP_STRING SKIP_BIT(KDL_SEQ_STRING)
+#define SKIP_RAW_STR SKIP_BIT(KDL_SEQ_RAW_STR)
+#define SKIP_C_COMM SKIP_BIT(KDL_SEQ_C_COMM)
+#define SKIP_CPP_COMM SKIP_BIT(KDL_SEQ_CPP_COMM)
+
+// bytes which end a run in each state. nulls end kdl_tok_next(), so they end
+// everything, and c++ comments stop on the lead bytes of non-ascii newlines
+static const unsigned char SKIP_STOPS[256] = {
+    ['\0'] = SKIP_STRING | SKIP_RAW_STR | SKIP_C_COMM | SKIP_CPP_COMM,
+    ['"'] = SKIP_STRING | SKIP_RAW_STR,
+    ['\\'] = SKIP_STRING,
+    ['*'] = SKIP_C_COMM,
+    ['/'] = SKIP_C_COMM,
+    ['\n'] = SKIP_CPP_COMM,
+    ['\f'] = SKIP_CPP_COMM,
+    ['\r'] = SKIP_CPP_COMM,
+    [0xC2] = SKIP_CPP_COMM,
+    [0xE2] = SKIP_CPP_COMM,
+};
+
+static inline size_t char_width(unsigned char lead) {
+    return lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+}
+
+// decodes a whole, validated char
+static kdl_u8ch_t decode_char(const unsigned char *data) {
+    switch (char_width(data[0])) {
+    case 1:
+        return data[0];
+    case 2:
+        return (data[0] & 0x1F) << 6 | (data[1] & 0x3F);
+    case 3:
+        return (data[0] & 0x0F) << 12 | (data[1] & 0x3F) << 6
+             | (data[2] & 0x3F);
+    default:
+        return (data[0] & 0x07) << 18 | (data[1] & 0x3F) << 12
+             | (data[2] & 0x3F) << 6 | (data[3] & 0x3F);
+    }
+}
+
+// finds the start of the char which ends right before end
+static inline size_t last_char_start(const unsigned char *data, size_t end) {
+    do {
+        --end;
+    } while ((data[end] & 0xC0) == 0x80);
+
+    return end;
+}
+
+/*
+ * has the same effect as calling consume_char() on every char of the next run,
+ * which for a run c1..cn is buffering last_char and c1..cn-1 (strings only)
+ * and then making cn last_char.
+ */
+static void skip_run(kdl_tokenizer_t *tzr) {
+    kdl_utf8_t *utf8 = &tzr->utf8;
+
+    switch (tzr->state) {
+    case KDL_SEQ_STRING:
+        if (tzr->str_escape)
+            return;
+
+        break;
+    case KDL_SEQ_RAW_STR:
+        // '#'s only matter after a quote
+        if (tzr->raw_current)
+            return;
+
+        break;
+    case KDL_SEQ_C_COMM:
+    case KDL_SEQ_CPP_COMM:
+        break;
+    default:
+        return;
+    }
+
+    // only skip once a sequence has settled, and never through a split char
+    if (tzr->last_state != tzr->state || tzr->force_detect || utf8->left_bytes)
+        return;
+
+    const unsigned char *data = utf8->data;
+    unsigned char stop = SKIP_BIT(tzr->state);
+    size_t start = utf8->data_idx, end = start;
+
+    while (end < utf8->data_len && !(SKIP_STOPS[data[end]] & stop))
+        ++end;
+
+    if (end == start)
+        return;
+
+    size_t last = last_char_start(data, end);
+
+    // a char cut off by the end of the data is left for kdl_utf8_next()
+    if (last + char_width(data[last]) > end) {
+        end = last;
+
+        if (end == start)
+            return;
+
+        last = last_char_start(data, end);
+    }
+
+    if (tzr->state == KDL_SEQ_STRING || tzr->state == KDL_SEQ_RAW_STR) {
+        size_t len = last - start;
+
+        store_char(tzr, tzr->last_char);
+
+        if (tzr->overflowed || !reserve_buf(tzr, len))
+            return;
+
+        memcpy(tzr->buf + tzr->buf_len, data + start, len);
+        tzr->buf_len += len;
+        tzr->buf[tzr->buf_len] = '\0';
+    }
+
+    tzr->last_char = decode_char(data + last);
+    utf8->data_idx = end;
 }
 
 /*
@@ -265,23 +537,42 @@ static void consume_char(kdl_tokenizer_t *tzr, kdl_u8ch_t ch) {
  * stream from the state machine (processing line break escapes and slashdashes)
  * and returning fully typed and usable tokens to the user
  */
-bool kdl_tok_next(kdl_tokenizer_t *tzr, kdl_token_t *token) {
+static inline bool next_token(kdl_tokenizer_t *tzr, kdl_token_t *token) {
     kdl_u8ch_t ch;
 
-    while (kdl_utf8_next(&tzr->utf8, &ch) && ch && ch != (kdl_u8ch_t)WEOF) {
+    while (1) {
+        // string and comment bodies are consumed in bulk
+        if (tzr->state >= KDL_SEQ_STRING)
+            skip_run(tzr);
+
+        if (!kdl_utf8_next(&tzr->utf8, &ch) || !ch || ch == (kdl_u8ch_t)WEOF)
+            break;
+
         consume_char(tzr, ch);
 
+        // the brace which ends a skipped block is skipped too
+        bool skipping = tzr->skip_depth > 0;
+
         // line break and node slashdash state machine
         switch (tzr->last_state) {
         case KDL_SEQ_CHILD_BEGIN:
             ++tzr->sd_node_level;
             tzr->expect_node = true;
 
+            // braces are only seen once the char after them is read
+            if (skipping)
+                ++tzr->skip_depth;
+            else
+                tzr->brace_offset = char_offset(tzr, ch) - 1;
+
             break;
         case KDL_SEQ_CHILD_END:
             --tzr->sd_node_level;
             tzr->expect_node = true;
 
+            if (skipping && !--tzr->skip_depth)
+                tzr->skip_end = char_offset(tzr, ch) - 1;
+
             break;
         case KDL_SEQ_BREAK:
             if (tzr->break_escape)
@@ -316,13 +607,34 @@ bool kdl_tok_next(kdl_tokenizer_t *tzr, kdl_token_t *token) {
         // tokens
         if (tzr->token_break && !tzr->sd_node) {
             if (tzr->sd_value) {
-                // slashdash values until they aren't prop names
-                if (tzr->state != KDL_SEQ_ASSIGNMENT)
+                // slashdash values until they aren't prop names or annotations
+                if (
+                    tzr->state != KDL_SEQ_ASSIGNMENT
+                    && tzr->last_state != KDL_SEQ_ANNOTATION
+                ) {
                     tzr->sd_value = false;
-            } else {
+                }
+            } else if (skipping) {
+                // names still have to end expect_node like generate_token()
+                if (
+                    tzr->last_state == KDL_SEQ_STRING
+                    || tzr->last_state == KDL_SEQ_RAW_STR
+                    || tzr->last_state == KDL_SEQ_CHARACTER
+                ) {
+                    tzr->expect_node = false;
+                }
+            } else if (!tzr->overflowed) {
                 // valid non-slashdashed token; type, parse, and pass
                 generate_token(tzr, token);
 
+                if (tzr->spans) {
+                    tzr->span.end = char_offset(tzr, ch);
+
+                    // the buffer starts over at a raw string's quote
+                    if (tzr->last_state == KDL_SEQ_RAW_STR)
+                        tzr->span.start -= tzr->raw_count;
+                }
+
                 return true;
             }
         }
@@ -330,3 +642,46 @@ bool kdl_tok_next(kdl_tokenizer_t *tzr, kdl_token_t *token) {
 
     return false;
 }
+
+bool kdl_tok_next(kdl_tokenizer_t *tzr, kdl_token_t *token) {
+    return next_token(tzr, token);
+}
+
+size_t kdl_tok_next_batch(kdl_tokenizer_t *tzr, kdl_token_batch_t *batch) {
+    // a token's text is never longer than the raw text in the tokenizer buffer
+    if (batch->bytes_size < tzr->buf_size) {
+        KDL_ERROR(
+            "token batch bytes (%zu) are smaller than the tokenizer buffer"
+            " (%zu).\n", batch->bytes_size, tzr->buf_size
+        );
+    }
+
+    batch->num_tokens = batch->bytes_len = 0;
+
+    while (
+        batch->num_tokens < batch->max_tokens
+        && batch->bytes_size - batch->bytes_len >= tzr->buf_size
+    ) {
+        kdl_token_t *token = &batch->tokens[batch->num_tokens];
+
+        // tokens without text leave it empty
+        token->string = batch->bytes + batch->bytes_len;
+        token->string[0] = '\0';
+        token->str_len = 0;
+
+        if (!next_token(tzr, token))
+            break;
+
+        if (batch->spans)
+            batch->spans[batch->num_tokens] = tzr->span;
+
+        batch->bytes_len += token->str_len + 1;
+        ++batch->num_tokens;
+    }
+
+    return batch->num_tokens;
+}
+
+void kdl_tok_skip_children(kdl_tokenizer_t *tzr) {
+    tzr->skip_depth = 1;
+}
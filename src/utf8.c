@@ -1,18 +1,57 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 
+#include <cuddle/meta.h>
 #include <cuddle/utf8.h>
 
+// build with KDL_NO_SIMD to always validate with the scalar fallback
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))\
+ && !defined(KDL_NO_SIMD)
+#define KDL_UTF8_SSSE3
+#include <tmmintrin.h>
+#endif
+
 void kdl_utf8_make(kdl_utf8_t *state) {
     *state = (kdl_utf8_t){0};
 }
 
-void kdl_utf8_feed(kdl_utf8_t *state, char *data, size_t length) {
-    state->data = (unsigned char *)data;
+bool kdl_utf8_feed(kdl_utf8_t *state, const char *data, size_t length) {
+    size_t offset;
+
+    state->data_len = state->data_idx = 0;
+
+    if (state->error.invalid)
+        return false;
+
+    kdl_utf8_validator_t *v = &state->validator;
+
+    if (!length && v->needed) {
+        // the stream ended partway through a char
+        state->error = (kdl_utf8_error_t){
+            .invalid = true,
+            .offset = v->offset - (v->width - v->needed)
+        };
+
+        return false;
+    }
+
+    if (!kdl_utf8_validate(v, data, length, &offset)) {
+        state->error = (kdl_utf8_error_t){
+            .invalid = true,
+            .offset = offset
+        };
+
+        return false;
+    }
+
+    state->data = (const unsigned char *)data;
     state->data_len = length;
-    state->data_idx = 0;
+
+    return true;
 }
 
-bool kdl_utf8_next(kdl_utf8_t *state, kdl_u8ch_t *out_ch) {
+static inline bool utf8_next(kdl_utf8_t *state, kdl_u8ch_t *out_ch) {
     kdl_u8ch_t ch;
     int mb_bytes;
 
@@ -21,6 +60,9 @@ bool kdl_utf8_next(kdl_utf8_t *state, kdl_u8ch_t *out_ch) {
         ch = state->leftover;
         mb_bytes = state->left_bytes;
         state->left_bytes = 0;
+    } else if (state->data_idx >= state->data_len) {
+        // nothing left to parse
+        return false;
     } else {
         // parse first byte
         kdl_u8ch_t current = state->data[state->data_idx++];
@@ -59,6 +101,304 @@ bool kdl_utf8_next(kdl_utf8_t *state, kdl_u8ch_t *out_ch) {
     return true;
 }
 
+bool kdl_utf8_next(kdl_utf8_t *state, kdl_u8ch_t *out_ch) {
+    KDL_PROFILE_BEGIN(KDL_PROF_UTF8_DECODE);
+
+    bool finished = utf8_next(state, out_ch);
+
+    KDL_PROFILE_END(KDL_PROF_UTF8_DECODE);
+
+    return finished;
+}
+
+/*
+ * validation
+ *
+ * whole chars are validated in bulk, with ssse3 when the cpu has it. chars
+ * which are split between chunks are finished one byte at a time, which also
+ * finds the exact offset of an error once a block is known to be bad.
+ */
+// advances validator by one byte, returns false on an invalid byte
+static inline bool validate_byte(kdl_utf8_validator_t *v, unsigned char byte) {
+    if (v->needed) {
+        if (byte < v->lo || byte > v->hi)
+            return false;
+
+        v->lo = 0x80;
+        v->hi = 0xBF;
+        --v->needed;
+    } else if (byte >= 0x80) {
+        // the second byte is narrowed to rule out overlongs, surrogates and
+        // codepoints past U+10FFFF
+        v->lo = 0x80;
+        v->hi = 0xBF;
+
+        if (byte < 0xC2) {
+            return false;
+        } else if (byte < 0xE0) {
+            v->needed = 1;
+        } else if (byte < 0xF0) {
+            v->needed = 2;
+
+            if (byte == 0xE0)
+                v->lo = 0xA0;
+            else if (byte == 0xED)
+                v->hi = 0x9F;
+        } else if (byte < 0xF5) {
+            v->needed = 3;
+
+            if (byte == 0xF0)
+                v->lo = 0x90;
+            else if (byte == 0xF4)
+                v->hi = 0x8F;
+        } else {
+            return false;
+        }
+
+        v->width = v->needed + 1;
+    }
+
+    return true;
+}
+
+// returns index of the first bad byte, or len
+static size_t validate_scalar(
+    kdl_utf8_validator_t *v, const unsigned char *data, size_t len
+) {
+    size_t i = 0;
+
+    while (i < len) {
+        // skip ascii a word at a time
+        if (!v->needed && len - i >= 8) {
+            uint64_t word;
+
+            memcpy(&word, data + i, 8);
+
+            if (!(word & 0x8080808080808080ull)) {
+                i += 8;
+
+                continue;
+            }
+        }
+
+        if (!validate_byte(v, data[i]))
+            return i;
+
+        ++i;
+    }
+
+    return len;
+}
+
+#ifdef KDL_UTF8_SSSE3
+/*
+ * the lookup algorithm from keiser and lemire, "validating utf-8 in less than
+ * one instruction per byte". every error shows up in some pair of adjacent
+ * bytes, so three nibble lookups over (previous byte, current byte) are and'ed
+ * together and anything left over is an error. the 3rd and 4th bytes of long
+ * chars are checked separately.
+ */
+#define TOO_SHORT      (1 << 0) // lead or ascii followed by a lead or ascii
+#define TOO_LONG       (1 << 1) // ascii followed by a continuation
+#define OVERLONG_3     (1 << 2)
+#define TOO_LARGE      (1 << 3)
+#define SURROGATE      (1 << 4)
+#define OVERLONG_2     (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4     (1 << 6)
+#define TWO_CONTS      (1 << 7) // continuation followed by a continuation
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#define LOAD_TABLE(table) _mm_loadu_si128((const __m128i *)(table))
+
+static const unsigned char BYTE_1_HIGH[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+static const unsigned char BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+static const unsigned char BYTE_2_HIGH[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000
+        | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+// lead bytes which are too close to the end of a block to be finished
+static const unsigned char INCOMPLETE_MAX[16] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+__attribute__((target("ssse3")))
+static bool validate_ssse3(const unsigned char *data, size_t len) {
+    const __m128i byte_1_high_table = LOAD_TABLE(BYTE_1_HIGH);
+    const __m128i byte_1_low_table = LOAD_TABLE(BYTE_1_LOW);
+    const __m128i byte_2_high_table = LOAD_TABLE(BYTE_2_HIGH);
+    const __m128i incomplete_max = LOAD_TABLE(INCOMPLETE_MAX);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    __m128i prev = _mm_setzero_si128(), prev_incomplete = prev;
+    __m128i error = prev;
+
+    for (size_t i = 0; i < len; i += 16) {
+        __m128i input;
+
+        if (len - i >= 16) {
+            input = _mm_loadu_si128((const __m128i *)(data + i));
+        } else {
+            // the zero padding is ascii, so a truncated last char is too short
+            unsigned char tail[16] = {0};
+
+            memcpy(tail, data + i, len - i);
+            input = _mm_loadu_si128((const __m128i *)tail);
+        }
+
+        if (!_mm_movemask_epi8(input)) {
+            // ascii block, only a char left unfinished by the last one is bad
+            error = _mm_or_si128(error, prev_incomplete);
+            prev = input;
+            prev_incomplete = _mm_setzero_si128();
+
+            continue;
+        }
+
+        __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+        __m128i byte_1_high = _mm_shuffle_epi8(
+            byte_1_high_table, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)
+        );
+        __m128i byte_1_low = _mm_shuffle_epi8(
+            byte_1_low_table, _mm_and_si128(prev1, nibble)
+        );
+        __m128i byte_2_high = _mm_shuffle_epi8(
+            byte_2_high_table, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)
+        );
+        __m128i special = _mm_and_si128(
+            _mm_and_si128(byte_1_high, byte_1_low), byte_2_high
+        );
+
+        // 3rd and 4th bytes must be continuations, and nothing else may be
+        __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+        __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+        __m128i must_be_cont = _mm_and_si128(
+            _mm_or_si128(
+                _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80)),
+                _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80))
+            ),
+            _mm_set1_epi8((char)0x80)
+        );
+
+        error = _mm_or_si128(error, _mm_xor_si128(must_be_cont, special));
+        prev = input;
+        prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+    }
+
+    error = _mm_or_si128(error, prev_incomplete);
+
+    return _mm_movemask_epi8(
+        _mm_cmpeq_epi8(error, _mm_setzero_si128())
+    ) == 0xFFFF;
+}
+#endif
+
+// validates whole chars starting from a fresh state
+static bool validate_bulk(const unsigned char *data, size_t len) {
+#ifdef KDL_UTF8_SSSE3
+    if (__builtin_cpu_supports("ssse3"))
+        return validate_ssse3(data, len);
+#endif
+
+    kdl_utf8_validator_t v = {0};
+
+    return validate_scalar(&v, data, len) == len && !v.needed;
+}
+
+// length of data up to a char which isn't finished by the end of it
+static size_t complete_len(const unsigned char *data, size_t len) {
+    for (size_t back = 1; back <= 3 && back <= len; ++back) {
+        unsigned char byte = data[len - back];
+
+        // skip continuations to find the lead
+        if ((byte & 0xC0) == 0x80)
+            continue;
+
+        size_t width = byte < 0xC0 ? 1 : byte < 0xE0 ? 2 : byte < 0xF0 ? 3 : 4;
+
+        return width > back ? len - back : len;
+    }
+
+    return len;
+}
+
+// returns index of the first bad byte, or len
+static size_t validate_chunk(
+    kdl_utf8_validator_t *v, const unsigned char *data, size_t len
+) {
+    size_t i = 0;
+
+    // finish a char left over from the last chunk
+    while (i < len && v->needed)
+        if (!validate_byte(v, data[i++]))
+            return i - 1;
+
+    size_t end = i + complete_len(data + i, len - i);
+
+    if (!validate_bulk(data + i, end - i)) {
+        // find where the error is
+        size_t bad = validate_scalar(v, data + i, end - i);
+
+        if (bad < end - i)
+            return i + bad;
+    }
+
+    // start a char which the next chunk finishes
+    return end + validate_scalar(v, data + end, len - end);
+}
+
+bool kdl_utf8_validate(
+    kdl_utf8_validator_t *v, const char *data, size_t length,
+    size_t *out_offset
+) {
+    KDL_PROFILE_BEGIN(KDL_PROF_UTF8_VALIDATE);
+
+    size_t bad = validate_chunk(v, (const unsigned char *)data, length);
+
+    // on success this is the end of the chunk
+    *out_offset = v->offset + bad;
+    v->offset += length;
+
+    KDL_PROFILE_END(KDL_PROF_UTF8_VALIDATE);
+
+    return bad == length;
+}
+
 void kdl_utf8_copy(kdl_u8ch_t *dst, kdl_u8ch_t *src) {
     while ((*dst++ = *src++))
         ;
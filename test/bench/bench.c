@@ -0,0 +1,365 @@
+/*
+ * parser benchmark. runs each requested mode over each corpus file in a forked
+ * child so that peak rss is measured per run, then prints one json object per
+ * line to stdout for regression tracking.
+ *
+ * usage: bench [-m tokenize,sax,dom,lazy] [-n iterations] file...
+ *
+ * modes:
+ * - tokenize: kdl_tok_next() over the whole input, tokens are discarded
+ * - sax: tokens are dispatched to event handlers without building a tree
+ * - dom: kdl_document_load_file() into preallocated document buffers, memory
+ *   numbers come from kdl_document_stats()
+ * - lazy: dom with lazy_values, nothing is read back so values stay raw
+ */
+
+/*
+ * built with KDL_AMALGAMATION, the whole library is compiled into this file so
+ * it can inline into the benchmark, see compare.sh. it goes first since it
+ * sets feature macros, and its header guards make the include below a no-op.
+ */
+#ifdef KDL_AMALGAMATION
+#include "cuddle.c"
+#endif
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <cuddle/cuddle.h>
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
+
+#define READ_SIZE (64 * 1024)
+#define TOKEN_SIZE 4096
+// blocks in each dom table, so dom runs fit bigger corpora
+#define DOM_BLOCKS 65535
+
+typedef enum bench_mode {
+    MODE_TOKENIZE,
+    MODE_SAX,
+    MODE_DOM,
+    MODE_LAZY
+} bench_mode_e;
+
+static const char *MODE_NAMES[] = { "tokenize", "sax", "dom", "lazy" };
+
+// what a child reports back to the parent through a pipe
+typedef struct bench_result {
+    int ok;
+    double seconds; // best of all iterations
+    size_t tokens;
+    long peak_rss_kb;
+
+    // dom only
+    kdl_document_stats_t mem;
+
+    // summed over all iterations, only recorded with KDL_PROFILE
+    kdl_profile_t profile;
+} bench_result_t;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * sax-style consumer, the kind of work a streaming user would do per event
+ */
+typedef struct sax_state {
+    size_t nodes, props, values, depth, max_depth;
+    unsigned long checksum;
+} sax_state_t;
+
+static void sax_string(sax_state_t *sax, const char *str, size_t len) {
+    for (size_t i = 0; i < len; ++i)
+        sax->checksum = sax->checksum * 31 + (unsigned char)str[i];
+}
+
+static void sax_event(sax_state_t *sax, kdl_token_t *token) {
+    if (token->node) {
+        ++sax->nodes;
+        sax_string(sax, token->string, token->str_len);
+    } else if (token->property) {
+        ++sax->props;
+        sax_string(sax, token->string, token->str_len);
+    } else {
+        switch (token->type) {
+        case KDL_TOK_CHILD_BEGIN:
+            if (++sax->depth > sax->max_depth)
+                sax->max_depth = sax->depth;
+
+            break;
+        case KDL_TOK_CHILD_END:
+            --sax->depth;
+
+            break;
+        case KDL_TOK_ANNOTATION:
+            sax_string(sax, token->string, token->str_len);
+
+            break;
+        case KDL_TOK_STRING:
+            sax_string(sax, token->string, token->str_len);
+            /* fallthru */
+        default:
+            ++sax->values;
+
+            break;
+        }
+    }
+}
+
+static size_t run_stream(const char *filename, bench_mode_e mode) {
+    FILE *fp = fopen(filename, "rb");
+
+    if (!fp) {
+        fprintf(stderr, "couldn't open %s\n", filename);
+        exit(-1);
+    }
+
+    static char read_buf[READ_SIZE], tzr_buf[TOKEN_SIZE], tok_buf[TOKEN_SIZE];
+
+    kdl_tokenizer_t tzr;
+    kdl_token_t token;
+    sax_state_t sax = {0};
+    size_t tokens = 0;
+    bool finished = false;
+
+    kdl_tokenizer_make(&tzr, tzr_buf, ARRAY_SIZE(tzr_buf));
+    kdl_token_make(&token, tok_buf);
+
+    while (!finished) {
+        size_t read = fread(read_buf, 1, sizeof(read_buf), fp);
+
+        if (read) {
+            kdl_tok_feed(&tzr, read_buf, read);
+        } else {
+            kdl_tok_finish(&tzr);
+            finished = true;
+        }
+
+        while (kdl_tok_next(&tzr, &token)) {
+            ++tokens;
+
+            if (mode == MODE_SAX)
+                sax_event(&sax, &token);
+        }
+    }
+
+    fclose(fp);
+
+    // keep the sax work from being optimized out
+    if (mode == MODE_SAX && sax.checksum == 1)
+        fprintf(stderr, "unlikely checksum\n");
+
+    return tokens;
+}
+
+static void run_dom(
+    const char *filename, kdl_document_buffers_t *bufs, bool lazy,
+    bench_result_t *res
+) {
+    kdl_document_t doc;
+
+    kdl_document_make(&doc, bufs);
+    doc.lazy_values = lazy;
+    kdl_document_load_file(&doc, filename);
+
+    kdl_document_stats(&doc, &res->mem);
+}
+
+static void run_child(
+    const char *filename, bench_mode_e mode, int iterations, int fd
+) {
+    bench_result_t res = { .seconds = -1.0 };
+    kdl_document_buffers_t bufs = {
+        .num_node_blocks = DOM_BLOCKS,
+        .data_block_size = 16 * 1024,
+        .num_data_blocks = DOM_BLOCKS,
+    };
+
+    if (mode == MODE_DOM || mode == MODE_LAZY) {
+        bufs.node_blocks = calloc(bufs.num_node_blocks, sizeof(kdl_node_t));
+        bufs.data_blocks = calloc(bufs.num_data_blocks, bufs.data_block_size);
+        bufs.node_meta = calloc(
+            KDL_HTABLE_META_LEN(bufs.num_node_blocks), sizeof(unsigned)
+        );
+        bufs.data_meta = calloc(
+            KDL_HTABLE_META_LEN(bufs.num_data_blocks), sizeof(unsigned)
+        );
+    }
+
+    for (int i = 0; i < iterations; ++i) {
+        double start = now();
+
+        if (mode == MODE_DOM || mode == MODE_LAZY)
+            run_dom(filename, &bufs, mode == MODE_LAZY, &res);
+        else
+            res.tokens = run_stream(filename, mode);
+
+        double elapsed = now() - start;
+
+        if (res.seconds < 0.0 || elapsed < res.seconds)
+            res.seconds = elapsed;
+    }
+
+    kdl_profile_read(&res.profile);
+
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    res.peak_rss_kb = usage.ru_maxrss;
+    res.ok = 1;
+
+    if (write(fd, &res, sizeof(res)) != sizeof(res))
+        exit(-1);
+
+    exit(0);
+}
+
+static bench_result_t run(const char *filename, bench_mode_e mode, int iters) {
+    bench_result_t res = {0};
+    int fds[2];
+
+    if (pipe(fds)) {
+        perror("pipe");
+        exit(-1);
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        close(fds[0]);
+        run_child(filename, mode, iters, fds[1]);
+    }
+
+    close(fds[1]);
+
+    // a failed parse exits the child early, leaving res.ok at 0
+    if (read(fds[0], &res, sizeof(res)) != sizeof(res))
+        res.ok = 0;
+
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    return res;
+}
+
+static void report(
+    const char *filename, bench_mode_e mode, size_t bytes, size_t tokens,
+    bench_result_t *res
+) {
+    printf(
+        "{\"corpus\":\"%s\",\"mode\":\"%s\",\"bytes\":%zu,\"ok\":%s",
+        filename, MODE_NAMES[mode], bytes, res->ok ? "true" : "false"
+    );
+
+    if (res->ok) {
+        double mb = bytes / (1024.0 * 1024.0);
+
+        printf(
+            ",\"seconds\":%.6f,\"mb_per_s\":%.2f,\"tokens\":%zu"
+            ",\"tokens_per_s\":%.0f,\"peak_rss_kb\":%ld",
+            res->seconds, mb / res->seconds, tokens, tokens / res->seconds,
+            res->peak_rss_kb
+        );
+
+        if (mode == MODE_DOM || mode == MODE_LAZY) {
+            kdl_htable_stats_t *nodes = &res->mem.nodes, *data = &res->mem.data;
+
+            printf(
+                ",\"node_blocks\":%zu,\"data_blocks\":%zu"
+                ",\"allocs\":%zu,\"bytes_requested\":%zu"
+                ",\"bytes_reserved\":%zu,\"bytes_wasted\":%zu",
+                nodes->max_used, data->max_used,
+                nodes->num_allocs + data->num_allocs,
+                nodes->bytes_requested + data->bytes_requested,
+                nodes->bytes_reserved + data->bytes_reserved,
+                nodes->bytes_wasted + data->bytes_wasted
+            );
+        }
+
+#ifdef KDL_PROFILE
+        printf(",\"profile\":{");
+
+        for (size_t i = 0; i < KDL_PROF_NUM_STAGES; ++i) {
+            printf(
+                "%s\"%s\":{\"cycles\":%llu,\"events\":%llu}",
+                i ? "," : "", KDL_PROFILE_STAGES[i],
+                res->profile.cycles[i], res->profile.events[i]
+            );
+        }
+
+        printf("}");
+#endif
+    }
+
+    printf("}\n");
+    fflush(stdout);
+}
+
+static void usage(void) {
+    fprintf(
+        stderr,
+        "usage: bench [-m tokenize,sax,dom,lazy] [-n iterations] file...\n"
+    );
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    bool modes[ARRAY_SIZE(MODE_NAMES)] = { true, true, true, true };
+    int iterations = 3;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+        if (i + 1 >= argc)
+            usage();
+
+        if (!strcmp(argv[i], "-n")) {
+            iterations = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-m")) {
+            for (size_t j = 0; j < ARRAY_SIZE(MODE_NAMES); ++j)
+                modes[j] = strstr(argv[i + 1], MODE_NAMES[j]) != NULL;
+        } else {
+            usage();
+        }
+    }
+
+    if (i == argc || iterations < 1)
+        usage();
+
+    for (; i < argc; ++i) {
+        struct stat st;
+
+        if (stat(argv[i], &st)) {
+            perror(argv[i]);
+            continue;
+        }
+
+        // the tokenizer run counts tokens for the other modes
+        bench_result_t tok_res = run(argv[i], MODE_TOKENIZE, iterations);
+
+        for (size_t j = 0; j < ARRAY_SIZE(MODE_NAMES); ++j) {
+            if (!modes[j])
+                continue;
+
+            bench_result_t res = j == MODE_TOKENIZE
+                ? tok_res
+                : run(argv[i], j, iterations);
+
+            report(argv[i], j, st.st_size, tok_res.tokens, &res);
+        }
+    }
+
+    return 0;
+}
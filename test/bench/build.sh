@@ -0,0 +1,17 @@
+# builds the corpus generator and benchmark runner into bin/
+LIB_SOURCES="../src/*.c"
+FLAGS="-lm -pthread -std=c99 -Wall -Wextra -Wpedantic -O3 -DNDEBUG"
+
+# `PROFILE=1 ./bench/build.sh` adds per-stage counters to the results
+if [ -n "$PROFILE" ]; then
+    FLAGS="$FLAGS -DKDL_PROFILE"
+fi
+INCLUDES="-I../include"
+
+mkdir -p bin
+
+echo "COMPILING bench/gen.c"
+LC_ALL=C gcc bench/gen.c $FLAGS -o bin/gen
+
+echo "COMPILING bench/bench.c"
+LC_ALL=C gcc bench/bench.c $LIB_SOURCES $FLAGS $INCLUDES -o bin/bench
@@ -0,0 +1,58 @@
+# benchmarks cuddle built each way it can be distributed, to compare how much
+# inlining across sources is worth:
+#
+# - shared: a shared library, as `make` builds it
+# - lto: the shared library with link time optimization
+# - static: a static library of lto objects, linked into the benchmark with lto
+# - amalgamated: the amalgamation compiled together with the benchmark
+#
+# takes the corpus size like run.sh, and bench options after it. results are
+# json lines on stdout, each with the build it came from.
+SIZE=${1:-1M}
+shift
+KINDS="deep wide string escape number comment unicode"
+CORPUS_DIR="files/bench"
+BUILDS="shared lto static amalgamated"
+
+LIB_SOURCES="$(pwd)/../src/*.c"
+FLAGS="-lm -pthread -std=c99 -O3 -DNDEBUG"
+INCLUDES="-I$(pwd)/../include"
+OUT="bin/compare"
+
+set -e
+mkdir -p $OUT/obj $CORPUS_DIR
+
+echo "COMPILING shared" >&2
+gcc -shared -fPIC $LIB_SOURCES $FLAGS $INCLUDES -o $OUT/libshared.so
+gcc bench/bench.c $FLAGS $INCLUDES -L$OUT -lshared -Wl,-rpath,$OUT \
+    -o $OUT/shared
+
+echo "COMPILING lto" >&2
+gcc -shared -fPIC -flto=auto $LIB_SOURCES $FLAGS $INCLUDES -o $OUT/liblto.so
+gcc bench/bench.c $FLAGS $INCLUDES -L$OUT -llto -Wl,-rpath,$OUT -o $OUT/lto
+
+echo "COMPILING static" >&2
+rm -f $OUT/obj/*.o $OUT/libstatic.a
+(cd $OUT/obj && gcc -c -flto=auto -ffat-lto-objects $LIB_SOURCES $FLAGS \
+    $INCLUDES)
+gcc-ar rcs $OUT/libstatic.a $OUT/obj/*.o
+gcc -flto=auto bench/bench.c $FLAGS $INCLUDES $OUT/libstatic.a \
+    -o $OUT/static
+
+echo "COMPILING amalgamated" >&2
+../tools/amalgamate.sh $OUT/amalgamation
+gcc bench/bench.c $FLAGS $INCLUDES \
+    -I$OUT/amalgamation -DKDL_AMALGAMATION -o $OUT/amalgamated
+
+for KIND in $KINDS; do
+    FILE="$CORPUS_DIR/$KIND-$SIZE.kdl"
+
+    if [ ! -f $FILE ]; then
+        echo "GENERATING $FILE" >&2
+        ./bin/gen $KIND $SIZE > $FILE
+    fi
+
+    for BUILD in $BUILDS; do
+        ./$OUT/$BUILD "$@" $FILE | sed "s/^{/{\"build\":\"$BUILD\",/"
+    done
+done
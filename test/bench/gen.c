@@ -0,0 +1,261 @@
+/*
+ * deterministic kdl corpus generator for benchmarking.
+ *
+ * usage: gen <kind> <size>[K|M|G] [-s seed] [-d depth] [-w width]
+ *
+ * writes a document of roughly <size> bytes to stdout. the same arguments
+ * always produce the same bytes, so corpora can be regenerated instead of
+ * checked in.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef struct gen {
+    uint64_t rng;
+    size_t written, target;
+    int depth, width;
+} gen_t;
+
+// xorshift64*, good enough and identical everywhere
+static uint64_t next_rand(gen_t *g) {
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+
+    return g->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t rand_range(gen_t *g, size_t lo, size_t hi) {
+    return lo + next_rand(g) % (hi - lo + 1);
+}
+
+static void emit(gen_t *g, const char *str) {
+    size_t len = strlen(str);
+
+    fwrite(str, 1, len, stdout);
+    g->written += len;
+}
+
+static void emitf(gen_t *g, const char *fmt, ...) {
+    char buf[512];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    emit(g, buf);
+}
+
+static const char *WORDS[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+    "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+    "et", "dolore", "magna", "aliqua", "enim", "ad", "minim", "veniam"
+};
+
+static const char *UNICODE_WORDS[] = {
+    "caf\xC3\xA9", "\xC3\xBC" "ber", "na\xC3\xAF" "ve", "\xCE\xB1\xCE\xB2\xCE\xB3",
+    "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82",
+    "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E", "\xED\x95\x9C\xEA\xB8\x80",
+    "\xF0\x9F\x98\x80", "\xF0\x9F\x9A\x80\xF0\x9F\x8C\x8D"
+};
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
+
+static void emit_words(gen_t *g, const char **words, size_t num, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (i)
+            emit(g, " ");
+
+        emit(g, words[next_rand(g) % num]);
+    }
+}
+
+/*
+ * each generator emits one self-contained chunk of the document. main() calls
+ * it until the target size is reached.
+ */
+
+static void gen_deep(gen_t *g) {
+    for (int i = 0; i < g->depth; ++i)
+        emitf(g, "%*snode%d %d {\n", i * 2, "", i, i);
+
+    emitf(g, "%*sleaf \"bottom\"\n", g->depth * 2, "");
+
+    for (int i = g->depth - 1; i >= 0; --i)
+        emitf(g, "%*s}\n", i * 2, "");
+}
+
+static void gen_wide(gen_t *g) {
+    emit(g, "parent {\n");
+
+    for (int i = 0; i < g->width; ++i) {
+        emitf(
+            g, "    child%d %d %d key%d=%d flag=true\n",
+            i, i, (int)rand_range(g, 0, 1000), i, (int)rand_range(g, 0, 1000)
+        );
+    }
+
+    emit(g, "}\n");
+}
+
+static void gen_string(gen_t *g) {
+    emit(g, "text \"");
+    emit_words(g, WORDS, ARRAY_SIZE(WORDS), rand_range(g, 4, 120));
+    emit(g, "\" title=\"");
+    emit_words(g, WORDS, ARRAY_SIZE(WORDS), rand_range(g, 1, 8));
+    emit(g, "\"\n");
+}
+
+static void gen_escape(gen_t *g) {
+    static const char *ESCAPES[] = {
+        "\\n", "\\t", "\\\"", "\\\\", "\\r", "\\b", "\\f", "\\/", "\\u00E9"
+    };
+
+    emit(g, "esc \"");
+
+    for (size_t i = rand_range(g, 4, 60); i; --i) {
+        emit(g, WORDS[next_rand(g) % ARRAY_SIZE(WORDS)]);
+        emit(g, ESCAPES[next_rand(g) % ARRAY_SIZE(ESCAPES)]);
+    }
+
+    emit(g, "\"\n");
+}
+
+static void gen_number(gen_t *g) {
+    emit(g, "nums");
+
+    for (size_t i = rand_range(g, 4, 16); i; --i) {
+        switch (next_rand(g) % 6) {
+        case 0:
+            emitf(g, " %d", (int)rand_range(g, 0, 1000000));
+            break;
+        case 1:
+            emitf(
+                g, " -%d.%d",
+                (int)rand_range(g, 0, 10000), (int)rand_range(g, 0, 99999)
+            );
+            break;
+        case 2:
+            emitf(g, " 0x%X", (unsigned)rand_range(g, 0, 0xFFFFFF));
+            break;
+        case 3:
+            emitf(g, " 0o%o", (unsigned)rand_range(g, 0, 077777));
+            break;
+        case 4:
+            emitf(g, " 0b%s", (next_rand(g) & 1) ? "1011_0110" : "1111");
+            break;
+        case 5:
+            emitf(
+                g, " %d.%de%d",
+                (int)rand_range(g, 1, 9), (int)rand_range(g, 0, 999),
+                (int)rand_range(g, 0, 20)
+            );
+            break;
+        }
+    }
+
+    emitf(g, " scale=%d.5\n", (int)rand_range(g, 0, 100));
+}
+
+static void gen_comment(gen_t *g) {
+    emit(g, "// ");
+    emit_words(g, WORDS, ARRAY_SIZE(WORDS), rand_range(g, 4, 20));
+    emit(g, "\n/*\n * ");
+    emit_words(g, WORDS, ARRAY_SIZE(WORDS), rand_range(g, 10, 60));
+    emit(g, "\n */\n");
+    emitf(g, "node /* inline */ %d /-%d\n", (int)rand_range(g, 0, 100), 1);
+    emit(g, "/-skipped \"");
+    emit_words(g, WORDS, ARRAY_SIZE(WORDS), rand_range(g, 1, 10));
+    emit(g, "\" {\n    inner 1\n}\n");
+}
+
+static void gen_unicode(gen_t *g) {
+    emit(g, UNICODE_WORDS[next_rand(g) % ARRAY_SIZE(UNICODE_WORDS)]);
+    // U+3000 ideographic space is kdl whitespace
+    emit(g, "\xE3\x80\x80\"");
+    emit_words(g, UNICODE_WORDS, ARRAY_SIZE(UNICODE_WORDS), rand_range(g, 2, 40));
+    emit(g, "\" name=\"");
+    emit_words(g, UNICODE_WORDS, ARRAY_SIZE(UNICODE_WORDS), rand_range(g, 1, 4));
+    emit(g, "\"\n");
+}
+
+typedef struct gen_kind {
+    const char *name;
+    void (*generate)(gen_t *);
+} gen_kind_t;
+
+static const gen_kind_t KINDS[] = {
+    { "deep", gen_deep },
+    { "wide", gen_wide },
+    { "string", gen_string },
+    { "escape", gen_escape },
+    { "number", gen_number },
+    { "comment", gen_comment },
+    { "unicode", gen_unicode },
+};
+
+static size_t parse_size(const char *str) {
+    char *end;
+    size_t size = strtoull(str, &end, 10);
+
+    switch (*end) {
+    case 'k': case 'K': return size << 10;
+    case 'm': case 'M': return size << 20;
+    case 'g': case 'G': return size << 30;
+    default: return size;
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: gen <kind> <size>[K|M|G] [-s seed] [-d depth] [-w width]\n");
+    fprintf(stderr, "kinds:");
+
+    for (size_t i = 0; i < ARRAY_SIZE(KINDS); ++i)
+        fprintf(stderr, " %s", KINDS[i].name);
+
+    fprintf(stderr, "\n");
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3)
+        usage();
+
+    const gen_kind_t *kind = NULL;
+
+    for (size_t i = 0; i < ARRAY_SIZE(KINDS); ++i)
+        if (!strcmp(argv[1], KINDS[i].name))
+            kind = &KINDS[i];
+
+    if (!kind)
+        usage();
+
+    gen_t g = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+        .target = parse_size(argv[2]),
+        .depth = 200, // stays under the dom's parent stack limit
+        .width = 200
+    };
+
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-s"))
+            g.rng ^= strtoull(argv[i + 1], NULL, 10) * 0xBF58476D1CE4E5B9ULL;
+        else if (!strcmp(argv[i], "-d"))
+            g.depth = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-w"))
+            g.width = atoi(argv[i + 1]);
+        else
+            usage();
+    }
+
+    emitf(&g, "// cuddle bench corpus: %s %s\n", kind->name, argv[2]);
+
+    while (g.written < g.target)
+        kind->generate(&g);
+
+    return 0;
+}
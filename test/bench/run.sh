@@ -0,0 +1,18 @@
+# generates every corpus kind at the given size and benchmarks them all.
+# results are json lines on stdout.
+SIZE=${1:-1M}
+KINDS="deep wide string escape number comment unicode"
+CORPUS_DIR="files/bench"
+
+mkdir -p $CORPUS_DIR
+
+for KIND in $KINDS; do
+    FILE="$CORPUS_DIR/$KIND-$SIZE.kdl"
+
+    if [ ! -f $FILE ]; then
+        echo "GENERATING $FILE" >&2
+        ./bin/gen $KIND $SIZE > $FILE
+    fi
+
+    ./bin/bench $FILE
+done
@@ -1,6 +1,6 @@
 TEST_SOURCES="src/**.c"
 LIB_SOURCES="../src/**.c"
-FLAGS="-lm -std=c99 -Wall -Wextra -Wpedantic"
+FLAGS="-lm -pthread -std=c99 -Wall -Wextra -Wpedantic"
 INCLUDES="-I../include"
 
 OPTIMIZE_FLAGS="-g -DDEBUG"
@@ -18,13 +18,14 @@ elif [ $# -gt 1 ]; then
     exit -1
 fi
 
-# compile
-i=1
+# compile, each program is named after its source
+mkdir -p bin
 
 for SOURCE in $TEST_SOURCES; do
     echo "COMPILING $SOURCE"
 
-    LC_ALL=C gcc $SOURCE $LIB_SOURCES $FLAGS $OPTIMIZE_FLAGS $INCLUDES -o bin/$i
+    NAME=$(basename $SOURCE .c)
 
-    ((++i))
+    LC_ALL=C gcc $SOURCE $LIB_SOURCES $FLAGS $OPTIMIZE_FLAGS $INCLUDES \
+        -o bin/$NAME
 done
@@ -0,0 +1,57 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cuddle/input.h>
+
+/*
+ * the check programs exit with 1 at the first thing that isn't as expected,
+ * see `make check`
+ */
+#define CHECK(cond)\
+    do {\
+        if (!(cond)) {\
+            fprintf(\
+                stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,\
+                #cond\
+            );\
+            exit(1);\
+        }\
+    } while (0)
+
+// hands out text a few bytes at a time, so tokens and chars get split up
+typedef struct chunks {
+    const char *text;
+    size_t len, pos, size;
+} chunks_t;
+
+static inline size_t chunks_read(const char **data, void *ctx) {
+    chunks_t *chunks = ctx;
+    size_t len = chunks->len - chunks->pos;
+
+    if (len > chunks->size)
+        len = chunks->size;
+
+    *data = chunks->text + chunks->pos;
+    chunks->pos += len;
+
+    return len;
+}
+
+// makes an input of text in chunks of size, which chunks has to outlive
+static inline void chunks_input(
+    kdl_input_t *input, chunks_t *chunks, const char *text, size_t size
+) {
+    *chunks = (chunks_t){
+        .text = text,
+        .len = strlen(text),
+        .size = size
+    };
+
+    kdl_input_make(input, chunks_read, chunks);
+}
+
+#endif
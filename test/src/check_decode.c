@@ -0,0 +1,151 @@
+#include <string.h>
+
+#include <cuddle/cuddle.h>
+#include "check.h"
+
+#define CHUNK_SIZE 3
+
+typedef struct reject_case {
+    const char *text;
+    // the annotation of the rejected value, and where the value is
+    const char *annotation;
+    size_t offset;
+} reject_case_t;
+
+static const reject_case_t CASES[] = {
+    // out of range
+    {"port (u8)300\n", "u8", 9},
+    {"a 1; b (i8)-129 2\n", "i8", 11},
+    // not in 8-4-4-4-12 form
+    {"id (uuid)\"not-a-uuid\" 2\n", "uuid", 9},
+    // no 13th month, and the decoders see values after escapes
+    {"a; b x=(date)\"2024-13-01\"\n", "date", 13},
+    {"when (date)\"2024\\u{2d}02-30\"\n", "date", 11},
+};
+
+// every std decoder accepts these
+static const char *VALID =
+    "port (u8)255 (i8)-128\n"
+    "id (uuid)\"0b3d5c2e-8f1a-4c6b-9d7e-2a4f6b8c0d1e\"\n"
+    "when (date)\"2024-02-29\" at=(date-time)\"2024-02-29T12:30:00Z\"\n";
+
+typedef enum load_mode {
+    LOAD_MEMORY,
+    LOAD_CHUNKED,
+    LOAD_PIPELINED,
+    NUM_LOAD_MODES
+} load_mode_e;
+
+static bool load(kdl_document_t *doc, const char *text, load_mode_e mode) {
+    chunks_t chunks;
+    kdl_input_t input;
+
+    kdl_document_reset(doc);
+
+    switch (mode) {
+    case LOAD_MEMORY:
+        return kdl_document_load_memory(doc, text, strlen(text));
+    case LOAD_CHUNKED:
+        chunks_input(&input, &chunks, text, CHUNK_SIZE);
+
+        return kdl_document_load(doc, &input);
+    default:
+        chunks_input(&input, &chunks, text, CHUNK_SIZE);
+
+        return kdl_document_load_pipelined(doc, &input);
+    }
+}
+
+static void check_rejected(
+    kdl_document_t *doc, const reject_case_t *c, const char *what
+) {
+    if (
+        !doc->decode_error.rejected
+        || strcmp(doc->decode_error.annotation, c->annotation)
+        || doc->decode_error.offset != c->offset
+    ) {
+        printf(
+            "%s rejected (%s) at %zu loading:\n%s", what,
+            doc->decode_error.rejected ? doc->decode_error.annotation : "",
+            doc->decode_error.offset, c->text
+        );
+    }
+
+    CHECK(doc->decode_error.rejected);
+    CHECK(!strcmp(doc->decode_error.annotation, c->annotation));
+    CHECK(doc->decode_error.offset == c->offset);
+}
+
+// a rejected value is left null, and nothing after it is loaded
+static void check_left_null(kdl_document_t *doc) {
+    const char *annotation = doc->decode_error.annotation;
+    kdl_node_t *node = doc->nodes[doc->num_nodes - 1];
+    kdl_value_t *val = node->num_props
+        ? &node->props[node->num_props - 1].value
+        : &node->args[node->num_args - 1];
+
+    CHECK(val->type == KDL_NULL);
+    CHECK(!strcmp(kdl_value_annotation(doc, val), annotation));
+    CHECK(node->num_args + node->num_props == 1);
+}
+
+static void check_on_demand(const reject_case_t *c) {
+    kdl_document_t doc;
+    size_t len = strlen(c->text);
+    char *text = malloc(len + 7);
+
+    // nested, so the value is only decoded once its block is loaded
+    sprintf(text, "a { %.*s }\n", (int)len - 1, c->text);
+
+    kdl_document_make_alloc(&doc, &KDL_DEFAULT_ALLOCATOR);
+    doc.decoders = KDL_STD_DECODERS;
+    doc.num_decoders = KDL_NUM_STD_DECODERS;
+    doc.on_demand = true;
+
+    CHECK(kdl_document_load_memory(&doc, text, strlen(text)));
+    CHECK(!doc.decode_error.rejected);
+
+    kdl_document_expand(&doc);
+
+    reject_case_t nested = *c;
+
+    nested.offset += 4;
+    check_rejected(&doc, &nested, "expanding");
+
+    kdl_document_free(&doc);
+    free(text);
+}
+
+int main() {
+    size_t num_cases = sizeof(CASES) / sizeof(CASES[0]);
+
+    kdl_document_t doc;
+    kdl_document_make_alloc(&doc, &KDL_DEFAULT_ALLOCATOR);
+    doc.decoders = KDL_STD_DECODERS;
+    doc.num_decoders = KDL_NUM_STD_DECODERS;
+
+    for (int mode = 0; mode < NUM_LOAD_MODES; ++mode) {
+        for (size_t i = 0; i < num_cases; ++i) {
+            CHECK(!load(&doc, CASES[i].text, mode));
+            check_rejected(&doc, &CASES[i], "loading");
+            check_left_null(&doc);
+        }
+
+        // errors are cleared by the next load
+        CHECK(load(&doc, VALID, mode));
+        CHECK(!doc.decode_error.rejected);
+        CHECK(doc.num_nodes == 3);
+        CHECK(doc.nodes[0]->args[0].type == KDL_UINT);
+        CHECK(doc.nodes[0]->args[1].type == KDL_INT);
+        CHECK(doc.nodes[1]->args[0].type == KDL_UUID);
+        CHECK(doc.nodes[2]->args[0].type == KDL_TIMESTAMP);
+        CHECK(doc.nodes[2]->props[0].value.type == KDL_TIMESTAMP);
+    }
+
+    for (size_t i = 0; i < num_cases; ++i)
+        check_on_demand(&CASES[i]);
+
+    kdl_document_free(&doc);
+
+    return 0;
+}
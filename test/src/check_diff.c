@@ -0,0 +1,189 @@
+#include <string.h>
+
+#include <cuddle/cuddle.h>
+#include "check.h"
+
+#define MAX_EDITS 16
+#define MAX_EDIT_LEN 64
+
+// deep enough that walking it by recursion overflows the stack
+#define DEEP 100000
+
+static const char OPS[][16] = {
+    "added", "removed", "moved", "changed",
+    "arg_added", "arg_removed", "arg_changed",
+    "prop_added", "prop_removed", "prop_changed"
+};
+
+typedef struct diff_case {
+    const char *old, *new;
+    // each edit as its op, the node it's in, and its index or prop
+    const char *edits[MAX_EDITS];
+} diff_case_t;
+
+static const diff_case_t CASES[] = {
+    // nodes which kept their order don't count as moved
+    {
+        "a; b; c\n",
+        "c; a; b\n",
+        {"moved c 0"}
+    },
+    {
+        "a 1 x=1 { k }\n",
+        "a 2 y=2 { k; l }\n",
+        {
+            "changed a 0", "arg_changed a 0", "prop_removed a x",
+            "prop_added a y", "added l 1"
+        }
+    },
+    {
+        "a 1; b 1; c 1\n",
+        "c 2; a 1; b 1\n",
+        {"moved c 0", "changed c 0", "arg_changed c 0"}
+    },
+    // removals come first at each level, before what's left is walked
+    {
+        "x { p; q 1 }; y\n",
+        "x { q 2; r }; z\n",
+        {
+            "removed y 1", "changed x 0", "removed p 0", "changed q 0",
+            "arg_changed q 0", "added r 1", "added z 1"
+        }
+    },
+    // unchanged runs at either end don't show up
+    {
+        "s; t; u 1 2; v; w\n",
+        "s; t; u 1; v; w\n",
+        {"changed u 2", "arg_removed u 1"}
+    },
+    // the nth node with an id is matched with the nth old one
+    {
+        "n 1; m; n 2\n",
+        "n 1; n 3; m\n",
+        {"moved n 1", "changed n 1", "arg_changed n 0"}
+    },
+};
+
+typedef struct edits {
+    char edits[MAX_EDITS][MAX_EDIT_LEN];
+    size_t num_edits;
+
+    // for the deep case, which is only counted
+    size_t num_changed;
+} edits_t;
+
+static void record(const kdl_diff_edit_t *edit, void *ctx) {
+    edits_t *edits = ctx;
+
+    if (edit->op == KDL_DIFF_NODE_CHANGED)
+        ++edits->num_changed;
+
+    if (edits->num_edits == MAX_EDITS)
+        return;
+
+    kdl_node_t *node = edit->new_node ? edit->new_node : edit->old_node;
+    char *out = edits->edits[edits->num_edits++];
+
+    switch (edit->op) {
+    case KDL_DIFF_PROP_ADDED:
+    case KDL_DIFF_PROP_REMOVED:
+    case KDL_DIFF_PROP_CHANGED:;
+        kdl_prop_t *prop = edit->new_prop ? edit->new_prop : edit->old_prop;
+
+        snprintf(
+            out, MAX_EDIT_LEN, "%s %s %s", OPS[edit->op], node->id, prop->id
+        );
+        break;
+    default:
+        snprintf(
+            out, MAX_EDIT_LEN, "%s %s %zu", OPS[edit->op], node->id,
+            edit->index
+        );
+        break;
+    }
+}
+
+static void load(kdl_document_t *doc, const char *text) {
+    kdl_document_make_alloc(doc, &KDL_DEFAULT_ALLOCATOR);
+    CHECK(kdl_document_load_memory(doc, text, strlen(text)));
+}
+
+static void check_case(const diff_case_t *c) {
+    kdl_document_t old_doc, new_doc;
+    edits_t edits = {0};
+
+    load(&old_doc, c->old);
+    load(&new_doc, c->new);
+
+    kdl_document_diff(&old_doc, &new_doc, record, &edits);
+
+    size_t num_expected = 0;
+
+    while (num_expected < MAX_EDITS && c->edits[num_expected])
+        ++num_expected;
+
+    bool same = edits.num_edits == num_expected;
+
+    for (size_t i = 0; same && i < num_expected; ++i)
+        same = !strcmp(edits.edits[i], c->edits[i]);
+
+    if (!same) {
+        printf("diffing:\n%sagainst:\n%sgave:\n", c->old, c->new);
+
+        for (size_t i = 0; i < edits.num_edits; ++i)
+            printf("  %s\n", edits.edits[i]);
+    }
+
+    CHECK(same);
+
+    kdl_document_free(&old_doc);
+    kdl_document_free(&new_doc);
+}
+
+// a leaf nested DEEP levels down, with an arg of its own
+static char *nest(const char *leaf) {
+    size_t len = DEEP * 6 + strlen(leaf) + 1;
+    char *text = malloc(len), *out = text;
+
+    for (size_t i = 0; i < DEEP; ++i, out += 4)
+        memcpy(out, "a {\n", 4);
+
+    out += sprintf(out, "%s", leaf);
+
+    for (size_t i = 0; i < DEEP; ++i, out += 2)
+        memcpy(out, "}\n", 2);
+
+    *out = '\0';
+
+    return text;
+}
+
+static void check_deep(void) {
+    char *old = nest("x 1\n"), *new = nest("x 2\n");
+    kdl_document_t old_doc, new_doc;
+    edits_t edits = {0};
+
+    load(&old_doc, old);
+    load(&new_doc, new);
+
+    kdl_document_diff(&old_doc, &new_doc, record, &edits);
+
+    // every level changed down to the leaf, whose arg did
+    CHECK(edits.num_changed == DEEP + 1);
+
+    kdl_document_free(&old_doc);
+    kdl_document_free(&new_doc);
+    free(old);
+    free(new);
+}
+
+int main() {
+    size_t num_cases = sizeof(CASES) / sizeof(CASES[0]);
+
+    for (size_t i = 0; i < num_cases; ++i)
+        check_case(&CASES[i]);
+
+    check_deep();
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <string.h>
+
+#include <cuddle/cuddle.h>
+#include "check.h"
+
+#define CHUNK_SIZE 3
+
+typedef struct limit_case {
+    kdl_limits_t limits;
+    // fits the limits exactly, and goes over them at offset
+    const char *fits, *over;
+    kdl_limit_e limit;
+    size_t max, offset;
+} limit_case_t;
+
+static const limit_case_t CASES[] = {
+    {
+        {.max_input_bytes = 8},
+        "a 1 2 3\n", "a 1 2 3 4\n",
+        KDL_LIMIT_INPUT_BYTES, 8, 8
+    },
+    {
+        {.max_depth = 2},
+        "a { b { c; }; }\n", "a { b { c { d; }; }; }\n",
+        KDL_LIMIT_DEPTH, 2, 10
+    },
+    {
+        {.max_nodes = 3},
+        "a; b { c; }\n", "a; b { c; }; d\n",
+        KDL_LIMIT_NODES, 3, 13
+    },
+    {
+        {.max_args = 2},
+        "a 1 \"x\" y=3\n", "a 1 \"x\" y=3 4\n",
+        KDL_LIMIT_ARGS, 2, 12
+    },
+    {
+        {.max_props = 1},
+        "a 1 x=1\n", "a 1 x=1 y=2\n",
+        KDL_LIMIT_PROPS, 1, 8
+    },
+    // names, annotations and strings all count
+    {
+        {.max_string_len = 4},
+        "abcd (wxyz)\"wxyz\"\n", "abcd \"vwxyz\"\n",
+        KDL_LIMIT_STRING_LEN, 4, 5
+    },
+    {
+        {.max_string_len = 4},
+        "abcd (wxyz)\"wxyz\"\n", "abcde\n",
+        KDL_LIMIT_STRING_LEN, 4, 0
+    },
+    {
+        {.max_string_len = 4},
+        "abcd (wxyz)\"wxyz\"\n", "abcd (vwxyz)1\n",
+        KDL_LIMIT_STRING_LEN, 4, 5
+    },
+};
+
+// loads text all at once or in chunks, which have to stop in the same place
+static bool load(kdl_document_t *doc, const char *text, bool chunked) {
+    kdl_document_reset(doc);
+
+    if (!chunked)
+        return kdl_document_load_memory(doc, text, strlen(text));
+
+    chunks_t chunks;
+    kdl_input_t input;
+
+    chunks_input(&input, &chunks, text, CHUNK_SIZE);
+
+    return kdl_document_load(doc, &input);
+}
+
+static void check_case(
+    kdl_document_t *doc, const limit_case_t *c, bool chunked
+) {
+    doc->limits = &c->limits;
+
+    CHECK(load(doc, c->fits, chunked));
+    CHECK(doc->limit_error.limit == KDL_LIMIT_NONE);
+
+    if (load(doc, c->over, chunked)) {
+        printf("loaded without going over: %s", c->over);
+        CHECK(false);
+    }
+
+    if (
+        doc->limit_error.limit != c->limit || doc->limit_error.max != c->max
+        || doc->limit_error.offset != c->offset
+    ) {
+        printf(
+            "stopped at %s (max %zu) at %zu loading:\n%s",
+            KDL_LIMITS[doc->limit_error.limit], doc->limit_error.max,
+            doc->limit_error.offset, c->over
+        );
+    }
+
+    CHECK(doc->limit_error.limit == c->limit);
+    CHECK(doc->limit_error.max == c->max);
+    CHECK(doc->limit_error.offset == c->offset);
+
+    // the same text loads without limits
+    doc->limits = NULL;
+
+    CHECK(load(doc, c->over, chunked));
+}
+
+// the arena limit depends on the layout of the tables, so it's measured
+static void check_arena(kdl_document_t *doc, bool chunked) {
+    const char *fits = "a 1 \"two\" x=3 { b; c; }\n";
+    const char *over = "a 1 \"two\" x=3 { b; c; }\nd 4\n";
+
+    doc->limits = NULL;
+
+    CHECK(load(doc, fits, chunked));
+
+    kdl_limits_t limits = {
+        .max_arena_bytes = doc->node_table.bytes_requested
+            + doc->data_table.bytes_requested
+    };
+
+    doc->limits = &limits;
+
+    CHECK(load(doc, fits, chunked));
+    CHECK(!load(doc, over, chunked));
+    CHECK(doc->limit_error.limit == KDL_LIMIT_ARENA_BYTES);
+    CHECK(doc->limit_error.max == limits.max_arena_bytes);
+    CHECK(doc->limit_error.offset >= strlen(fits));
+
+    doc->limits = NULL;
+}
+
+int main() {
+    size_t num_cases = sizeof(CASES) / sizeof(CASES[0]);
+
+    kdl_document_t doc;
+    kdl_document_make_alloc(&doc, &KDL_DEFAULT_ALLOCATOR);
+
+    for (int chunked = 0; chunked < 2; ++chunked) {
+        for (size_t i = 0; i < num_cases; ++i)
+            check_case(&doc, &CASES[i], chunked);
+
+        check_arena(&doc, chunked);
+    }
+
+    kdl_document_free(&doc);
+
+    return 0;
+}
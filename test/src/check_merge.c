@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include <cuddle/cuddle.h>
+#include "check.h"
+
+typedef struct merge_case {
+    const char *base, *overlay, *expected;
+} merge_case_t;
+
+static const merge_case_t CASES[] = {
+    // args and annotations are replaced, props are overridden one at a time
+    {
+        "(old)server \"a\" port=1 host=\"x\" { opt 1; keep }\n",
+        "(new)server \"b\" host=\"y\" user=\"z\" { opt 2; extra }\n",
+        "(new)server \"b\" port=1 host=\"y\" user=\"z\" {"
+        " opt 2; keep; extra }\n"
+    },
+    // a node without args keeps the base's
+    {
+        "item 1; item 2\n",
+        "item; item 20; item 30\n",
+        "item 1; item 20; item 30\n"
+    },
+    // replaced nodes stay where they were, children and all
+    {
+        "a; b 1 { c; d }; e\n",
+        "b 2 { f }\n",
+        "a; b 2 { f }; e\n"
+    },
+    // appended nodes never match
+    {
+        "c 1 { x }\n",
+        "c 2\n",
+        "c 1 { x }; c 2\n"
+    },
+    // rules hold at any depth
+    {
+        "root { b 1 { x }; c 1; n { deep { b 1 } } }\n",
+        "root { c 2; b 2; n { deep { b 2; b 3 } } }\n",
+        "root { b 2; c 1; n { deep { b 2; b 3 } }; c 2 }\n"
+    },
+    // the nth overlay node with an id is matched with the nth base one
+    {
+        "p 1; q 1; p 2; q 2\n",
+        "q; q a=1; q; p; p; p b=2\n",
+        "p 1; q 1; p 2; q 2 a=1; q; p b=2\n"
+    },
+};
+
+static const kdl_merge_rule_t RULES[] = {
+    {"b", KDL_MERGE_REPLACE},
+    {"c", KDL_MERGE_APPEND},
+};
+
+static void load(kdl_document_t *doc, const char *text) {
+    kdl_document_make_alloc(doc, &KDL_DEFAULT_ALLOCATOR);
+    CHECK(kdl_document_load_memory(doc, text, strlen(text)));
+}
+
+int main() {
+    kdl_merge_rules_t rules = {
+        .default_mode = KDL_MERGE_OVERRIDE,
+        .rules = RULES,
+        .num_rules = sizeof(RULES) / sizeof(RULES[0])
+    };
+
+    size_t num_cases = sizeof(CASES) / sizeof(CASES[0]);
+
+    for (size_t i = 0; i < num_cases; ++i) {
+        kdl_document_t doc, overlay, expected;
+
+        load(&doc, CASES[i].base);
+        load(&overlay, CASES[i].overlay);
+        load(&expected, CASES[i].expected);
+
+        kdl_document_merge(&doc, &overlay, &rules);
+
+        if (!kdl_document_equal(&doc, &expected)) {
+            printf("case %zu merged to:\n", i);
+            kdl_document_debug(&doc);
+            printf("instead of:\n");
+            kdl_document_debug(&expected);
+        }
+
+        CHECK(kdl_document_equal(&doc, &expected));
+
+        kdl_document_free(&doc);
+        kdl_document_free(&overlay);
+        kdl_document_free(&expected);
+    }
+
+    return 0;
+}
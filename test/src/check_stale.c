@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <cuddle/cuddle.h>
+#include "check.h"
+
+#define NUM_NODE_BLOCKS 64
+#define NUM_DATA_BLOCKS 256
+#define DATA_BLOCK_SIZE 256
+
+static const char *TEXT = "a { b; c }\nd\n";
+
+// whether using a stale handle makes the child process exit with an error
+static bool rejected(
+    kdl_document_t *doc, kdl_href_t *stale,
+    void (*use)(kdl_document_t *, kdl_href_t *)
+) {
+    fflush(stdout);
+
+    pid_t pid = fork();
+
+    CHECK(pid >= 0);
+
+    if (!pid) {
+        // the error is expected, so it doesn't need to be seen
+        freopen("/dev/null", "w", stderr);
+        use(doc, stale);
+        exit(0);
+    }
+
+    int status;
+
+    CHECK(waitpid(pid, &status, 0) == pid);
+
+    return WIFEXITED(status) && WEXITSTATUS(status) != 0;
+}
+
+static void use_remove(kdl_document_t *doc, kdl_href_t *ref) {
+    kdl_node_remove(doc, ref);
+}
+
+static void use_append(kdl_document_t *doc, kdl_href_t *ref) {
+    kdl_node_append(doc, ref, "child");
+}
+
+static void use_push_arg(kdl_document_t *doc, kdl_href_t *ref) {
+    kdl_value_t val = {
+        .type = KDL_BOOL,
+        .data.boolean = true
+    };
+
+    kdl_node_push_arg(doc, ref, &val);
+}
+
+static void check_document(kdl_document_t *doc) {
+    CHECK(kdl_document_load_memory(doc, TEXT, strlen(TEXT)));
+    CHECK(doc->num_nodes == 2);
+
+    kdl_href_t a = doc->nodes[0]->self_ref;
+    kdl_href_t b = doc->nodes[0]->children[0]->self_ref;
+    kdl_href_t c = doc->nodes[0]->children[1]->self_ref;
+    kdl_href_t d = doc->nodes[1]->self_ref;
+    kdl_href_t none = {0};
+
+    CHECK(!kdl_node_get(doc, &none));
+    CHECK(kdl_node_get(doc, &a) == doc->nodes[0]);
+
+    // removing a node takes its children with it
+    kdl_node_remove(doc, &a);
+
+    CHECK(!kdl_node_get(doc, &a));
+    CHECK(!kdl_node_get(doc, &b));
+    CHECK(!kdl_node_get(doc, &c));
+    CHECK(kdl_node_get(doc, &d) == doc->nodes[0]);
+
+    // new nodes take the freed blocks, which doesn't bring old handles back
+    kdl_href_t fresh[3];
+    bool reused = false;
+
+    for (size_t i = 0; i < 3; ++i) {
+        fresh[i] = kdl_node_append(doc, NULL, "fresh");
+        reused |= fresh[i].index == a.index;
+    }
+
+    CHECK(reused);
+    CHECK(!kdl_node_get(doc, &a));
+    CHECK(!kdl_node_get(doc, &b));
+    CHECK(!kdl_node_get(doc, &c));
+
+    for (size_t i = 0; i < 3; ++i)
+        CHECK(kdl_node_get(doc, &fresh[i]) == doc->nodes[i + 1]);
+
+    // mutating through a stale handle is an error
+    CHECK(rejected(doc, &a, use_remove));
+    CHECK(rejected(doc, &b, use_append));
+    CHECK(rejected(doc, &c, use_push_arg));
+
+    // and nothing was changed trying
+    CHECK(doc->num_nodes == 4);
+
+    // resetting makes every handle stale
+    kdl_document_reset(doc);
+
+    CHECK(!kdl_node_get(doc, &d));
+
+    for (size_t i = 0; i < 3; ++i)
+        CHECK(!kdl_node_get(doc, &fresh[i]));
+
+    CHECK(rejected(doc, &d, use_remove));
+}
+
+int main() {
+    kdl_document_buffers_t doc_bufs = {
+        .num_node_blocks = NUM_NODE_BLOCKS,
+        .data_block_size = DATA_BLOCK_SIZE,
+        .num_data_blocks = NUM_DATA_BLOCKS,
+
+        .node_blocks = calloc(sizeof(kdl_node_t), NUM_NODE_BLOCKS),
+        .data_blocks = calloc(DATA_BLOCK_SIZE, NUM_DATA_BLOCKS),
+
+        .node_meta = calloc(
+            sizeof(unsigned), KDL_HTABLE_META_LEN(NUM_NODE_BLOCKS)
+        ),
+        .data_meta = calloc(
+            sizeof(unsigned), KDL_HTABLE_META_LEN(NUM_DATA_BLOCKS)
+        ),
+    };
+
+    kdl_document_t doc;
+
+    // handles are checked the same way with fixed buffers and an allocator
+    kdl_document_make(&doc, &doc_bufs);
+    check_document(&doc);
+
+    kdl_document_make_alloc(&doc, &KDL_DEFAULT_ALLOCATOR);
+    check_document(&doc);
+    kdl_document_free(&doc);
+
+    free(doc_bufs.node_blocks);
+    free(doc_bufs.data_blocks);
+    free(doc_bufs.node_meta);
+    free(doc_bufs.data_meta);
+
+    return 0;
+}
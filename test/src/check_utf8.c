@@ -0,0 +1,90 @@
+#include <string.h>
+
+#include <cuddle/cuddle.h>
+#include "check.h"
+
+static void load_chunked(
+    kdl_document_t *doc, const char *text, size_t size, bool pipelined,
+    bool expect_ok
+) {
+    chunks_t chunks;
+    kdl_input_t input;
+
+    chunks_input(&input, &chunks, text, size);
+    kdl_document_reset(doc);
+
+    bool ok = pipelined
+        ? kdl_document_load_pipelined(doc, &input)
+        : kdl_document_load(doc, &input);
+
+    CHECK(ok == expect_ok);
+    CHECK(doc->utf8_error.invalid == !expect_ok);
+}
+
+int main() {
+    // 2, 3 and 4 byte chars, with enough of them to be validated in bulk
+    const char *valid =
+        "node \"h\xC3\xA9llo \xE2\x82\xAC\xE2\x82\xAC\xE2\x82\xAC "
+        "\xF0\x9F\x98\x80\xF0\x9F\x98\x80\xF0\x9F\x98\x80\"\n";
+    const char *valid_string =
+        "h\xC3\xA9llo \xE2\x82\xAC\xE2\x82\xAC\xE2\x82\xAC "
+        "\xF0\x9F\x98\x80\xF0\x9F\x98\x80\xF0\x9F\x98\x80";
+
+    // the error is the first byte which can't be where it is
+    struct {
+        const char *text;
+        size_t offset;
+    } invalid[] = {
+        // a 3 byte char cut short by the closing quote
+        {"node \"\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9 ab\xE2\x82\" x\n", 19},
+        // a continuation byte with nothing before it
+        {"node \"\xE2\x82\xAC\xE2\x82\xAC\xE2\x82\xAC \x80\"\n", 16},
+        // an overlong encoding of '/'
+        {"a \"\xF0\x9F\x98\x80\xF0\x9F\x98\x80 \xC0\xAF\"\n", 12},
+        // a surrogate
+        {"b 1\nc \"\xF0\x9F\x98\x80\xF0\x9F\x98\x80\xED\xA0\x80\"\n", 16},
+        // input which ends partway through a char, at its lead byte
+        {"node ab\xE2\x82", 7},
+        {"node \"ab\xE2\x82", 8},
+        {"node 1\n\xF0\x9F", 7},
+        {"node \"\xE2\x82\xAC\xE2\x82\xAC\xE2\x82\xAC\xF0\x9F\x98", 15},
+    };
+    size_t num_invalid = sizeof(invalid) / sizeof(invalid[0]);
+
+    kdl_document_t doc;
+    kdl_document_make_alloc(&doc, &KDL_DEFAULT_ALLOCATOR);
+
+    // every chunk size puts the splits somewhere else
+    for (size_t size = 1; size <= strlen(valid); ++size) {
+        for (int pipelined = 0; pipelined < 2; ++pipelined) {
+            load_chunked(&doc, valid, size, pipelined, true);
+
+            CHECK(doc.num_nodes == 1);
+            CHECK(doc.nodes[0]->num_args == 1);
+            CHECK(!strcmp(
+                kdl_value_string(&doc, &doc.nodes[0]->args[0]), valid_string
+            ));
+        }
+    }
+
+    for (size_t i = 0; i < num_invalid; ++i) {
+        const char *text = invalid[i].text;
+
+        for (size_t size = 1; size <= strlen(text); ++size) {
+            for (int pipelined = 0; pipelined < 2; ++pipelined) {
+                load_chunked(&doc, text, size, pipelined, false);
+                CHECK(doc.utf8_error.offset == invalid[i].offset);
+            }
+        }
+
+        // and all at once
+        kdl_document_reset(&doc);
+
+        CHECK(!kdl_document_load_memory(&doc, text, strlen(text)));
+        CHECK(doc.utf8_error.offset == invalid[i].offset);
+    }
+
+    kdl_document_free(&doc);
+
+    return 0;
+}
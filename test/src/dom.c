@@ -13,6 +13,13 @@ int main() {
         .data_blocks = calloc(
             doc_bufs.data_block_size, doc_bufs.num_data_blocks
         ),
+
+        .node_meta = calloc(
+            sizeof(unsigned), KDL_HTABLE_META_LEN(doc_bufs.num_node_blocks)
+        ),
+        .data_meta = calloc(
+            sizeof(unsigned), KDL_HTABLE_META_LEN(doc_bufs.num_data_blocks)
+        ),
     };
 
     kdl_document_t doc;
@@ -24,6 +31,8 @@ int main() {
 
     free(doc_bufs.node_blocks);
     free(doc_bufs.data_blocks);
+    free(doc_bufs.node_meta);
+    free(doc_bufs.data_meta);
 
     return 0;
 }
@@ -0,0 +1,63 @@
+#!/usr/bin/env bash
+# packs cuddle into a single header and a single source file, which go in the
+# directory given (bin by default):
+#
+# - cuddle.h is every public header
+# - cuddle.c is every source, and includes cuddle.h
+#
+# compiling cuddle.c along with a program, or including it into one, puts the
+# whole library in the same translation unit as the code using it, so the
+# tokenizer's per-character path inlines without lto.
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${1:-$ROOT/bin}
+
+declare -A EMITTED
+
+# prints a file with the cuddle headers it includes inlined the first time
+emit() {
+    local file=$1 dir=$(dirname "$1")
+
+    while IFS= read -r line; do
+        if [[ $line =~ ^#include\ \<cuddle/([a-z0-9_]+\.h)\> ]]; then
+            emit_once "$ROOT/include/cuddle/${BASH_REMATCH[1]}"
+        elif [[ $line =~ ^#include\ \"([a-z0-9_]+\.h)\" ]]; then
+            emit_once "$dir/${BASH_REMATCH[1]}"
+        elif [[ $line != "#define _GNU_SOURCE" ]]; then
+            printf '%s\n' "$line"
+        fi
+    done < "$file"
+}
+
+emit_once() {
+    if [ -z "${EMITTED[$1]}" ]; then
+        EMITTED[$1]=1
+        echo "/* $(basename "$1") */"
+        emit "$1"
+    fi
+}
+
+mkdir -p "$OUT"
+
+{
+    echo "/* cuddle amalgamated header, generated by tools/amalgamate.sh */"
+    emit_once "$ROOT/include/cuddle/cuddle.h"
+} > "$OUT/cuddle.h"
+
+{
+    echo "/* cuddle amalgamated source, generated by tools/amalgamate.sh */"
+    # syscall(), mmap() and posix_fadvise() aren't c99, see src/input.c
+    echo "#define _GNU_SOURCE"
+    echo
+    echo "#include \"cuddle.h\""
+
+    for SOURCE in "$ROOT"/src/*.c; do
+        echo "/* $(basename "$SOURCE") */"
+        emit "$SOURCE"
+
+        # macros a source defines for itself stop at its end
+        sed -n 's/^#define \([A-Za-z_][A-Za-z0-9_]*\).*/#undef \1/p' "$SOURCE" \
+            | grep -v "_GNU_SOURCE" || true
+    done
+} > "$OUT/cuddle.c"
@@ -0,0 +1,421 @@
+/*
+ * cuddlegen: generates c structs and kdl_bind_struct_t tables (see
+ * cuddle/bind.h) from a schema, so that documents can be bound straight into
+ * typed structs in one pass.
+ *
+ * usage: cuddlegen <schema.kdl> <output path without extension>
+ *
+ * writes <output>.h and <output>.c. a schema is a list of structs, and the
+ * first one is the root that a document's top level binds to:
+ *
+ *     struct "server" {
+ *         field "host" type="string" size=64
+ *         field "port" type="int"
+ *         field "ratio" type="double"
+ *         field "verbose" type="bool"
+ *         field "listen" type="int" count=8   // long listen[8], num_listen
+ *         field "tls" type="tls"              // another struct
+ *     }
+ *
+ *     struct "tls" {
+ *         field "cert-file" type="string" size=256 c-name="cert_file"
+ *     }
+ *
+ * names that aren't c identifiers get their other characters replaced with
+ * '_', or can be given explicitly with c-name.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/cuddle.h>
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
+
+#define MAX_STRUCTS 64
+#define MAX_FIELDS 128
+#define NAME_SIZE 128
+
+typedef struct gen_field {
+    char *name;
+    char c_name[NAME_SIZE];
+    kdl_bind_kind_e kind;
+    struct gen_struct *type;
+    size_t size, count;
+} gen_field_t;
+
+typedef struct gen_struct {
+    char *name;
+    char c_name[NAME_SIZE];
+    gen_field_t fields[MAX_FIELDS];
+    size_t num_fields;
+
+    // perfect hash
+    short slots[MAX_FIELDS * 4];
+    unsigned seed, mask;
+
+    unsigned emitted: 1;
+    unsigned visiting: 1;
+} gen_struct_t;
+
+static gen_struct_t structs[MAX_STRUCTS];
+static size_t num_structs;
+
+static void to_c_name(char dst[NAME_SIZE], const char *name) {
+    size_t i;
+
+    for (i = 0; name[i] && i < NAME_SIZE - 1; ++i)
+        dst[i] = isalnum((unsigned char)name[i]) ? name[i] : '_';
+
+    dst[i] = '\0';
+}
+
+static gen_struct_t *find_struct(const char *name) {
+    for (size_t i = 0; i < num_structs; ++i)
+        if (!strcmp(structs[i].name, name))
+            return &structs[i];
+
+    return NULL;
+}
+
+static kdl_value_t *find_prop(kdl_node_t *node, const char *id) {
+    for (size_t i = 0; i < node->num_props; ++i)
+        if (!strcmp(node->props[i].id, id))
+            return &node->props[i].value;
+
+    return NULL;
+}
+
+// the document isn't changed after loading, so names stay where they are
+static char *expect_name(kdl_document_t *doc, kdl_node_t *node) {
+    if (node->num_args != 1 || node->args[0].type != KDL_STRING)
+        KDL_ERROR("\"%s\" expects a single string name.\n", node->id);
+
+    return kdl_value_text(doc, &node->args[0]);
+}
+
+static size_t number_prop(kdl_node_t *node, const char *id, size_t def) {
+    kdl_value_t *val = find_prop(node, id);
+
+    if (!val)
+        return def;
+    else if (val->type != KDL_NUMBER || val->data.number < 1)
+        KDL_ERROR("\"%s\" must be a positive number.\n", id);
+
+    return (size_t)val->data.number;
+}
+
+static void load_schema(kdl_document_t *doc) {
+    // declare structs first so fields can reference any of them
+    for (size_t i = 0; i < doc->num_nodes; ++i) {
+        kdl_node_t *node = doc->nodes[i];
+
+        if (strcmp(node->id, "struct"))
+            KDL_ERROR("unknown schema node \"%s\".\n", node->id);
+        else if (num_structs == MAX_STRUCTS)
+            KDL_ERROR("too many structs in schema.\n");
+
+        gen_struct_t *st = &structs[num_structs++];
+
+        st->name = expect_name(doc, node);
+        to_c_name(st->c_name, st->name);
+
+        if (find_struct(st->name) != st)
+            KDL_ERROR("struct \"%s\" is defined twice.\n", st->name);
+    }
+
+    for (size_t i = 0; i < doc->num_nodes; ++i) {
+        kdl_node_t *node = doc->nodes[i];
+        gen_struct_t *st = &structs[i];
+
+        for (size_t j = 0; j < node->num_children; ++j) {
+            kdl_node_t *child = node->children[j];
+
+            if (strcmp(child->id, "field"))
+                KDL_ERROR("unknown struct node \"%s\".\n", child->id);
+            else if (st->num_fields == MAX_FIELDS)
+                KDL_ERROR("too many fields in \"%s\".\n", st->name);
+
+            gen_field_t *field = &st->fields[st->num_fields++];
+            kdl_value_t *type = find_prop(child, "type");
+            kdl_value_t *c_name = find_prop(child, "c-name");
+
+            field->name = expect_name(doc, child);
+            field->count = number_prop(child, "count", 0);
+
+            if (c_name && c_name->type == KDL_STRING)
+                to_c_name(field->c_name, kdl_value_text(doc, c_name));
+            else
+                to_c_name(field->c_name, field->name);
+
+            if (!type || type->type != KDL_STRING)
+                KDL_ERROR("field \"%s\" needs a type.\n", field->name);
+
+            char *type_name = kdl_value_text(doc, type);
+
+            if (!strcmp(type_name, "int")) {
+                field->kind = KDL_BIND_INT;
+            } else if (!strcmp(type_name, "double")) {
+                field->kind = KDL_BIND_DOUBLE;
+            } else if (!strcmp(type_name, "bool")) {
+                field->kind = KDL_BIND_BOOL;
+            } else if (!strcmp(type_name, "string")) {
+                field->kind = KDL_BIND_STRING;
+                field->size = number_prop(child, "size", 0);
+
+                if (!field->size)
+                    KDL_ERROR("string \"%s\" needs a size.\n", field->name);
+            } else if ((field->type = find_struct(type_name))) {
+                field->kind = KDL_BIND_STRUCT;
+            } else {
+                KDL_ERROR("unknown type \"%s\".\n", type_name);
+            }
+
+            for (size_t k = 0; k + 1 < st->num_fields; ++k)
+                if (!strcmp(st->fields[k].name, field->name))
+                    KDL_ERROR("field \"%s\" is defined twice.\n", field->name);
+        }
+    }
+}
+
+/*
+ * finds a seed for which every field name hashes to its own slot. the table
+ * starts at twice the number of fields and doubles if no seed works.
+ */
+static void build_hash(gen_struct_t *st) {
+    size_t size = 2;
+
+    while (size < st->num_fields * 2)
+        size *= 2;
+
+    for (; size <= ARRAY_SIZE(st->slots); size *= 2) {
+        for (unsigned seed = 0; seed < 100000; ++seed) {
+            bool collision = false;
+
+            for (size_t i = 0; i < size; ++i)
+                st->slots[i] = -1;
+
+            for (size_t i = 0; i < st->num_fields && !collision; ++i) {
+                gen_field_t *field = &st->fields[i];
+                unsigned slot = kdl_bind_hash(
+                    field->name, strlen(field->name), seed
+                ) & (size - 1);
+
+                if (st->slots[slot] >= 0)
+                    collision = true;
+                else
+                    st->slots[slot] = i;
+            }
+
+            if (!collision) {
+                st->seed = seed;
+                st->mask = size - 1;
+
+                return;
+            }
+        }
+    }
+
+    KDL_ERROR("couldn't find a perfect hash for \"%s\".\n", st->name);
+}
+
+static const char *c_type(gen_field_t *field) {
+    static char buf[NAME_SIZE + 2];
+
+    switch (field->kind) {
+    case KDL_BIND_INT: return "long";
+    case KDL_BIND_DOUBLE: return "double";
+    case KDL_BIND_BOOL: return "bool";
+    case KDL_BIND_STRING: return "char";
+    case KDL_BIND_STRUCT:
+        snprintf(buf, sizeof(buf), "%s_t", field->type->c_name);
+
+        return buf;
+    }
+
+    return NULL;
+}
+
+static const char *KIND_NAMES[] = {
+    "KDL_BIND_INT", "KDL_BIND_DOUBLE", "KDL_BIND_BOOL", "KDL_BIND_STRING",
+    "KDL_BIND_STRUCT"
+};
+
+// structs are emitted after the structs they contain
+static void emit_struct(FILE *fp, gen_struct_t *st) {
+    if (st->emitted)
+        return;
+    else if (st->visiting)
+        KDL_ERROR("struct \"%s\" contains itself.\n", st->name);
+
+    st->visiting = true;
+
+    for (size_t i = 0; i < st->num_fields; ++i)
+        if (st->fields[i].kind == KDL_BIND_STRUCT)
+            emit_struct(fp, st->fields[i].type);
+
+    fprintf(fp, "typedef struct %s {\n", st->c_name);
+
+    for (size_t i = 0; i < st->num_fields; ++i) {
+        gen_field_t *field = &st->fields[i];
+
+        fprintf(fp, "    %s %s", c_type(field), field->c_name);
+
+        if (field->count)
+            fprintf(fp, "[%zu]", field->count);
+
+        if (field->kind == KDL_BIND_STRING)
+            fprintf(fp, "[%zu]", field->size);
+
+        fprintf(fp, ";\n");
+
+        if (field->count)
+            fprintf(fp, "    size_t num_%s;\n", field->c_name);
+    }
+
+    fprintf(fp, "} %s_t;\n\n", st->c_name);
+
+    st->visiting = false;
+    st->emitted = true;
+}
+
+static void emit_header(FILE *fp, const char *schema, const char *guard) {
+    gen_struct_t *root = &structs[0];
+
+    fprintf(fp, "// generated by cuddlegen from %s, do not edit\n", schema);
+    fprintf(fp, "#ifndef %s\n#define %s\n\n", guard, guard);
+    fprintf(fp, "#include <stddef.h>\n#include <stdbool.h>\n\n");
+    fprintf(fp, "#include <cuddle/bind.h>\n\n");
+
+    for (size_t i = 0; i < num_structs; ++i)
+        emit_struct(fp, &structs[i]);
+
+    for (size_t i = 0; i < num_structs; ++i)
+        fprintf(fp, "extern const kdl_bind_struct_t %s_bind;\n", structs[i].c_name);
+
+    fprintf(
+        fp,
+        "\n"
+        "// binds a whole document into out, false if it isn't utf-8\n"
+        "static inline bool %s_parse(char *data, size_t length, %s_t *out) {\n"
+        "    return kdl_bind_parse(&%s_bind, out, data, length);\n"
+        "}\n\n",
+        root->c_name, root->c_name, root->c_name
+    );
+
+    fprintf(fp, "#endif\n");
+}
+
+static void emit_source(FILE *fp, const char *schema, const char *header) {
+    fprintf(fp, "// generated by cuddlegen from %s, do not edit\n", schema);
+    fprintf(fp, "#include \"%s\"\n", header);
+
+    for (size_t i = 0; i < num_structs; ++i) {
+        gen_struct_t *st = &structs[i];
+        const char *cn = st->c_name;
+
+        fprintf(fp, "\nstatic const kdl_bind_field_t %s_fields[] = {\n", cn);
+
+        for (size_t j = 0; j < st->num_fields; ++j) {
+            gen_field_t *field = &st->fields[j];
+            const char *fn = field->c_name;
+
+            fprintf(
+                fp, "    { \"%s\", %zu, %s, offsetof(%s_t, %s), ",
+                field->name, strlen(field->name), KIND_NAMES[field->kind],
+                cn, fn
+            );
+
+            if (field->count) {
+                fprintf(
+                    fp, "sizeof(((%s_t *)0)->%s[0]), %zu, "
+                    "offsetof(%s_t, num_%s), ",
+                    cn, fn, field->count, cn, fn
+                );
+            } else {
+                fprintf(fp, "sizeof(((%s_t *)0)->%s), 0, 0, ", cn, fn);
+            }
+
+            if (field->type)
+                fprintf(fp, "&%s_bind },\n", field->type->c_name);
+            else
+                fprintf(fp, "NULL },\n");
+        }
+
+        // empty structs still need an array to point at
+        if (!st->num_fields)
+            fprintf(fp, "    { NULL, 0, KDL_BIND_INT, 0, 0, 0, 0, NULL }\n");
+
+        fprintf(fp, "};\n\n");
+        fprintf(fp, "static const short %s_slots[] = {", cn);
+
+        for (size_t j = 0; j <= st->mask; ++j)
+            fprintf(fp, "%s%d", j ? ", " : " ", st->slots[j]);
+
+        fprintf(fp, " };\n\n");
+        fprintf(
+            fp,
+            "const kdl_bind_struct_t %s_bind = {\n"
+            "    \"%s\", %s_fields, %zu, %s_slots, %uu, %uu\n"
+            "};\n",
+            cn, st->name, cn, st->num_fields, cn, st->seed, st->mask
+        );
+    }
+}
+
+static FILE *open_output(const char *base, const char *ext) {
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s%s", base, ext);
+
+    FILE *fp = fopen(path, "w");
+
+    if (!fp)
+        KDL_ERROR("couldn't open \"%s\" for writing.\n", path);
+
+    return fp;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: cuddlegen <schema.kdl> <output path>\n");
+        exit(-1);
+    }
+
+    kdl_document_t doc;
+    kdl_document_make_alloc(&doc, &KDL_DEFAULT_ALLOCATOR);
+    kdl_document_load_file(&doc, argv[1]);
+
+    load_schema(&doc);
+
+    if (!num_structs)
+        KDL_ERROR("schema has no structs.\n");
+
+    for (size_t i = 0; i < num_structs; ++i)
+        build_hash(&structs[i]);
+
+    // names for the include and guard come from the output's base name
+    const char *base = argv[2];
+    const char *file = strrchr(base, '/') ? strrchr(base, '/') + 1 : base;
+    char header[NAME_SIZE + 2], guard[NAME_SIZE + 2];
+
+    snprintf(header, sizeof(header), "%s.h", file);
+    to_c_name(guard, header);
+
+    for (char *trav = guard; *trav; ++trav)
+        *trav = toupper((unsigned char)*trav);
+
+    FILE *fp = open_output(base, ".h");
+    emit_header(fp, argv[1], guard);
+    fclose(fp);
+
+    fp = open_output(base, ".c");
+    emit_source(fp, argv[1], header);
+    fclose(fp);
+
+    kdl_document_free(&doc);
+
+    return 0;
+}
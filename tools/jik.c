@@ -0,0 +1,71 @@
+/*
+ * jik: streams json to json-in-kdl or back, see cuddle/jik.h.
+ *
+ * usage: jik <to-kdl|to-json> < input > output
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cuddle/meta.h>
+#include <cuddle/jik.h>
+
+#define BUF_SIZE (64 * 1024)
+
+static char read_buf[BUF_SIZE], write_buf[BUF_SIZE];
+static char tok_bufs[3][BUF_SIZE];
+
+static void write_stdout(const char *data, size_t length, void *ctx) {
+    (void)ctx;
+
+    if (fwrite(data, 1, length, stdout) != length)
+        KDL_ERROR("couldn't write to stdout.\n");
+}
+
+int main(int argc, char **argv) {
+    bool to_kdl = argc == 2 && !strcmp(argv[1], "to-kdl");
+
+    if (!to_kdl && !(argc == 2 && !strcmp(argv[1], "to-json"))) {
+        fprintf(stderr, "usage: jik <to-kdl|to-json> < input > output\n");
+        exit(-1);
+    }
+
+    kdl_output_t out;
+    kdl_output_make(&out, write_buf, BUF_SIZE, write_stdout, NULL);
+
+    kdl_jik_encoder_t enc;
+    kdl_jik_decoder_t dec;
+
+    if (to_kdl) {
+        kdl_jik_encoder_make(&enc, &out, tok_bufs[0], BUF_SIZE, tok_bufs[1]);
+    } else {
+        kdl_jik_decoder_make(
+            &dec, &out, tok_bufs[0], BUF_SIZE, tok_bufs[1], tok_bufs[2]
+        );
+    }
+
+    size_t read;
+
+    while ((read = fread(read_buf, 1, BUF_SIZE, stdin))) {
+        if (to_kdl) {
+            kdl_jik_encoder_feed(&enc, read_buf, read);
+        } else if (!kdl_jik_decoder_feed(&dec, read_buf, read)) {
+            KDL_ERROR(
+                "invalid utf-8 at byte %zu.\n", dec.tzr.utf8.error.offset
+            );
+        }
+    }
+
+    if (ferror(stdin))
+        KDL_ERROR("couldn't read stdin.\n");
+
+    if (to_kdl) {
+        kdl_jik_encoder_finish(&enc);
+    } else if (!kdl_jik_decoder_finish(&dec)) {
+        KDL_ERROR(
+            "invalid utf-8 at byte %zu.\n", dec.tzr.utf8.error.offset
+        );
+    }
+
+    return 0;
+}